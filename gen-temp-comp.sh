@@ -0,0 +1,51 @@
+#!/bin/bash
+#
+# Generates the temperature compensation table for main.c.
+#
+# Usage: gen-temp-comp.sh [reference] [linear] [quadratic]
+#
+# The fit models how far the moisture reading of a sample at temperature
+# T drifts from its reading at the reference temperature (in °C):
+#
+#	measured = actual * (1 + linear*(T-reference) + quadratic*(T-reference)^2)
+#
+# The table holds the gain that undoes this, 1/(1 + ...), every 8°C
+# from -40°C to 88°C, in 1/16384ths. The defaults make a flat table, which
+# leaves readings as-is. Gains that don't fit in 16 bits are clamped with
+# a warning.
+
+REFERENCE=${1:-20}
+LINEAR=${2:-0}
+QUADRATIC=${3:-0}
+
+MIN=-40
+STEP_SHIFT=7	# 8°C in 1/16ths of a degree
+POINTS=17
+ONE=16384
+
+awk -v ref="$REFERENCE" -v lin="$LINEAR" -v quad="$QUADRATIC" \
+	-v min="$MIN" -v shift="$STEP_SHIFT" -v points="$POINTS" -v one="$ONE" '
+BEGIN {
+	step = 2^shift / 16;
+
+	printf("// Generated by gen-temp-comp.sh %s %s %s, do not edit.\n\n", ref, lin, quad);
+	printf("#define TEMP_COMP_MIN\t\t\t(%d)\t//!< Temperature of the first entry, in °C\n", min);
+	printf("#define TEMP_COMP_STEP_SHIFT\t(%d)\t//!< log2 of the spacing, in 1/16ths of a °C\n", shift);
+	printf("#define TEMP_COMP_POINTS\t\t(%d)\n", points);
+	printf("#define TEMP_COMP_ONE\t\t\t(%d)\n\n", one);
+	printf("#define TEMP_COMP_TABLE { \\\n");
+
+	for(i = 0; i < points; i++) {
+		t = min + i * step - ref;
+		drift = 1 + lin * t + quad * t * t;
+		gain = (drift > 0) ? int(one / drift + 0.5) : 65536;
+		if(gain > 65535) {
+			printf("gen-temp-comp.sh: warning: gain at %d°C clamped to 65535 (%s)\n",
+				min + i * step, (drift > 0) ? sprintf("%.0f", one / drift) : "drift <= 0") > "/dev/stderr";
+			gain = 65535;
+		}
+		printf("\t%5d,\t/* %4d°C */ \\\n", gain, min + i * step);
+	}
+
+	printf("}\n");
+}'
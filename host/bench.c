@@ -0,0 +1,184 @@
+/*	@title Conversion Pipeline Benchmark
+**
+**	Runs do_convert() from main.c against the simulated sensing
+**	circuit for every oversample exponent and temperature resolution,
+**	reporting the number of pulse-loop iterations, ADC conversions,
+**	estimated AVR cycles and the resulting on-target conversion time.
+**
+**	The output is deterministic (other than the host time column),
+**	so it can be diffed against a previous run to catch conversion
+**	latency regressions.
+**
+**	@legal
+**	This package is free software; you can redistribute it and/or
+**	modify it under the terms of the GNU General Public License
+**	version 2 as published by the Free Software Foundation.
+**
+**	This package is distributed in the hope that it will be useful,
+**	but WITHOUT ANY WARRANTY; without even the implied warranty of
+**	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+**	General Public License for more details.
+**	@endlegal
+*/
+
+#include "../main.c"
+
+#undef main
+
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+// ----------------------------------------------------------------------------
+#pragma mark Helpers
+
+static uint64_t
+host_time_ns() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void
+bench_init() {
+	sim_reset();
+
+	DDRB = _BV(MOIST_COLLECTOR_PIN) | _BV(MOIST_DRIVE_PIN);
+	PORTB = ~(_BV(COMM_SDA) | _BV(MOIST_COLLECTOR_PIN) | _BV(MOIST_DRIVE_PIN));
+
+#if SUPPORT_VOLT_READING || SUPPORT_TEMP_READING
+	ADCSRA = _BV(ADEN) | _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0);
+#endif
+
+	do_recall();
+
+	// The firmware converts with interrupts on, as main() leaves them.
+	sei();
+}
+
+static int precision = -1;		//!< Overrides calib.precision if set
+static int filter = -1;			//!< Overrides calib.filter if set
+
+static void
+bench_run(uint8_t exponent, uint8_t temp_res) {
+	uint64_t start;
+	uint64_t host_ns;
+	uint8_t used = exponent;
+
+	bench_init();
+
+	calib.flags = (calib.flags & ~OVERSAMPLE_COUNT_EXPONENT_MASK) | exponent;
+	cfg.flags = (cfg.flags & ~TEMP_RESOLUTION_MASK) | temp_res;
+#if SUPPORT_ADAPTIVE_OVERSAMPLE
+	if(precision >= 0)
+		calib.precision = precision;
+#endif
+#if DO_FILTERING
+	if(filter >= 0)
+		calib.filter = filter;
+#endif
+
+	start = host_time_ns();
+	do_convert(CONVERT_ALL);
+	host_ns = host_time_ns() - start;
+
+#if SUPPORT_ADAPTIVE_OVERSAMPLE
+	used = cfg.oversample;
+#endif
+
+	printf(
+		"%3u %4u %4u %10lu %7lu %12llu %10.3f %5s %10.1f\n",
+		exponent,
+		temp_res,
+		used,
+		(unsigned long)sim_stats.moist_pulses,
+		(unsigned long)sim_stats.adc_conversions,
+		(unsigned long long)sim_stats.cycles,
+		(double)sim_stats.cycles * 1000.0 / F_CPU,
+		(cfg.flags & CFG_FLAG_ERROR) ? "ERR" : "ok",
+		host_ns / 1000.0
+	);
+}
+
+static void
+usage(const char* name) {
+	fprintf(stderr,
+		"usage: %s [-p pulses] [-n noise] [-v vcc] [-t temp] [-e exp] [-r res] [-a prec] [-f filter]\n"
+		"\n"
+		"  -p pulses  Pulses per measurement of the simulated sensor (%g)\n"
+		"  -n noise   Peak-to-peak noise, in pulses (%g)\n"
+		"  -v vcc     Supply voltage (%g)\n"
+		"  -t temp    Temperature, in degrees C (%g)\n"
+		"  -e exp     Only run the given oversample exponent\n"
+		"  -r res     Only run the given temperature resolution\n"
+		"  -a prec    Adaptive oversampling precision, in 1/16ths of a pulse\n"
+		"  -f filter  Moisture filter, as in CALIB_FILTER\n",
+		name,
+		sim_model.moist_pulses,
+		sim_model.moist_noise,
+		sim_model.vcc,
+		sim_model.temp_c
+	);
+}
+
+// ----------------------------------------------------------------------------
+#pragma mark -
+#pragma mark Main
+
+int
+main(int argc, char* argv[]) {
+	int only_exponent = -1;
+	int only_temp_res = -1;
+	int c;
+
+	// main.c addresses the memory pages as one contiguous block.
+	if(((uintptr_t)&cfg != (uintptr_t)&value + 8)
+	    || ((uintptr_t)&calib != (uintptr_t)&cfg + 8)
+	) {
+		fprintf(stderr, "Memory pages are not contiguous, check HOST_CFLAGS\n");
+		return 1;
+	}
+
+	while((c = getopt(argc, argv, "p:n:v:t:e:r:a:f:h")) != -1) {
+		switch(c) {
+		case 'p': sim_model.moist_pulses = atof(optarg); break;
+		case 'n': sim_model.moist_noise = atof(optarg); break;
+		case 'v': sim_model.vcc = atof(optarg); break;
+		case 't': sim_model.temp_c = atof(optarg); break;
+		case 'e': only_exponent = atoi(optarg); break;
+		case 'r': only_temp_res = atoi(optarg); break;
+		case 'a': precision = atoi(optarg); break;
+		case 'f': filter = strtol(optarg, NULL, 0); break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	printf("# F_CPU=%lu pulses=%g noise=%g vcc=%g temp=%g\n",
+		(unsigned long)F_CPU,
+		sim_model.moist_pulses,
+		sim_model.moist_noise,
+		sim_model.vcc,
+		sim_model.temp_c
+	);
+	printf("%3s %4s %4s %10s %7s %12s %10s %5s %10s\n",
+		"exp", "tres", "used", "iterations", "adc", "cycles", "ms", "stat", "host-us");
+
+	for(uint8_t exponent = 0; exponent <= OVERSAMPLE_COUNT_EXPONENT_MASK; exponent++) {
+		if((only_exponent >= 0) && (only_exponent != exponent))
+			continue;
+#if SUPPORT_TEMP_READING
+		for(uint8_t temp_res = 0; temp_res <= TEMP_RESOLUTION_MASK; temp_res++) {
+			if((only_temp_res >= 0) && (only_temp_res != temp_res))
+				continue;
+			bench_run(exponent, temp_res);
+		}
+#else
+		bench_run(exponent, 0);
+#endif
+	}
+
+	return 0;
+}
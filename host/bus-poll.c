@@ -0,0 +1,143 @@
+/*	@title Bus Master Example
+**
+**	Enumerates every sensor on a loopback bus with SEARCH (or ALARM
+**	SEARCH), then polls them all with a single broadcast CONVERT_T
+**	followed by RD_VALUES from each device, printing what was found
+**	along with the slots and bus time each step took.
+**
+**	@legal
+**	This package is free software; you can redistribute it and/or
+**	modify it under the terms of the GNU General Public License
+**	version 2 as published by the Free Software Foundation.
+**
+**	This package is distributed in the hope that it will be useful,
+**	but WITHOUT ANY WARRANTY; without even the implied warranty of
+**	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+**	General Public License for more details.
+**	@endlegal
+*/
+
+#include "busmaster.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static void
+print_stats(const char* what, const struct bus_stats_t* stats) {
+	printf("# %-10s %8u resets %10llu slots %12.3f ms\n",
+		what,
+		stats->resets,
+		(unsigned long long)stats->slots,
+		stats->time_us / 1000.0
+	);
+}
+
+static void
+usage(const char* name) {
+	fprintf(stderr,
+		"usage: %s [-n count] [-s serial] [-b bus] [-a] [-q]\n"
+		"\n"
+		"  -n count   Number of devices on the bus (8)\n"
+		"  -s serial  Serial number of the first device (1)\n"
+		"  -b bus     Bus timing: std, od or fxb (std)\n"
+		"  -a         Enumerate with ALARM SEARCH instead of SEARCH\n"
+		"  -q         Only print the totals\n",
+		name
+	);
+}
+
+int
+main(int argc, char* argv[]) {
+	const struct bus_timing_t* timing = &bus_timing_standard;
+	struct bus_loopback_t* loopback;
+	struct bus_transport_t transport;
+	struct bus_master_t master;
+	struct bus_search_t search;
+	struct bus_values_t* values;
+	uint8_t (*roms)[8];
+	uint32_t count = 8;
+	uint64_t serial = 1;
+	uint8_t search_cmd = BUS_ROMCMD_SEARCH;
+	bool quiet = false;
+	uint32_t found = 0;
+	int failed;
+	int ret;
+	int c;
+
+	while((c = getopt(argc, argv, "n:s:b:aqh")) != -1) {
+		switch(c) {
+		case 'n': count = strtoul(optarg, NULL, 0); break;
+		case 's': serial = strtoull(optarg, NULL, 0); break;
+		case 'a': search_cmd = BUS_ROMCMD_ALARM_SEARCH; break;
+		case 'q': quiet = true; break;
+		case 'b':
+			if(!strcmp(optarg, "std")) {
+				timing = &bus_timing_standard;
+			} else if(!strcmp(optarg, "od")) {
+				timing = &bus_timing_overdrive;
+			} else if(!strcmp(optarg, "fxb")) {
+				timing = &bus_timing_foxbus;
+			} else {
+				usage(argv[0]);
+				return 1;
+			}
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	loopback = bus_loopback_create(count, serial, timing);
+	roms = calloc(count ? count : 1, sizeof(*roms));
+	values = calloc(count ? count : 1, sizeof(*values));
+	if(!loopback || !roms || !values) {
+		fprintf(stderr, "Out of memory\n");
+		return 1;
+	}
+
+	bus_loopback_transport(loopback, &transport);
+	bus_init(&master, &transport, timing);
+
+	printf("# bus=%s devices=%u\n", timing->name, count);
+
+	bus_search_begin(&search, search_cmd);
+	while((ret = bus_search_next(&master, &search)) == 1) {
+		if(found < count)
+			memcpy(roms[found], search.rom, 8);
+		found++;
+	}
+	if(ret < 0)
+		fprintf(stderr, "Search failed (%d)\n", ret);
+
+	print_stats("search", &master.stats);
+	if(found > count)
+		found = count;
+
+	memset(&master.stats, 0, sizeof(master.stats));
+	failed = bus_poll_all(&master, (const uint8_t (*)[8])roms, found, values);
+	print_stats("poll", &master.stats);
+
+	if(!quiet) {
+		for(uint32_t i = 0; i != found; i++) {
+			for(uint8_t j = 0; j != 8; j++)
+				printf("%02x", roms[i][j]);
+			printf(" moist=%5u raw=%5u temp=%7.3f flags=%02x\n",
+				values[i].moisture,
+				values[i].raw,
+				values[i].temp / 16.0,
+				values[i].flags
+			);
+		}
+	}
+
+	printf("# found=%u failed=%d\n", found, failed);
+
+	bus_loopback_free(loopback);
+	free(roms);
+	free(values);
+
+	return (ret < 0) || failed;
+}
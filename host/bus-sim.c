@@ -0,0 +1,269 @@
+/*	@title Virtual Bus Scaling Report
+**
+**	Builds loopback buses of increasing size out of simulated sensors
+**	(see busmaster.h) and reports, for each, what it costs to:
+**
+**	 *	enumerate: find every device with SEARCH,
+**	 *	poll: convert on every device at once and read each one back
+**		with RD_VALUES,
+**	 *	alarm: find the devices whose readings changed with ALARM
+**		SEARCH, when only some of them did.
+**	 *	history: read back the last few readings of every device in
+**		one go with RD_HISTORY, instead of polling for each of them.
+**
+**	Each line gives reset pulses, time slots, whole bytes, estimated
+**	bus time (total and per device) and the host time the simulation
+**	took. The output is deterministic other than the host time.
+**
+**	@legal
+**	This package is free software; you can redistribute it and/or
+**	modify it under the terms of the GNU General Public License
+**	version 2 as published by the Free Software Foundation.
+**
+**	This package is distributed in the hope that it will be useful,
+**	but WITHOUT ANY WARRANTY; without even the implied warranty of
+**	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+**	General Public License for more details.
+**	@endlegal
+*/
+
+#include "busmaster.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// ----------------------------------------------------------------------------
+#pragma mark Helpers
+
+static uint64_t
+host_time_ns() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void
+report(
+	uint32_t count,
+	const char* phase,
+	uint32_t devices,
+	const struct bus_stats_t* stats,
+	uint64_t host_ns,
+	int status
+) {
+	printf("%7u %-9s %7u %8u %10llu %9llu %12.3f %9.3f %10.1f %4s\n",
+		count,
+		phase,
+		devices,
+		stats->resets,
+		(unsigned long long)stats->slots,
+		(unsigned long long)stats->bytes,
+		stats->time_us / 1000.0,
+		devices ? stats->time_us / 1000.0 / devices : 0.0,
+		host_ns / 1000000.0,
+		status ? "ERR" : "ok"
+	);
+}
+
+//!	Runs a whole SEARCH or ALARM SEARCH, returning the number of devices found.
+static uint32_t
+enumerate(
+	struct bus_master_t* master,
+	uint8_t cmd,
+	uint8_t (*roms)[8],
+	uint32_t max,
+	int* status
+) {
+	struct bus_search_t search;
+	uint32_t found = 0;
+	int ret;
+
+	bus_search_begin(&search, cmd);
+	while((ret = bus_search_next(master, &search)) == 1) {
+		if(found < max)
+			memcpy(roms[found], search.rom, 8);
+		found++;
+	}
+
+	*status = (ret < 0) || (found > max);
+	return found;
+}
+
+// ----------------------------------------------------------------------------
+#pragma mark -
+#pragma mark Report
+
+static const struct bus_timing_t* timing = &bus_timing_standard;
+static double changed_pct = 1;
+static double convert_ms = 150;
+static uint8_t history_len = 4;
+
+static int
+run(uint32_t count) {
+	struct bus_loopback_t* loopback;
+	struct bus_transport_t transport;
+	struct bus_master_t master;
+	struct bus_values_t* values;
+	struct bus_record_t records[BUS_HISTORY_MAX];
+	uint8_t (*roms)[8];
+	uint32_t found;
+	uint32_t changed = 0;
+	uint64_t start;
+	int status;
+	int failed = 0;
+
+	loopback = bus_loopback_create(count, 1, timing);
+	roms = calloc(count ? count : 1, sizeof(*roms));
+	values = calloc(count ? count : 1, sizeof(*values));
+	if(!loopback || !roms || !values) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+
+	loopback->convert_us = convert_ms * 1000.0;
+	loopback->history_len = history_len;
+	bus_loopback_transport(loopback, &transport);
+	bus_init(&master, &transport, timing);
+
+	// Enumerate
+	start = host_time_ns();
+	found = enumerate(&master, BUS_ROMCMD_SEARCH, roms, count, &status);
+	status |= (found != count);
+	report(count, "enumerate", found, &master.stats, host_time_ns() - start, status);
+	failed |= status;
+
+	// Poll
+	memset(&master.stats, 0, sizeof(master.stats));
+	start = host_time_ns();
+	status = bus_poll_all(&master, (const uint8_t (*)[8])roms, found, values);
+	report(count, "poll", found, &master.stats, host_time_ns() - start, status);
+	failed |= status;
+
+	// Mark an evenly spread subset of the devices as changed,
+	// as if their readings had moved past the change threshold.
+	for(uint32_t i = 0; i != count; i++) {
+		if((uint32_t)((i + 1) * changed_pct / 100.0) != (uint32_t)(i * changed_pct / 100.0)) {
+			loopback->devices[i].mem[BUS_MEM_CFG_FLAGS] |= BUS_CFG_FLAG_CHANGED;
+			changed++;
+		}
+	}
+
+	memset(&master.stats, 0, sizeof(master.stats));
+	start = host_time_ns();
+	found = enumerate(&master, BUS_ROMCMD_ALARM_SEARCH, roms, count, &status);
+	status |= (found != changed);
+	report(count, "alarm", found, &master.stats, host_time_ns() - start, status);
+	failed |= status;
+
+	// Read the history once every device has filled it, which takes
+	// the ROM IDs back from the ALARM SEARCH.
+	for(uint8_t i = 1; i < history_len; i++)
+		bus_command(&master, NULL, BUS_FUNCCMD_CONVERT_T);
+	found = enumerate(&master, BUS_ROMCMD_SEARCH, roms, count, &status);
+	status |= (found != count);
+
+	memset(&master.stats, 0, sizeof(master.stats));
+	start = host_time_ns();
+	for(uint32_t i = 0; i != found; i++) {
+		uint16_t seq;
+		uint8_t records_read;
+
+		if((bus_read_history(&master, roms[i], &seq, records, &records_read) != BUS_OK)
+		    || (records_read != history_len)
+		    || (seq != history_len)
+		)
+			status = 1;
+	}
+	report(count, "history", found, &master.stats, host_time_ns() - start, status);
+	failed |= status;
+
+	bus_loopback_free(loopback);
+	free(roms);
+	free(values);
+
+	return failed;
+}
+
+static void
+usage(const char* name) {
+	fprintf(stderr,
+		"usage: %s [-n counts] [-b bus] [-c percent] [-t ms] [-r records]\n"
+		"\n"
+		"  -n counts   Comma separated device counts (1,10,100,1000,10000)\n"
+		"  -b bus      Bus timing: std, od or fxb (std)\n"
+		"  -c percent  Devices with changed readings for ALARM SEARCH (1)\n"
+		"  -t ms       Conversion time of the simulated devices (150)\n"
+		"  -r records  Records read out by each RD_HISTORY (4)\n",
+		name
+	);
+}
+
+int
+main(int argc, char* argv[]) {
+	const char* counts = "1,10,100,1000,10000";
+	int failed = 0;
+	int c;
+
+	while((c = getopt(argc, argv, "n:b:c:t:r:h")) != -1) {
+		switch(c) {
+		case 'n': counts = optarg; break;
+		case 'c': changed_pct = atof(optarg); break;
+		case 't': convert_ms = atof(optarg); break;
+		case 'r':
+			history_len = strtoul(optarg, NULL, 0);
+			if(!history_len || (history_len > BUS_HISTORY_MAX)) {
+				usage(argv[0]);
+				return 1;
+			}
+			break;
+		case 'b':
+			if(!strcmp(optarg, "std")) {
+				timing = &bus_timing_standard;
+			} else if(!strcmp(optarg, "od")) {
+				timing = &bus_timing_overdrive;
+			} else if(!strcmp(optarg, "fxb")) {
+				timing = &bus_timing_foxbus;
+			} else {
+				usage(argv[0]);
+				return 1;
+			}
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	printf("# bus=%s slot=%gus reset=%gus convert=%gms changed=%g%% history=%u\n",
+		timing->name,
+		timing->slot,
+		timing->reset,
+		convert_ms,
+		changed_pct,
+		history_len
+	);
+	printf("%7s %-9s %7s %8s %10s %9s %12s %9s %10s %4s\n",
+		"devices", "phase", "found", "resets", "slots", "bytes",
+		"bus-ms", "ms/dev", "host-ms", "stat");
+
+	while(*counts) {
+		char* end;
+		const uint32_t count = strtoul(counts, &end, 0);
+
+		if(end == counts) {
+			usage(argv[0]);
+			return 1;
+		}
+		failed |= run(count);
+
+		counts = end;
+		if(*counts == ',')
+			counts++;
+	}
+
+	return failed;
+}
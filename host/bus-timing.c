@@ -0,0 +1,505 @@
+/*	@title Bus Timing Budget Report
+**
+**	Drives the bit-level bus routines in main.c (comm_read_bit,
+**	comm_write_bit and comm_send_presence) with a scripted bus master
+**	on the simulated bus, and reports how much timing margin they
+**	leave for the physical protocol and clock speed main.c was built
+**	for:
+**
+**	 *	Response latency: time from the master opening a slot to the
+**		device pulling the bus low, worst case and jitter.
+**	 *	Sample margin: how far the master's sample point is from the
+**		nearest edge of the device's response.
+**	 *	Presence: latency and width of the presence response.
+**	 *	Minimum safe slot: shortest slot period for which every bit in
+**		both directions is still transferred correctly.
+**
+**	Master slot starts are dithered by a few cycles, which models the
+**	master's clock being unrelated to ours and exposes the jitter
+**	caused by the device's polling loops. See sim.h for how cycles
+**	are estimated.
+**
+**	@legal
+**	This package is free software; you can redistribute it and/or
+**	modify it under the terms of the GNU General Public License
+**	version 2 as published by the Free Software Foundation.
+**
+**	This package is distributed in the hope that it will be useful,
+**	but WITHOUT ANY WARRANTY; without even the implied warranty of
+**	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+**	General Public License for more details.
+**	@endlegal
+*/
+
+#include "../main.c"
+
+#undef main
+
+#include <stdio.h>
+#include <unistd.h>
+
+// ----------------------------------------------------------------------------
+#pragma mark Master Timing Profiles
+
+#define US_TO_CYCLES(us)	((uint64_t)((us) * (F_CPU / 1000000.0) + 0.5))
+#define CYCLES_TO_US(c)		((double)(c) * 1000000.0 / F_CPU)
+
+#define MAX_INTERVALS		(64)
+#define MAX_EDGES			(256)
+#define SLOT_DITHER			(13)	//!< Cycles of dither on slot starts
+
+//!	Timing used by the bus master, all in microseconds.
+struct master_profile_t {
+	const char* phy;
+	bool	overdrive;		//!< Run with the device in overdrive
+	double	slot;			//!< Nominal slot period
+	double	slot_step;		//!< Resolution of the minimum slot search
+	double	write1_low;		//!< Low time when writing a '1' (or opening a slot)
+	double	write0_low;		//!< Low time when writing a '0' (1-Wire only)
+	double	mark_delay;		//!< Delay from release to the '1' mark (Fox-Bus only)
+	double	mark_low;		//!< Width of the '1' mark (Fox-Bus only)
+	double	read_sample;	//!< Sample point of a read slot, from slot open
+	double	reset_low;		//!< Reset pulse width
+	double	presence_sample;	//!< Presence sample point, after reset release
+};
+
+#if COMM_PHY_PROTO == COMM_PHY_1WIRE
+static const struct master_profile_t profiles[] = {
+	{	// Standard speed 1-Wire® master timing.
+		.phy				= "1-Wire",
+		.slot				= 70,
+		.slot_step			= 1,
+		.write1_low			= 6,
+		.write0_low			= 60,
+		.read_sample		= 15,
+		.reset_low			= 480,
+		.presence_sample	= 70,
+	},
+#if SUPPORT_OVERDRIVE
+	{	// Overdrive speed 1-Wire® master timing.
+		.phy				= "1-Wire-OD",
+		.overdrive			= true,
+		.slot				= 10,
+		.slot_step			= 0.25,
+		.write1_low			= 1,
+		.write0_low			= 7.5,
+		.read_sample		= 2,
+		.reset_low			= 70,
+		.presence_sample	= 9,
+	},
+#endif
+};
+#elif COMM_PHY_PROTO == COMM_PHY_FxB
+// Fox-Bus™: Every slot is opened by a short low pulse. The master
+// sends a '1' with a second "mark" pulse after the slot opens, and
+// the device sends a '0' by pulling the bus low shortly after the
+// opening pulse ends.
+static const struct master_profile_t profiles[] = {
+	{
+		.phy				= "Fox-Bus",
+		.slot				= 300,
+		.slot_step			= 1,
+		.write1_low			= 5,
+		.mark_delay			= 10,
+		.mark_low			= 20,
+		.read_sample		= 5 + 7.5,
+		.reset_low			= 480,
+		.presence_sample	= 20 + 5 + 7.5,
+	},
+};
+#else
+#error bus-timing only supports single-wire physical protocols
+#endif
+
+static const struct master_profile_t* profile;
+
+#if defined(__AVR_ATtiny25__)
+#define DEVICE_NAME "attiny25"
+#else
+#define DEVICE_NAME "attiny13a"
+#endif
+
+// ----------------------------------------------------------------------------
+#pragma mark -
+#pragma mark Scripted Bus Master
+
+struct interval_t {
+	uint64_t start;
+	uint64_t end;
+};
+
+struct edge_t {
+	uint64_t cycle;
+	uint8_t low;
+};
+
+static struct interval_t intervals[MAX_INTERVALS];
+static uint8_t interval_count;
+
+static struct edge_t edges[MAX_EDGES];
+static uint16_t edge_count;
+
+static uint64_t deadline;
+static jmp_buf timeout_jmp;
+
+static uint8_t
+master_level(uint64_t cycle) {
+	if(cycle > deadline)
+		longjmp(timeout_jmp, 1);
+
+	for(uint8_t i = 0; i < interval_count; i++)
+		if((cycle >= intervals[i].start) && (cycle < intervals[i].end))
+			return 0;
+	return 1;
+}
+
+static uint64_t
+master_next_edge(uint64_t cycle) {
+	uint64_t ret = UINT64_MAX;
+
+	for(uint8_t i = 0; i < interval_count; i++) {
+		if((intervals[i].start > cycle) && (intervals[i].start < ret))
+			ret = intervals[i].start;
+		if((intervals[i].end > cycle) && (intervals[i].end < ret))
+			ret = intervals[i].end;
+	}
+
+	// Make sure a stuck device still reaches the deadline.
+	if((ret == UINT64_MAX) && (deadline != UINT64_MAX) && (deadline > cycle))
+		ret = deadline + 1;
+
+	return ret;
+}
+
+static void
+slave_changed(uint8_t pulling_low, uint64_t cycle) {
+	if(edge_count < MAX_EDGES) {
+		edges[edge_count].cycle = cycle;
+		edges[edge_count].low = pulling_low;
+		edge_count++;
+	}
+}
+
+static const struct sim_bus_t master_bus = {
+	.master_level		= master_level,
+	.master_next_edge	= master_next_edge,
+	.slave_changed		= slave_changed,
+};
+
+static void
+master_begin() {
+	interval_count = 0;
+	edge_count = 0;
+	deadline = UINT64_MAX;
+}
+
+static void
+master_pull(uint64_t start, double low_us) {
+	if(interval_count < MAX_INTERVALS) {
+		intervals[interval_count].start = start;
+		intervals[interval_count].end = start + US_TO_CYCLES(low_us);
+		interval_count++;
+	}
+}
+
+//!	Returns true if the device is pulling the bus low at `cycle`.
+static uint8_t
+slave_low_at(uint64_t cycle) {
+	uint8_t low = 0;
+
+	for(uint16_t i = 0; (i < edge_count) && (edges[i].cycle <= cycle); i++)
+		low = edges[i].low;
+	return low;
+}
+
+//!	Returns the first edge of the given polarity in [start, end).
+static struct edge_t*
+slave_edge_in(uint64_t start, uint64_t end, uint8_t low) {
+	for(uint16_t i = 0; i < edge_count; i++)
+		if((edges[i].low == low)
+		    && (edges[i].cycle >= start)
+		    && (edges[i].cycle < end)
+		)
+			return &edges[i];
+	return NULL;
+}
+
+static uint64_t
+slot_start(uint64_t base, uint8_t i, double slot_us) {
+	return base + i * US_TO_CYCLES(slot_us) + (i * 5) % SLOT_DITHER;
+}
+
+// ----------------------------------------------------------------------------
+#pragma mark -
+#pragma mark Device Setup
+
+static jmp_buf device_reset_jmp;
+
+//!	Mirrors the register setup performed by main().
+static void
+device_init() {
+	TCCR0B = 0;
+	DDRB = _BV(MOIST_COLLECTOR_PIN) | _BV(MOIST_DRIVE_PIN);
+	PORTB = ~(_BV(COMM_SDA) | _BV(MOIST_COLLECTOR_PIN) | _BV(MOIST_DRIVE_PIN));
+	TIMSK0 = _BV(TOIE0);
+#if SUPPORT_CONVERT_INDICATOR && (COMM_PHY_PROTO == COMM_PHY_1WIRE)
+	OCR0A = (uint8_t)((uint32_t)OWSLAVE_T_X * F_CPU / (8l * 1000000l));
+#elif SUPPORT_CONVERT_INDICATOR && (COMM_PHY_PROTO == COMM_PHY_FxB)
+	OCR0A = (uint8_t)((uint32_t)COMM_FxB_T_BUSY * F_CPU / (8l * 1000000l));
+#endif
+	sbi(PCMSK, COMM_SDA);
+	sbi(GIMSK, PCIE);
+	sei();
+}
+
+// ----------------------------------------------------------------------------
+#pragma mark -
+#pragma mark Measurements
+
+struct results_t {
+	uint32_t	errors;
+	uint64_t	latency_min;
+	uint64_t	latency_max;
+	int64_t		margin_min;
+	uint64_t	presence_latency;
+	uint64_t	presence_width;
+	uint8_t		presence_ok;
+};
+
+static const uint8_t patterns[] = { 0x00, 0xFF, 0xA5, 0x5A, COMM_ROMCMD_READ };
+
+//!	Master writes `byte`, device reads it with comm_read_byte().
+static uint8_t
+test_master_write(uint8_t byte, double slot_us) {
+	const uint64_t base = sim_stats.cycles + US_TO_CYCLES(slot_us);
+
+	master_begin();
+	device_init();
+	for(uint8_t i = 0; i != 8; i++) {
+		const uint64_t start = slot_start(base, i, slot_us);
+		const uint8_t bit = (byte >> i) & 1;
+
+#if COMM_PHY_PROTO == COMM_PHY_1WIRE
+		master_pull(start, bit ? profile->write1_low : profile->write0_low);
+#else
+		master_pull(start, profile->write1_low);
+		if(bit)
+			master_pull(
+				start + US_TO_CYCLES(profile->write1_low + profile->mark_delay),
+				profile->mark_low
+			);
+#endif
+	}
+	deadline = slot_start(base, 9, slot_us);
+
+	if(setjmp(timeout_jmp))
+		return 0;
+
+	return comm_read_byte() == byte;
+}
+
+//!	Master reads a byte which the device sends with comm_write_byte().
+static uint8_t
+test_master_read(uint8_t byte, double slot_us, struct results_t* results) {
+	const uint64_t base = sim_stats.cycles + US_TO_CYCLES(slot_us);
+	uint8_t ok = 1;
+
+	master_begin();
+	device_init();
+	for(uint8_t i = 0; i != 8; i++)
+		master_pull(slot_start(base, i, slot_us), profile->write1_low);
+	deadline = slot_start(base, 9, slot_us);
+
+	if(setjmp(timeout_jmp))
+		return 0;
+
+	comm_write_byte(byte);
+
+	for(uint8_t i = 0; i != 8; i++) {
+		const uint64_t start = slot_start(base, i, slot_us);
+		const uint64_t sample = start + US_TO_CYCLES(profile->read_sample);
+		const uint8_t bit = (byte >> i) & 1;
+		struct edge_t* assert;
+		struct edge_t* release;
+
+		if(slave_low_at(sample) == bit) {
+			ok = 0;
+			continue;
+		}
+
+		if(bit || !results)
+			continue;
+
+		assert = slave_edge_in(start, start + US_TO_CYCLES(slot_us), 1);
+		release = slave_edge_in(start, start + US_TO_CYCLES(slot_us), 0);
+		if(!assert || !release)
+			continue;
+
+		if(assert->cycle - start < results->latency_min)
+			results->latency_min = assert->cycle - start;
+		if(assert->cycle - start > results->latency_max)
+			results->latency_max = assert->cycle - start;
+
+		{
+			int64_t margin = (int64_t)(sample - assert->cycle);
+
+			if((int64_t)(release->cycle - sample) < margin)
+				margin = (int64_t)(release->cycle - sample);
+			if(margin < results->margin_min)
+				results->margin_min = margin;
+		}
+	}
+
+	return ok;
+}
+
+//!	Master sends a reset pulse and looks for the presence response.
+static void
+test_presence(struct results_t* results) {
+	const uint64_t base = sim_stats.cycles + US_TO_CYCLES(profile->slot);
+	const uint64_t release = base + US_TO_CYCLES(profile->reset_low);
+	const uint64_t sample = release + US_TO_CYCLES(profile->presence_sample);
+	struct edge_t* assert;
+	struct edge_t* done;
+
+	master_begin();
+	device_init();
+	master_pull(base, profile->reset_low);
+#if COMM_PHY_PROTO == COMM_PHY_FxB
+	// Presence is a '0' sent in the first slot after the reset.
+	master_pull(release + US_TO_CYCLES(20), profile->write1_low);
+#endif
+	deadline = sample + US_TO_CYCLES(profile->slot * 2);
+
+	if(setjmp(timeout_jmp))
+		return;
+
+	sim_reset_jmp = &device_reset_jmp;
+	if(!setjmp(device_reset_jmp)) {
+		// Idle like the wait_for_reset loop in main()
+		// until the reset pulse is detected.
+		for(;;)
+			sim_delay_cycles(16);
+	}
+	sim_reset_jmp = NULL;
+
+	device_init();
+#if SUPPORT_OVERDRIVE
+	if(bit_is_clear(PINB, COMM_SDA))
+		comm_overdrive = false;
+#endif
+	comm_send_presence();
+
+	assert = slave_edge_in(release, deadline, 1);
+	done = assert ? slave_edge_in(assert->cycle, deadline, 0) : NULL;
+
+	results->presence_ok = slave_low_at(sample) && assert && done;
+	if(assert && done) {
+		results->presence_latency = assert->cycle - release;
+		results->presence_width = done->cycle - assert->cycle;
+	}
+}
+
+static uint32_t
+run_transfers(double slot_us, struct results_t* results) {
+	uint32_t errors = 0;
+
+	for(uint8_t i = 0; i < sizeof(patterns); i++) {
+		if(!test_master_write(patterns[i], slot_us))
+			errors++;
+		if(!test_master_read(patterns[i], slot_us, results))
+			errors++;
+	}
+
+	return errors;
+}
+
+static void
+device_start() {
+	master_begin();
+	sim_reset();
+	sim_bus = &master_bus;
+	device_init();
+	do_recall();
+#if SUPPORT_OVERDRIVE
+	comm_overdrive = profile->overdrive;
+#endif
+}
+
+// ----------------------------------------------------------------------------
+#pragma mark -
+#pragma mark Main
+
+static uint8_t
+run_profile() {
+	struct results_t results = {
+		.latency_min = UINT64_MAX,
+		.margin_min = INT64_MAX,
+	};
+	double min_slot = 0;
+
+	device_start();
+	results.errors = run_transfers(profile->slot, &results);
+	test_presence(&results);
+
+	// Walk the slot period down until something breaks.
+	for(double slot = profile->slot;
+	    slot > profile->write1_low;
+	    slot -= profile->slot_step
+	) {
+		device_start();
+		if(run_transfers(slot, NULL))
+			break;
+		min_slot = slot;
+	}
+
+	printf("%-9s %-9s %8lu %6.1f %7.2f %7.2f %6.2f %7.2f %8.2f %7.2f %8.2f %s\n",
+		profile->phy,
+		DEVICE_NAME,
+		(unsigned long)F_CPU,
+		profile->slot,
+		results.latency_min == UINT64_MAX ? 0 : CYCLES_TO_US(results.latency_min),
+		CYCLES_TO_US(results.latency_max),
+		results.latency_min == UINT64_MAX ? 0
+			: CYCLES_TO_US(results.latency_max - results.latency_min),
+		results.margin_min == INT64_MAX ? 0 : CYCLES_TO_US(results.margin_min),
+		CYCLES_TO_US(results.presence_latency),
+		CYCLES_TO_US(results.presence_width),
+		min_slot,
+		(results.errors || !results.presence_ok) ? "FAIL" : "ok"
+	);
+
+	return results.errors || !results.presence_ok;
+}
+
+int
+main(int argc, char* argv[]) {
+	uint8_t status = 0;
+	int c;
+
+	sim_model.poll_overhead = 4;
+
+	while((c = getopt(argc, argv, "Hk:")) != -1) {
+		switch(c) {
+		case 'H':
+			printf("%-9s %-9s %8s %6s %7s %7s %6s %7s %8s %7s %8s %s\n",
+				"phy", "device", "f_cpu", "slot",
+				"lat-min", "lat-max", "jitter", "margin",
+				"pres-lat", "pres-w", "min-slot", "status");
+			return 0;
+		case 'k':
+			sim_model.poll_overhead = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-H] [-k poll-overhead-cycles]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	for(uint8_t i = 0; i < sizeof(profiles) / sizeof(*profiles); i++) {
+		profile = &profiles[i];
+		status |= run_profile();
+	}
+
+	return status;
+}
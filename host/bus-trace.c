@@ -0,0 +1,1131 @@
+/*	@title Bus Trace Decoder
+**
+**	Decodes a trace of SDA, either the VCD written by the simulator
+**	(see `matrix-run -t`) or one exported from a logic analyzer, with
+**	the same ROM and function commands main.c answers. It prints one
+**	line for every transaction, a summary for every device addressed,
+**	and histograms of the timing of each kind of slot.
+**
+**	Only the level of the wire is looked at, so who sent what is
+**	worked out from the protocol, just as a master would. A VCD may
+**	hold other signals too, -s picks the one to decode (SDA, or else
+**	the first one, by default). A CSV export has the time in seconds in
+**	its first column and a digital level in the column named by -s (the
+**	second, by default), with an optional header line.
+**
+**	Standard and overdrive speed 1-Wire are told apart the way the
+**	device does it: OD_SKIP and OD_MATCH switch to overdrive until the
+**	next standard speed reset pulse.
+**
+**	@legal
+**	This package is free software; you can redistribute it and/or
+**	modify it under the terms of the GNU General Public License
+**	version 2 as published by the Free Software Foundation.
+**
+**	This package is distributed in the hope that it will be useful,
+**	but WITHOUT ANY WARRANTY; without even the implied warranty of
+**	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+**	General Public License for more details.
+**	@endlegal
+*/
+
+#include "../main.c"
+
+#undef main
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <unistd.h>
+
+// Built as 1-Wire with everything in, see the Makefile,
+// so that every command main.c knows of is defined.
+#if !SUPPORT_OVERDRIVE || !SUPPORT_RD_VALUES || !SUPPORT_HISTORY \
+	|| !EMULATE_DS18B20 || !SUPPORT_DEVICE_NAMING
+#error bus-trace must be built with every function command
+#endif
+
+#define US(us)				((us) * 1000.0)		//!< Trace times are in ns
+
+#define MAX_SLOTS			(8192)	//!< Per transaction
+#define MAX_DEVICES			(64)
+#define HISTOGRAM_BINS		(8)
+
+// ----------------------------------------------------------------------------
+#pragma mark -
+#pragma mark Timing
+
+enum {
+	SPEED_STD,
+	SPEED_OD,
+	SPEED_FXB,
+	SPEED_COUNT
+};
+
+//!	Thresholds the decoder uses, in microseconds.
+static const struct speed_t {
+	const char* name;
+	double sample;			//!< Where a '0' is told from a '1'
+	double reset;			//!< Shortest reset pulse
+	double window;			//!< Presence (1-Wire) or second pulse (Fox-Bus) starts within
+} speeds[SPEED_COUNT] = {
+	// 1-Wire® times are from the start of the slot.
+	[SPEED_STD] = { "std", 15, 240, 120 },
+	[SPEED_OD] = { "od", 2, 48, 16 },
+	// Fox-Bus™ times are from the end of the opening pulse.
+	[SPEED_FXB] = { "fxb", 7.5, 240, 40 },
+};
+
+enum {
+	KIND_RESET,
+	KIND_PRESENCE_LATENCY,
+	KIND_PRESENCE_WIDTH,
+	KIND_WRITE1,
+	KIND_WRITE0,
+	KIND_READ1,
+	KIND_READ0,
+	KIND_OPEN,
+	KIND_MARK_DELAY,
+	KIND_MARK_WIDTH,
+	KIND_RESPONSE,
+	KIND_RESPONSE_WIDTH,
+	KIND_MARGIN,
+	KIND_PERIOD,
+	KIND_RECOVERY,
+	KIND_COUNT
+};
+
+static const char* const kind_names[KIND_COUNT] = {
+	[KIND_RESET] = "reset low",
+	[KIND_PRESENCE_LATENCY] = "presence latency",
+	[KIND_PRESENCE_WIDTH] = "presence width",
+	[KIND_WRITE1] = "write-1 low",
+	[KIND_WRITE0] = "write-0 low",
+	[KIND_READ1] = "read-1 low",
+	[KIND_READ0] = "read-0 low",
+	[KIND_OPEN] = "opening pulse",
+	[KIND_MARK_DELAY] = "mark delay",
+	[KIND_MARK_WIDTH] = "mark width",
+	[KIND_RESPONSE] = "device delay",
+	[KIND_RESPONSE_WIDTH] = "device width",
+	[KIND_MARGIN] = "read-0 margin",
+	[KIND_PERIOD] = "slot period",
+	[KIND_RECOVERY] = "recovery",
+};
+
+//!	Every time seen of one kind, in microseconds.
+struct series_t {
+	double* v;
+	size_t count;
+	size_t size;
+};
+
+static struct series_t stats[SPEED_COUNT][KIND_COUNT];
+
+static void
+stat_add(uint8_t speed, uint8_t kind, double ns) {
+	struct series_t* series = &stats[speed][kind];
+
+	if(series->count == series->size) {
+		series->size = series->size ? series->size * 2 : 256;
+		series->v = realloc(series->v, series->size * sizeof(*series->v));
+		if(!series->v) {
+			fprintf(stderr, "Out of memory\n");
+			exit(1);
+		}
+	}
+	series->v[series->count++] = ns / 1000.0;
+}
+
+static void
+stat_print(const char* speed, const char* name, const struct series_t* series) {
+	unsigned bins[HISTOGRAM_BINS] = { 0 };
+	double min = series->v[0];
+	double max = series->v[0];
+	double sum = 0;
+	size_t i;
+
+	for(i = 0; i != series->count; i++) {
+		if(series->v[i] < min)
+			min = series->v[i];
+		if(series->v[i] > max)
+			max = series->v[i];
+		sum += series->v[i];
+	}
+
+	for(i = 0; i != series->count; i++) {
+		unsigned bin = (max > min)
+			? (unsigned)((series->v[i] - min) * HISTOGRAM_BINS / (max - min))
+			: 0;
+
+		bins[(bin < HISTOGRAM_BINS) ? bin : HISTOGRAM_BINS - 1]++;
+	}
+
+	printf("%-4s %-17s %7zu %9.2f %9.2f %9.2f  ",
+		speed, name, series->count, min, sum / series->count, max);
+	for(i = 0; i != HISTOGRAM_BINS; i++)
+		printf(" %5u", bins[i]);
+	printf("\n");
+}
+
+// ----------------------------------------------------------------------------
+#pragma mark -
+#pragma mark Slots
+
+//!	One slot, as seen on the wire. Times are in ns.
+struct slot_t {
+	double start;			//!< Slot opens
+	double end;				//!< Bus released
+	double mark_start;		//!< Fox-Bus second pulse, if has_mark
+	double mark_end;
+	uint8_t has_mark;
+	uint8_t speed;
+};
+
+static struct {
+	double start;			//!< Reset pulse
+	double release;
+	uint8_t speed;
+	uint8_t awaiting_presence;
+	uint8_t presence;
+	double presence_latency;
+	double presence_width;
+	struct slot_t slots[MAX_SLOTS];
+	unsigned count;
+	unsigned dropped;		//!< Slots past MAX_SLOTS
+} txn;
+
+static bool in_txn;
+static uint8_t bus_speed;	//!< Speed of 1-Wire slots to come
+static bool is_fxb;
+
+static struct slot_t pending;	//!< Fox-Bus slot still open to a second pulse
+static bool has_pending;
+
+enum {
+	CRC_ROM,
+	CRC_RD_MEM,
+	CRC_WR_MEM,
+	CRC_VALUES,
+	CRC_HISTORY,
+	CRC_SCRATCH,
+	CRC_KIND_COUNT
+};
+
+static const char* const crc_kind_names[CRC_KIND_COUNT] = {
+	[CRC_ROM] = "rom",
+	[CRC_RD_MEM] = "rd_mem",
+	[CRC_WR_MEM] = "wr_mem",
+	[CRC_VALUES] = "rd_values",
+	[CRC_HISTORY] = "rd_history",
+	[CRC_SCRATCH] = "rd_scratch",
+};
+
+static struct {
+	unsigned transactions;
+	unsigned no_presence;
+	unsigned truncated;
+	unsigned stray;			//!< Slots outside of any command
+	unsigned crc_checked;
+	unsigned crc_errors;
+	unsigned crc_kind_errors[CRC_KIND_COUNT];
+} totals;
+
+static void decode_txn(void);
+
+//!	When the bus was last released in `slot`.
+static double
+slot_end(const struct slot_t* slot) {
+	return slot->has_mark ? slot->mark_end : slot->end;
+}
+
+static void
+slot_add(const struct slot_t* slot) {
+	if(!in_txn) {
+		totals.stray++;
+		return;
+	}
+	if(txn.count == MAX_SLOTS) {
+		txn.dropped++;
+		return;
+	}
+	txn.slots[txn.count++] = *slot;
+
+	// OD_SKIP and OD_MATCH switch speed from the next slot on.
+	if((txn.count == 8) && !is_fxb && (bus_speed == SPEED_STD)) {
+		uint8_t byte = 0;
+
+		for(uint8_t i = 0; i != 8; i++)
+			if(txn.slots[i].end - txn.slots[i].start < US(speeds[SPEED_STD].sample))
+				byte |= (1 << i);
+		if((byte == COMM_ROMCMD_OD_SKIP) || (byte == COMM_ROMCMD_OD_MATCH))
+			bus_speed = SPEED_OD;
+	}
+}
+
+static void
+txn_begin(double fall, double rise) {
+	if(in_txn)
+		decode_txn();
+
+	in_txn = true;
+	txn.start = fall;
+	txn.release = rise;
+	txn.speed = bus_speed;
+	txn.awaiting_presence = true;
+	txn.presence = false;
+	txn.count = 0;
+	txn.dropped = 0;
+	stat_add(bus_speed, KIND_RESET, rise - fall);
+}
+
+//!	Closes the pending Fox-Bus slot.
+static void
+fxb_flush() {
+	if(!has_pending)
+		return;
+	has_pending = false;
+
+	// Presence is a '0' in the first slot after the reset.
+	if(in_txn && txn.awaiting_presence) {
+		txn.awaiting_presence = false;
+		if(pending.has_mark) {
+			txn.presence = true;
+			txn.presence_latency = pending.mark_start - pending.end;
+			txn.presence_width = pending.mark_end - pending.mark_start;
+		}
+		return;
+	}
+
+	slot_add(&pending);
+}
+
+//!	Takes in one low pulse on the bus.
+static void
+pulse(double fall, double rise) {
+	const double width = rise - fall;
+
+	if(is_fxb) {
+		if(width >= US(speeds[SPEED_FXB].reset)) {
+			fxb_flush();
+			txn_begin(fall, rise);
+		} else if(has_pending && !pending.has_mark
+		    && (fall - pending.end < US(speeds[SPEED_FXB].window))
+		) {
+			pending.has_mark = true;
+			pending.mark_start = fall;
+			pending.mark_end = rise;
+		} else {
+			fxb_flush();
+			pending = (struct slot_t){ .start = fall, .end = rise, .speed = SPEED_FXB };
+			has_pending = true;
+		}
+		return;
+	}
+
+	// A standard speed reset pulse always drops back to standard speed.
+	if(width >= US(speeds[SPEED_STD].reset)) {
+		bus_speed = SPEED_STD;
+		txn_begin(fall, rise);
+	} else if((bus_speed == SPEED_OD) && (width >= US(speeds[SPEED_OD].reset))) {
+		txn_begin(fall, rise);
+	} else if(in_txn && txn.awaiting_presence
+	    && (fall - txn.release < US(speeds[txn.speed].window))
+	) {
+		txn.awaiting_presence = false;
+		txn.presence = true;
+		txn.presence_latency = fall - txn.release;
+		txn.presence_width = width;
+	} else {
+		if(in_txn)
+			txn.awaiting_presence = false;
+		slot_add(&(struct slot_t){ .start = fall, .end = rise, .speed = bus_speed });
+	}
+}
+
+// ----------------------------------------------------------------------------
+#pragma mark -
+#pragma mark Devices
+
+static struct device_t {
+	char key[20];			//!< ROM ID, or how it was addressed
+	unsigned transactions;
+	unsigned crc_errors;
+	unsigned truncated;
+	double max_busy;		//!< ms
+	double worst_margin;	//!< µs, read-0 margin
+	double worst_presence;	//!< µs, presence latency
+	double max_duration;	//!< ms
+	double total_duration;
+	bool has_margin;
+} devices[MAX_DEVICES];
+
+static unsigned device_count;
+
+static struct device_t*
+device_find(const char* key) {
+	unsigned i;
+
+	for(i = 0; i != device_count; i++)
+		if(!strcmp(devices[i].key, key))
+			return &devices[i];
+
+	// Lump the rest together once there are too many.
+	if(device_count == MAX_DEVICES)
+		return &devices[MAX_DEVICES - 1];
+
+	snprintf(devices[device_count].key, sizeof(devices[0].key), "%s", key);
+	return &devices[device_count++];
+}
+
+// ----------------------------------------------------------------------------
+#pragma mark -
+#pragma mark Decoding
+
+enum {
+	DIR_WRITE,				//!< Master to device
+	DIR_READ				//!< Device to master
+};
+
+static bool verbose;
+
+//!	Where the decoding of the current transaction is up to.
+static struct {
+	unsigned pos;			//!< Next slot
+	bool truncated;
+	char leftover[9];		//!< Bits of a byte cut short
+	unsigned crc_ok;
+	unsigned crc_bad;
+	double worst_margin;
+	bool has_margin;
+	uint8_t bytes[MAX_SLOTS / 8];
+	uint8_t dirs[MAX_SLOTS / 8];
+	unsigned byte_count;
+} rd;
+
+//!	Returns the next bit sent in the direction given, or -1 at the end.
+static int
+read_bit(uint8_t dir) {
+	const struct slot_t* slot;
+	const struct speed_t* speed;
+	int bit;
+
+	if(rd.pos == txn.count)
+		return -1;
+
+	slot = &txn.slots[rd.pos];
+	speed = &speeds[slot->speed];
+
+	if(rd.pos) {
+		const struct slot_t* prev = &txn.slots[rd.pos - 1];
+
+		if(prev->speed == slot->speed) {
+			stat_add(slot->speed, KIND_PERIOD, slot->start - prev->start);
+			stat_add(slot->speed, KIND_RECOVERY, slot->start - slot_end(prev));
+		}
+	}
+	rd.pos++;
+
+	if(slot->speed == SPEED_FXB) {
+		const double sample = slot->end + US(speed->sample);
+
+		stat_add(SPEED_FXB, KIND_OPEN, slot->end - slot->start);
+		if(dir == DIR_WRITE) {
+			// The master marks a '1' with a second pulse.
+			bit = slot->has_mark;
+			if(bit) {
+				stat_add(SPEED_FXB, KIND_MARK_DELAY, slot->mark_start - slot->end);
+				stat_add(SPEED_FXB, KIND_MARK_WIDTH, slot->mark_end - slot->mark_start);
+			}
+		} else {
+			// The device sends a '0' by pulling low across the sample.
+			bit = !slot->has_mark;
+			if(!bit) {
+				double margin = sample - slot->mark_start;
+
+				if(slot->mark_end - sample < margin)
+					margin = slot->mark_end - sample;
+				stat_add(SPEED_FXB, KIND_RESPONSE, slot->mark_start - slot->end);
+				stat_add(SPEED_FXB, KIND_RESPONSE_WIDTH, slot->mark_end - slot->mark_start);
+				stat_add(SPEED_FXB, KIND_MARGIN, margin);
+				if(!rd.has_margin || (margin < rd.worst_margin))
+					rd.worst_margin = margin;
+				rd.has_margin = true;
+			}
+		}
+	} else {
+		const double width = slot->end - slot->start;
+
+		bit = (width < US(speed->sample));
+		if(dir == DIR_WRITE) {
+			stat_add(slot->speed, bit ? KIND_WRITE1 : KIND_WRITE0, width);
+		} else {
+			stat_add(slot->speed, bit ? KIND_READ1 : KIND_READ0, width);
+			if(!bit) {
+				// How long the device held the bus past the sample.
+				const double margin = width - US(speed->sample);
+
+				stat_add(slot->speed, KIND_MARGIN, margin);
+				if(!rd.has_margin || (margin < rd.worst_margin))
+					rd.worst_margin = margin;
+				rd.has_margin = true;
+			}
+		}
+	}
+
+	return bit;
+}
+
+//!	Reads a whole byte, or returns false at the end of the transaction.
+static bool
+read_byte(uint8_t dir, uint8_t* byte) {
+	uint8_t i;
+
+	*byte = 0;
+	for(i = 0; i != 8; i++) {
+		const int bit = read_bit(dir);
+
+		if(bit < 0) {
+			if(i) {
+				rd.truncated = true;
+				rd.leftover[i] = 0;
+			}
+			return false;
+		}
+		rd.leftover[i] = '0' + bit;
+		if(bit)
+			*byte |= (1 << i);
+	}
+
+	if(rd.byte_count < sizeof(rd.bytes)) {
+		rd.bytes[rd.byte_count] = *byte;
+		rd.dirs[rd.byte_count] = dir;
+		rd.byte_count++;
+	}
+	return true;
+}
+
+static void
+crc_check(uint8_t kind, bool ok) {
+	totals.crc_checked++;
+	if(ok) {
+		rd.crc_ok++;
+	} else {
+		rd.crc_bad++;
+		totals.crc_errors++;
+		totals.crc_kind_errors[kind]++;
+	}
+}
+
+//!	Reads the CRC16 the device sends, low byte first, and checks it.
+static bool
+crc16_check(uint8_t kind, uint16_t crc) {
+	uint8_t lo, hi;
+
+	if(!read_byte(DIR_READ, &lo) || !read_byte(DIR_READ, &hi))
+		return false;
+	crc_check(kind, (lo | (hi << 8)) == crc);
+	return true;
+}
+
+//!	Reads `len` bytes from the device into the CRC16.
+static bool
+read_crc16(uint16_t* crc, uint8_t len) {
+	uint8_t byte;
+
+	while(len--) {
+		if(!read_byte(DIR_READ, &byte))
+			return false;
+		*crc = _crc16_update(*crc, byte);
+	}
+	return true;
+}
+
+static const char*
+romcmd_name(uint8_t cmd) {
+	switch(cmd) {
+	case COMM_ROMCMD_READ: return "READ";
+	case COMM_ROMCMD_MATCH: return "MATCH";
+	case COMM_ROMCMD_SKIP: return "SKIP";
+	case COMM_ROMCMD_SEARCH: return "SEARCH";
+	case COMM_ROMCMD_ALARM_SEARCH: return "ALARM_SEARCH";
+	case COMM_ROMCMD_OD_SKIP: return "OD_SKIP";
+	case COMM_ROMCMD_OD_MATCH: return "OD_MATCH";
+	}
+	return NULL;
+}
+
+static const char*
+funccmd_name(uint8_t cmd) {
+	switch(cmd) {
+	case COMM_FUNCCMD_RD_MEM: return "RD_MEM";
+	case COMM_FUNCCMD_WR_MEM: return "WR_MEM";
+	case COMM_FUNCCMD_CONVERT: return "CONVERT";
+	case COMM_FUNCCMD_COMMIT_MEM: return "COMMIT_MEM";
+	case COMM_FUNCCMD_RECALL_MEM: return "RECALL_MEM";
+	case COMM_FUNCCMD_CONVERT_T: return "CONVERT_T";
+	case COMM_FUNCCMD_RD_SCRATCH: return "RD_SCRATCH";
+	case COMM_FUNCCMD_RD_VALUES: return "RD_VALUES";
+	case COMM_FUNCCMD_RD_HISTORY: return "RD_HISTORY";
+	case COMM_FUNCCMD_RD_NAME: return "RD_NAME";
+	}
+	return NULL;
+}
+
+//!	Reads the ROM ID the ROM command sent into `rom`.
+//!	Returns false if it stopped short or nobody answered.
+static bool
+decode_rom(uint8_t cmd, comm_addr_t* rom) {
+	uint8_t crc = 0;
+
+	if((cmd == COMM_ROMCMD_SEARCH) || (cmd == COMM_ROMCMD_ALARM_SEARCH)) {
+		memset(rom, 0, sizeof(*rom));
+		for(uint8_t i = 0; i != 64; i++) {
+			const int bit = read_bit(DIR_READ);
+			const int cmp = read_bit(DIR_READ);
+			const int dir = read_bit(DIR_WRITE);
+
+			if((bit < 0) || (cmp < 0) || (dir < 0)) {
+				rd.truncated = true;
+				snprintf(rd.leftover, sizeof(rd.leftover), "search");
+				return false;
+			}
+			if(bit && cmp)
+				return false;
+			if(dir)
+				rom->d[i / 8] |= (1 << (i & 7));
+		}
+	} else {
+		const uint8_t dir = (cmd == COMM_ROMCMD_READ) ? DIR_READ : DIR_WRITE;
+
+		for(uint8_t i = 0; i != 8; i++)
+			if(!read_byte(dir, &rom->d[i]))
+				return false;
+	}
+
+	for(uint8_t i = 0; i != 8; i++)
+		crc = _crc_ibutton_update(crc, rom->d[i]);
+	crc_check(CRC_ROM, crc == 0);
+	return true;
+}
+
+//!	Times how long the device answers read slots with '0'.
+//!	Returns the time in ms, negative if it was still busy.
+static double
+decode_busy() {
+	const unsigned first = rd.pos;
+	const double from = slot_end(&txn.slots[rd.pos - 1]);
+	int bit;
+
+	while((bit = read_bit(DIR_READ)) == 0)
+		;
+	if(bit < 0)
+		return (rd.pos == first) ? 0 : -(txn.slots[rd.pos - 1].start - from) / 1e6;
+
+	// Any polls after the first '1' are just more of the same.
+	rd.pos = txn.count;
+	return (txn.slots[rd.pos - 1].start - from) / 1e6;
+}
+
+//!	Decodes the function command, writing what it was into `desc`.
+//!	Returns the busy time in ms, or 0.
+static double
+decode_function(char* desc, size_t len) {
+	uint8_t cmd, byte, lo, hi;
+	uint16_t crc;
+	const char* name;
+
+	if(!read_byte(DIR_WRITE, &cmd)) {
+		snprintf(desc, len, "-");
+		return 0;
+	}
+
+	name = funccmd_name(cmd);
+	if(!name) {
+		snprintf(desc, len, "?%02X", cmd);
+		return 0;
+	}
+	snprintf(desc, len, "%s", name);
+
+	switch(cmd) {
+	case COMM_FUNCCMD_RD_MEM:
+	case COMM_FUNCCMD_WR_MEM: {
+		const uint8_t kind = (cmd == COMM_FUNCCMD_RD_MEM) ? CRC_RD_MEM : CRC_WR_MEM;
+		const uint8_t dir = (cmd == COMM_FUNCCMD_RD_MEM) ? DIR_READ : DIR_WRITE;
+		uint8_t i;
+
+		if(!read_byte(DIR_WRITE, &lo) || !read_byte(DIR_WRITE, &hi))
+			break;
+		snprintf(desc, len, "%s @%02X", name, lo);
+
+		// The device takes the high address byte to be zero.
+		crc = _crc16_update(0, cmd);
+		crc = _crc16_update(crc, lo);
+		crc = _crc16_update(crc, 0);
+		for(i = lo; i < 23; ) {
+			if(!read_byte(dir, &byte))
+				break;
+			crc = _crc16_update(crc, byte);
+			if((++i & 7) == 0) {
+				if(!crc16_check(kind, crc))
+					break;
+				crc = 0;
+			}
+		}
+		break;
+	}
+
+	case COMM_FUNCCMD_CONVERT:
+		if(!read_byte(DIR_WRITE, &lo) || !read_byte(DIR_WRITE, &hi))
+			break;
+		snprintf(desc, len, "%s %02X", name, lo);
+		return decode_busy();
+
+	case COMM_FUNCCMD_COMMIT_MEM:
+	case COMM_FUNCCMD_RECALL_MEM:
+	case COMM_FUNCCMD_CONVERT_T:
+		return decode_busy();
+
+	case COMM_FUNCCMD_RD_SCRATCH: {
+		uint8_t crc8 = 0;
+
+		for(uint8_t i = 0; i != 9; i++) {
+			if(!read_byte(DIR_READ, &byte))
+				return 0;
+			crc8 = _crc_ibutton_update(crc8, byte);
+		}
+		crc_check(CRC_SCRATCH, crc8 == 0);
+		break;
+	}
+
+	case COMM_FUNCCMD_RD_VALUES:
+		crc = _crc16_update(0, cmd);
+		if(read_crc16(&crc, RD_VALUES_LEN))
+			crc16_check(CRC_VALUES, crc);
+		break;
+
+	case COMM_FUNCCMD_RD_HISTORY: {
+		// A header record with the record count last, then the records.
+		const unsigned header = rd.byte_count;
+
+		crc = _crc16_update(0, cmd);
+		if(!read_crc16(&crc, HISTORY_RECORD_LEN))
+			break;
+		byte = rd.bytes[header + HISTORY_RECORD_LEN - 1];
+		snprintf(desc, len, "%s %u", name, byte);
+		for(uint8_t n = 0; n != byte; n++)
+			if(!read_crc16(&crc, HISTORY_RECORD_LEN))
+				return 0;
+		crc16_check(CRC_HISTORY, crc);
+		break;
+	}
+
+	case COMM_FUNCCMD_RD_NAME: {
+		char name_str[sizeof(device_name) + 1];
+		uint8_t i;
+
+		// The name is followed by a zero, and no CRC.
+		for(i = 0; i != sizeof(device_name) + 1; i++) {
+			if(!read_byte(DIR_READ, &byte))
+				break;
+			name_str[i] = ((byte >= 0x20) && (byte < 0x7F)) ? byte : (byte ? '.' : 0);
+		}
+		name_str[(i < sizeof(device_name)) ? i : sizeof(device_name)] = 0;
+		snprintf(desc, len, "%s \"%s\"", name, name_str);
+		break;
+	}
+	}
+
+	return 0;
+}
+
+static void
+print_bytes() {
+	for(unsigned i = 0; i != rd.byte_count; i++) {
+		if(!i || (rd.dirs[i] != rd.dirs[i - 1]))
+			printf("%s    %s", i ? "\n" : "", (rd.dirs[i] == DIR_WRITE) ? "w:" : "r:");
+		printf(" %02X", rd.bytes[i]);
+	}
+	if(rd.byte_count)
+		printf("\n");
+}
+
+static void
+decode_txn() {
+	const uint8_t start_speed = txn.speed;
+	char rom_str[20] = "-";
+	char func[40] = "-";
+	char busy_str[16] = "-";
+	const char* romcmd = "-";
+	const char* key;
+	struct device_t* device;
+	double busy = 0;
+	double end;
+	uint8_t cmd;
+
+	if(is_fxb)
+		fxb_flush();
+	in_txn = false;
+
+	if(!totals.transactions)
+		printf("%12s %-4s %-4s %-12s %-16s %-22s %5s %-7s %9s %9s\n",
+			"time-ms", "bus", "pres", "rom-cmd", "rom-id", "function",
+			"bytes", "crc", "busy-ms", "dur-ms");
+
+	memset(&rd, 0, sizeof(rd));
+	totals.transactions++;
+	if(!txn.presence)
+		totals.no_presence++;
+	else {
+		stat_add(start_speed, KIND_PRESENCE_LATENCY, txn.presence_latency);
+		stat_add(start_speed, KIND_PRESENCE_WIDTH, txn.presence_width);
+	}
+
+	key = txn.presence ? "(none)" : "(absent)";
+	if(read_byte(DIR_WRITE, &cmd)) {
+		romcmd = romcmd_name(cmd);
+		if(!romcmd) {
+			static char unknown[8];
+
+			snprintf(unknown, sizeof(unknown), "?%02X", cmd);
+			romcmd = unknown;
+		} else if((cmd == COMM_ROMCMD_SKIP) || (cmd == COMM_ROMCMD_OD_SKIP)) {
+			key = "(skip)";
+			busy = decode_function(func, sizeof(func));
+		} else {
+			comm_addr_t rom;
+
+			if(decode_rom(cmd, &rom)) {
+				for(uint8_t i = 0; i != 8; i++)
+					sprintf(rom_str + i * 2, "%02X", rom.d[i]);
+				key = rom_str;
+				busy = decode_function(func, sizeof(func));
+			} else if(!rd.truncated) {
+				snprintf(rom_str, sizeof(rom_str), "(no match)");
+			}
+		}
+	}
+
+	end = txn.count ? slot_end(&txn.slots[txn.count - 1]) : txn.release;
+
+	if(busy > 0)
+		snprintf(busy_str, sizeof(busy_str), "%.3f", busy);
+	else if(busy < 0)
+		snprintf(busy_str, sizeof(busy_str), ">%.3f", -busy);
+
+	printf("%12.3f %-4s %-4s %-12s %-16s %-22s %5u %-7s %9s %9.3f",
+		txn.start / 1e6,
+		speeds[start_speed].name,
+		txn.presence ? "yes" : "no",
+		romcmd,
+		rom_str,
+		func,
+		rd.byte_count,
+		rd.crc_bad ? "ERR" : rd.crc_ok ? "ok" : "-",
+		busy_str,
+		(end - txn.start) / 1e6
+	);
+	if(rd.truncated) {
+		totals.truncated++;
+		printf(" truncated after %s", rd.leftover);
+	}
+	if(rd.pos < txn.count) {
+		totals.stray += txn.count - rd.pos;
+		printf(" +%u stray slots", txn.count - rd.pos);
+	}
+	if(txn.dropped)
+		printf(" %u slots dropped", txn.dropped);
+	printf("\n");
+	if(verbose)
+		print_bytes();
+
+	device = device_find(key);
+	device->transactions++;
+	device->crc_errors += rd.crc_bad;
+	device->truncated += rd.truncated;
+	if(busy > device->max_busy)
+		device->max_busy = busy;
+	if(-busy > device->max_busy)
+		device->max_busy = -busy;
+	if(rd.has_margin && (!device->has_margin || (rd.worst_margin < device->worst_margin))) {
+		device->worst_margin = rd.worst_margin;
+		device->has_margin = true;
+	}
+	if(txn.presence && (txn.presence_latency / 1000.0 > device->worst_presence))
+		device->worst_presence = txn.presence_latency / 1000.0;
+	if((end - txn.start) / 1e6 > device->max_duration)
+		device->max_duration = (end - txn.start) / 1e6;
+	device->total_duration += (end - txn.start) / 1e6;
+}
+
+// ----------------------------------------------------------------------------
+#pragma mark -
+#pragma mark Trace Input
+
+static uint8_t level = 1;	//!< Pulled up while idle
+static double fall_time;
+
+static void
+level_change(double ns, uint8_t high) {
+	if(high == level)
+		return;
+	level = high;
+	if(high)
+		pulse(fall_time, ns);
+	else
+		fall_time = ns;
+}
+
+//!	Returns the length of a VCD time unit in ns, or 0.
+static double
+vcd_timescale(const char* str) {
+	static const struct {
+		const char* unit;
+		double ns;
+	} units[] = {
+		{ "fs", 1e-6 }, { "ps", 1e-3 }, { "ns", 1 },
+		{ "us", 1e3 }, { "ms", 1e6 }, { "s", 1e9 },
+	};
+	char* unit;
+	const double n = strtod(str, &unit);
+
+	for(uint8_t i = 0; i != sizeof(units) / sizeof(*units); i++)
+		if(!strcmp(unit, units[i].unit))
+			return n * units[i].ns;
+	return 0;
+}
+
+static bool
+vcd_skip_to_end(FILE* file, char* collect, size_t len) {
+	char token[256];
+
+	if(collect)
+		*collect = 0;
+	while(fscanf(file, "%255s", token) == 1) {
+		if(!strcmp(token, "$end"))
+			return true;
+		if(collect && (strlen(collect) + strlen(token) < len))
+			strcat(collect, token);
+	}
+	return false;
+}
+
+static int
+read_vcd(FILE* file, const char* path, const char* signal) {
+	char token[256];
+	char code[64] = "";
+	char first[64] = "";
+	double scale = 1;
+	double now = 0;
+
+	while(fscanf(file, "%255s", token) == 1) {
+		if(!strcmp(token, "$timescale")) {
+			char str[64];
+
+			vcd_skip_to_end(file, str, sizeof(str));
+			if(!(scale = vcd_timescale(str))) {
+				fprintf(stderr, "%s: bad timescale \"%s\"\n", path, str);
+				return -1;
+			}
+		} else if(!strcmp(token, "$var")) {
+			char type[32], size[32], id[64], name[128];
+
+			if(fscanf(file, "%31s %31s %63s %127s", type, size, id, name) != 4)
+				break;
+			vcd_skip_to_end(file, NULL, 0);
+			if(!first[0])
+				strcpy(first, id);
+			if(!code[0] && (signal ? !strcmp(name, signal) : !strcasecmp(name, "sda")))
+				strcpy(code, id);
+		} else if(!strcmp(token, "$enddefinitions")) {
+			vcd_skip_to_end(file, NULL, 0);
+			if(!code[0] && !signal)
+				strcpy(code, first);
+			if(!code[0]) {
+				fprintf(stderr, "%s: no signal named \"%s\"\n", path, signal ? signal : "sda");
+				return -1;
+			}
+		} else if(!strcmp(token, "$comment") || !strcmp(token, "$date")
+		    || !strcmp(token, "$version") || !strcmp(token, "$scope")
+		    || !strcmp(token, "$upscope")
+		) {
+			vcd_skip_to_end(file, NULL, 0);
+		} else if(token[0] == '$') {
+			// $dumpvars and friends just hold value changes.
+		} else if(token[0] == '#') {
+			now = strtod(token + 1, NULL) * scale;
+		} else if(strchr("bBrR", token[0])) {
+			// Vectors and reals are never SDA.
+			if(fscanf(file, "%255s", token) != 1)
+				break;
+		} else if(code[0] && !strcmp(token + 1, code)) {
+			// X and Z are taken to be pulled up.
+			level_change(now, token[0] != '0');
+		}
+	}
+
+	if(!code[0]) {
+		fprintf(stderr, "%s: no definitions\n", path);
+		return -1;
+	}
+	return 0;
+}
+
+static int
+read_csv(FILE* file, const char* path, const char* signal) {
+	char line[1024];
+	unsigned column = 1;
+	unsigned lineno = 0;
+
+	while(fgets(line, sizeof(line), file)) {
+		char* fields[32];
+		unsigned count = 0;
+		char* end;
+		char* p = line;
+
+		lineno++;
+		while(count < 32) {
+			fields[count++] = p;
+			p += strcspn(p, ",;\t\r\n");
+			if((*p != ',') && (*p != ';') && (*p != '\t')) {
+				*p = 0;
+				break;
+			}
+			*p++ = 0;
+		}
+
+		// The header names the columns.
+		const double seconds = strtod(fields[0], &end);
+		if(end == fields[0]) {
+			if(signal) {
+				for(unsigned i = 1; i < count; i++) {
+					char* name = fields[i] + strspn(fields[i], " \"");
+
+					name[strcspn(name, "\"")] = 0;
+					if(!strcasecmp(name, signal))
+						column = i;
+				}
+			}
+			continue;
+		}
+		if(column >= count) {
+			fprintf(stderr, "%s:%u: no column %u\n", path, lineno, column);
+			return -1;
+		}
+		level_change(seconds * 1e9, strtod(fields[column], NULL) != 0);
+	}
+	return 0;
+}
+
+// ----------------------------------------------------------------------------
+#pragma mark -
+#pragma mark Main
+
+static void
+usage(const char* name) {
+	fprintf(stderr,
+		"usage: %s [-b std|od|fxb] [-s signal] [-v] [file]\n"
+		"\n"
+		"  -b bus     Physical protocol, and 1-Wire speed to start at (std)\n"
+		"  -s signal  Name of the SDA signal or CSV column (sda)\n"
+		"  -v         Print the bytes of each transaction\n"
+		"\n"
+		"Reads a VCD or CSV trace from file, or else standard input.\n",
+		name
+	);
+}
+
+int
+main(int argc, char* argv[]) {
+	const char* signal = NULL;
+	const char* path = "-";
+	FILE* file = stdin;
+	int status;
+	int c;
+
+	while((c = getopt(argc, argv, "b:s:vh")) != -1) {
+		switch(c) {
+		case 'b':
+			if(!strcmp(optarg, "std")) {
+				bus_speed = SPEED_STD;
+			} else if(!strcmp(optarg, "od")) {
+				bus_speed = SPEED_OD;
+			} else if(!strcmp(optarg, "fxb")) {
+				bus_speed = SPEED_FXB;
+				is_fxb = true;
+			} else {
+				usage(argv[0]);
+				return 1;
+			}
+			break;
+		case 's': signal = optarg; break;
+		case 'v': verbose = true; break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if(optind < argc) {
+		path = argv[optind];
+		if(!(file = fopen(path, "r"))) {
+			fprintf(stderr, "%s: %s\n", path, strerror(errno));
+			return 1;
+		}
+	}
+
+	c = fgetc(file);
+	ungetc(c, file);
+	status = (c == '$') ? read_vcd(file, path, signal) : read_csv(file, path, signal);
+	if(file != stdin)
+		fclose(file);
+	if(status)
+		return 1;
+
+	// Whatever was still going on at the end.
+	if(is_fxb)
+		fxb_flush();
+	if(in_txn)
+		decode_txn();
+
+	printf("\n%-17s %5s %5s %5s %9s %9s %9s %9s %9s\n",
+		"device", "txns", "crc", "trunc", "busy-ms", "margin", "pres-lat",
+		"avg-ms", "max-ms");
+	for(unsigned i = 0; i != device_count; i++) {
+		const struct device_t* device = &devices[i];
+		char margin[16] = "-";
+
+		if(device->has_margin)
+			snprintf(margin, sizeof(margin), "%.2f", device->worst_margin / 1000.0);
+		printf("%-17s %5u %5u %5u %9.3f %9s %9.2f %9.3f %9.3f\n",
+			device->key,
+			device->transactions,
+			device->crc_errors,
+			device->truncated,
+			device->max_busy,
+			margin,
+			device->worst_presence,
+			device->total_duration / device->transactions,
+			device->max_duration
+		);
+	}
+
+	printf("\n%-4s %-17s %7s %9s %9s %9s   %s (us)\n",
+		"bus", "timing", "count", "min", "avg", "max", "histogram, min to max");
+	for(uint8_t speed = 0; speed != SPEED_COUNT; speed++)
+		for(uint8_t kind = 0; kind != KIND_COUNT; kind++)
+			if(stats[speed][kind].count)
+				stat_print(speeds[speed].name, kind_names[kind], &stats[speed][kind]);
+
+	printf("\n%u transactions, %u without presence, %u truncated, %u stray slots\n",
+		totals.transactions, totals.no_presence, totals.truncated, totals.stray);
+	printf("%u CRCs checked, %u errors", totals.crc_checked, totals.crc_errors);
+	for(uint8_t kind = 0; kind != CRC_KIND_COUNT; kind++)
+		if(totals.crc_kind_errors[kind])
+			printf(", %u %s", totals.crc_kind_errors[kind], crc_kind_names[kind]);
+	printf("\n");
+
+	return (totals.crc_errors || !totals.transactions) ? 1 : 0;
+}
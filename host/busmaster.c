@@ -0,0 +1,1062 @@
+/*	@title Host Bus Master Library
+**
+**	See busmaster.h.
+**
+**	@legal
+**	This package is free software; you can redistribute it and/or
+**	modify it under the terms of the GNU General Public License
+**	version 2 as published by the Free Software Foundation.
+**
+**	This package is distributed in the hope that it will be useful,
+**	but WITHOUT ANY WARRANTY; without even the implied warranty of
+**	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+**	General Public License for more details.
+**	@endlegal
+*/
+
+#include "busmaster.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <util/crc16.h>
+
+// ----------------------------------------------------------------------------
+#pragma mark Bus Timing
+
+const struct bus_timing_t bus_timing_standard = {
+	.name	= "1-Wire",
+	.slot	= 70,
+	.reset	= 960,
+};
+
+const struct bus_timing_t bus_timing_overdrive = {
+	.name	= "1-Wire-OD",
+	.slot	= 10,
+	.reset	= 140,
+};
+
+const struct bus_timing_t bus_timing_foxbus = {
+	.name	= "Fox-Bus",
+	.slot	= 300,
+	.reset	= 960,
+};
+
+// ----------------------------------------------------------------------------
+#pragma mark -
+#pragma mark Primitives
+
+void
+bus_init(
+	struct bus_master_t* master,
+	const struct bus_transport_t* transport,
+	const struct bus_timing_t* timing
+) {
+	memset(master, 0, sizeof(*master));
+	master->transport = transport;
+	master->timing = timing;
+
+	// Enough for the longest conversion at the slowest slot rate.
+	master->busy_timeout = 200000;
+}
+
+bool
+bus_reset(struct bus_master_t* master) {
+	master->stats.resets++;
+	master->stats.time_us += master->timing->reset;
+	return master->transport->reset(master->transport->context);
+}
+
+uint8_t
+bus_touch_bit(struct bus_master_t* master, uint8_t bit) {
+	master->stats.slots++;
+	master->stats.time_us += master->timing->slot;
+	return master->transport->touch_bit(master->transport->context, bit != 0);
+}
+
+void
+bus_write_byte(struct bus_master_t* master, uint8_t byte) {
+	master->stats.bytes++;
+	for(uint8_t i = 0; i != 8; i++) {
+		bus_touch_bit(master, byte & 1);
+		byte >>= 1;
+	}
+}
+
+uint8_t
+bus_read_byte(struct bus_master_t* master) {
+	uint8_t byte = 0;
+
+	master->stats.bytes++;
+	for(uint8_t i = 0; i != 8; i++) {
+		byte >>= 1;
+		if(bus_touch_bit(master, 1))
+			byte |= 0x80;
+	}
+	return byte;
+}
+
+uint8_t
+bus_crc8(const uint8_t* data, uint8_t len) {
+	uint8_t crc = 0;
+
+	while(len--)
+		crc = _crc_ibutton_update(crc, *data++);
+	return crc;
+}
+
+int
+bus_select(struct bus_master_t* master, const uint8_t* rom) {
+	if(!bus_reset(master))
+		return BUS_ERR_NO_PRESENCE;
+
+	if(rom) {
+		bus_write_byte(master, BUS_ROMCMD_MATCH);
+		for(uint8_t i = 0; i != 8; i++)
+			bus_write_byte(master, rom[i]);
+	} else {
+		bus_write_byte(master, BUS_ROMCMD_SKIP);
+	}
+	return BUS_OK;
+}
+
+int
+bus_read_rom(struct bus_master_t* master, uint8_t* rom) {
+	if(!bus_reset(master))
+		return BUS_ERR_NO_PRESENCE;
+
+	bus_write_byte(master, BUS_ROMCMD_READ);
+	for(uint8_t i = 0; i != 8; i++)
+		rom[i] = bus_read_byte(master);
+
+	return bus_crc8(rom, 8) ? BUS_ERR_CRC : BUS_OK;
+}
+
+int
+bus_wait_busy(struct bus_master_t* master) {
+	for(uint32_t i = 0; i != master->busy_timeout; i++) {
+		if(bus_touch_bit(master, 1))
+			return BUS_OK;
+	}
+	return BUS_ERR_TIMEOUT;
+}
+
+// ----------------------------------------------------------------------------
+#pragma mark -
+#pragma mark Search
+
+void
+bus_search_begin(struct bus_search_t* search, uint8_t cmd) {
+	memset(search, 0, sizeof(*search));
+	search->cmd = cmd;
+	search->last_discrepancy = -1;
+}
+
+uint8_t
+bus_triplet(struct bus_master_t* master, uint8_t dir) {
+	const uint8_t id = bus_touch_bit(master, 1);
+	const uint8_t cmp = bus_touch_bit(master, 1);
+
+	// Devices disagree only if both bits came back as zero.
+	if(id != cmp)
+		dir = id;
+	else if(id)
+		dir = 1;
+
+	bus_touch_bit(master, dir);
+
+	return id | (cmp << 1) | (dir << 2);
+}
+
+int
+bus_search_next(struct bus_master_t* master, struct bus_search_t* search) {
+	int8_t last_zero = -1;
+
+	if(search->done)
+		return 0;
+
+	if(!bus_reset(master)) {
+		search->done = true;
+		return BUS_ERR_NO_PRESENCE;
+	}
+
+	bus_write_byte(master, search->cmd);
+
+	for(uint8_t i = 0; i != 64; i++) {
+		uint8_t* const byte = &search->rom[i >> 3];
+		const uint8_t mask = 1 << (i & 7);
+		uint8_t dir;
+		uint8_t triplet;
+
+		// Follow the previous pass up to where it took the 0 branch,
+		// take the 1 branch there, and the 0 branch from then on.
+		if(i < search->last_discrepancy)
+			dir = (*byte & mask) != 0;
+		else
+			dir = (i == search->last_discrepancy);
+
+		triplet = bus_triplet(master, dir);
+
+		if((triplet & 3) == 3) {
+			// Nobody is taking part, which for ALARM SEARCH just
+			// means that no device has its alarm condition set.
+			search->done = true;
+			return 0;
+		}
+
+		if(((triplet & 3) == 0) && !(triplet & 4))
+			last_zero = i;
+
+		if(triplet & 4)
+			*byte |= mask;
+		else
+			*byte &= ~mask;
+	}
+
+	search->last_discrepancy = last_zero;
+	if(last_zero < 0)
+		search->done = true;
+
+	return bus_crc8(search->rom, 8) ? BUS_ERR_CRC : 1;
+}
+
+// ----------------------------------------------------------------------------
+#pragma mark -
+#pragma mark Function Commands
+
+int
+bus_read_mem(
+	struct bus_master_t* master,
+	const uint8_t* rom,
+	uint8_t addr,
+	uint8_t* data,
+	uint8_t len
+) {
+	uint16_t crc;
+	int ret;
+
+	if((uint16_t)addr + len > BUS_MEM_SIZE)
+		return BUS_ERR_RANGE;
+
+	if((ret = bus_select(master, rom)) != BUS_OK)
+		return ret;
+
+	bus_write_byte(master, BUS_FUNCCMD_RD_MEM);
+	bus_write_byte(master, addr);
+	bus_write_byte(master, 0);
+
+	crc = _crc16_update(0, BUS_FUNCCMD_RD_MEM);
+	crc = _crc16_update(crc, addr);
+	crc = _crc16_update(crc, 0);
+
+	while(len--) {
+		*data = bus_read_byte(master);
+		crc = _crc16_update(crc, *data++);
+
+		// The device sends its CRC at every 8-byte page boundry.
+		if((++addr & 7) == 0) {
+			uint16_t dev_crc = bus_read_byte(master);
+
+			dev_crc |= (uint16_t)bus_read_byte(master) << 8;
+			if(dev_crc != crc)
+				return BUS_ERR_CRC;
+			crc = 0;
+		}
+	}
+
+	return BUS_OK;
+}
+
+int
+bus_write_mem(
+	struct bus_master_t* master,
+	const uint8_t* rom,
+	uint8_t addr,
+	const uint8_t* data,
+	uint8_t len
+) {
+	uint16_t crc;
+	int ret;
+
+	if((uint16_t)addr + len > BUS_MEM_SIZE)
+		return BUS_ERR_RANGE;
+
+	if((ret = bus_select(master, rom)) != BUS_OK)
+		return ret;
+
+	bus_write_byte(master, BUS_FUNCCMD_WR_MEM);
+	bus_write_byte(master, addr);
+	bus_write_byte(master, 0);
+
+	crc = _crc16_update(0, BUS_FUNCCMD_WR_MEM);
+	crc = _crc16_update(crc, addr);
+	crc = _crc16_update(crc, 0);
+
+	while(len--) {
+		bus_write_byte(master, *data);
+		crc = _crc16_update(crc, *data++);
+
+		if((++addr & 7) == 0) {
+			uint16_t dev_crc = bus_read_byte(master);
+
+			dev_crc |= (uint16_t)bus_read_byte(master) << 8;
+			if(dev_crc != crc)
+				return BUS_ERR_CRC;
+			crc = 0;
+		}
+	}
+
+	return BUS_OK;
+}
+
+int
+bus_command(struct bus_master_t* master, const uint8_t* rom, uint8_t cmd) {
+	int ret;
+
+	if((ret = bus_select(master, rom)) != BUS_OK)
+		return ret;
+
+	bus_write_byte(master, cmd);
+	return bus_wait_busy(master);
+}
+
+int
+bus_read_values(
+	struct bus_master_t* master,
+	const uint8_t* rom,
+	struct bus_values_t* values
+) {
+	uint8_t frame[BUS_VALUES_LEN];
+	uint16_t crc;
+	uint16_t dev_crc;
+	int ret;
+
+	if((ret = bus_select(master, rom)) != BUS_OK)
+		return ret;
+
+	bus_write_byte(master, BUS_FUNCCMD_RD_VALUES);
+
+	crc = _crc16_update(0, BUS_FUNCCMD_RD_VALUES);
+	for(uint8_t i = 0; i != BUS_VALUES_LEN; i++) {
+		frame[i] = bus_read_byte(master);
+		crc = _crc16_update(crc, frame[i]);
+	}
+
+	dev_crc = bus_read_byte(master);
+	dev_crc |= (uint16_t)bus_read_byte(master) << 8;
+	if(dev_crc != crc)
+		return BUS_ERR_CRC;
+
+	values->moisture = frame[0] | (frame[1] << 8);
+	values->raw = frame[2] | (frame[3] << 8);
+	values->temp = (int16_t)(frame[4] | (frame[5] << 8));
+	values->voltage = frame[6] | (frame[7] << 8);
+	values->flags = frame[8];
+
+	return BUS_OK;
+}
+
+int
+bus_read_history(
+	struct bus_master_t* master,
+	const uint8_t* rom,
+	uint16_t* seq,
+	struct bus_record_t* records,
+	uint8_t* count
+) {
+	uint8_t record[BUS_HISTORY_RECORD_LEN];
+	uint16_t crc;
+	uint16_t dev_crc;
+	int ret;
+
+	if((ret = bus_select(master, rom)) != BUS_OK)
+		return ret;
+
+	bus_write_byte(master, BUS_FUNCCMD_RD_HISTORY);
+
+	// The header is SEQ and COUNT, sent the same size as a record.
+	crc = _crc16_update(0, BUS_FUNCCMD_RD_HISTORY);
+	for(uint8_t i = 0; i != BUS_HISTORY_RECORD_LEN; i++) {
+		record[i] = bus_read_byte(master);
+		crc = _crc16_update(crc, record[i]);
+	}
+	*seq = record[0] | (record[1] << 8);
+	*count = record[2];
+	if(*count > BUS_HISTORY_MAX)
+		return BUS_ERR_RANGE;
+
+	for(uint8_t n = 0; n != *count; n++) {
+		for(uint8_t i = 0; i != BUS_HISTORY_RECORD_LEN; i++) {
+			record[i] = bus_read_byte(master);
+			crc = _crc16_update(crc, record[i]);
+		}
+		records[n].moisture = record[0] | (record[1] << 8);
+		records[n].temp = (int8_t)record[2];
+	}
+
+	dev_crc = bus_read_byte(master);
+	dev_crc |= (uint16_t)bus_read_byte(master) << 8;
+	if(dev_crc != crc)
+		return BUS_ERR_CRC;
+
+	return BUS_OK;
+}
+
+int
+bus_poll_all(
+	struct bus_master_t* master,
+	const uint8_t (*roms)[8],
+	uint32_t count,
+	struct bus_values_t* values
+) {
+	int failed = 0;
+
+	// Everyone converts at once. The bus reads as zero
+	// until the slowest device has finished.
+	if(bus_select(master, NULL) != BUS_OK)
+		return count;
+	bus_write_byte(master, BUS_FUNCCMD_CONVERT_T);
+	if(bus_wait_busy(master) != BUS_OK)
+		return count;
+
+	for(uint32_t i = 0; i != count; i++) {
+		if(bus_read_values(master, roms[i], &values[i]) != BUS_OK)
+			failed++;
+	}
+
+	return failed;
+}
+
+// ----------------------------------------------------------------------------
+#pragma mark -
+#pragma mark Loopback Devices
+
+// The device model follows the interrupt-driven slave in main.c:
+// bits are shifted in and out a byte at a time (or a bit at a
+// time for SEARCH), and device_next() is called with every byte.
+
+enum {
+	DEV_IDLE,			//!< Ignoring the bus until the next reset.
+	DEV_BUSY,			//!< Running a command until `busy_until`.
+	DEV_ROM_CMD,
+	DEV_ROM_READ,
+	DEV_ROM_MATCH,
+	DEV_SEARCH_BIT,
+	DEV_SEARCH_CMP,
+	DEV_SEARCH_DIR,
+	DEV_FUNC_CMD,
+	DEV_MEM_ADDR,
+	DEV_MEM_DATA,
+	DEV_MEM_CRC,
+	DEV_CONVERT_ARGS,
+	DEV_RD_VALUES,
+	DEV_RD_HISTORY,
+};
+
+static void
+device_rx(struct bus_device_t* dev, uint8_t state) {
+	dev->state = state;
+	dev->tx = false;
+	dev->count = 8;
+}
+
+static void
+device_send(struct bus_device_t* dev, uint8_t state, uint8_t byte) {
+	dev->state = state;
+	dev->tx = true;
+	dev->byte = byte;
+	dev->count = 8;
+}
+
+static uint8_t
+device_rom_bit(const struct bus_device_t* dev) {
+	return (dev->rom[dev->index >> 3] >> (dev->index & 7)) & 1;
+}
+
+static void
+device_run(struct bus_loopback_t* lb, struct bus_device_t* dev, uint8_t cmd) {
+	dev->cmd = cmd;
+	dev->busy_until = lb->now_us
+		+ ((cmd == BUS_FUNCCMD_COMMIT_MEM) || (cmd == BUS_FUNCCMD_RECALL_MEM)
+			? lb->commit_us
+			: lb->convert_us);
+	dev->state = DEV_BUSY;
+}
+
+//!	Makes up a new set of readings for `dev`.
+static void
+device_convert(struct bus_device_t* dev) {
+	uint16_t moisture;
+	int16_t temp;
+
+	dev->seed = dev->seed * 1103515245 + 12345;
+	moisture = (dev->seed >> 8) & 0xFFFF;
+	temp = 25 * 16 + (int16_t)((dev->seed >> 24) & 0x3F) - 32;
+
+	dev->mem[0] = moisture;
+	dev->mem[1] = moisture >> 8;
+	dev->mem[2] = moisture >> 4;
+	dev->mem[3] = moisture >> 12;
+	dev->mem[4] = temp;
+	dev->mem[5] = temp >> 8;
+	dev->mem[6] = 0x00;
+	dev->mem[7] = 0x01;
+
+	dev->mem[BUS_MEM_CFG_FLAGS] &= ~(BUS_CFG_FLAG_ALARM|BUS_CFG_FLAG_ERROR);
+	if(((moisture >> 8) > dev->mem[BUS_MEM_ALARM_HIGH])
+	    || ((moisture >> 8) < dev->mem[BUS_MEM_ALARM_LOW])
+	)
+		dev->mem[BUS_MEM_CFG_FLAGS] |= BUS_CFG_FLAG_ALARM;
+}
+
+//!	Adds the readings from the last conversion to the history.
+static void
+device_record(struct bus_loopback_t* lb, struct bus_device_t* dev) {
+	uint8_t* const record = dev->history[dev->history_head];
+
+	if(!lb->history_len)
+		return;
+
+	record[0] = dev->mem[0];
+	record[1] = dev->mem[1];
+	record[2] = ((int16_t)(dev->mem[4] | (dev->mem[5] << 8)) + 8) >> 4;
+
+	if(++dev->history_head == lb->history_len)
+		dev->history_head = 0;
+	if(dev->history_count != lb->history_len)
+		dev->history_count++;
+	dev->history_seq++;
+}
+
+//!	Returns byte `i` of record `n` of the RD_HISTORY frame, where record 0 is the header.
+static uint8_t
+device_history_byte(const struct bus_loopback_t* lb, const struct bus_device_t* dev, uint8_t n, uint8_t i) {
+	uint16_t index;
+
+	if(n-- == 0)
+		return (i < 2) ? (dev->history_seq >> (8 * i)) : dev->history_count;
+
+	index = dev->history_head + lb->history_len - dev->history_count + n;
+	return dev->history[index % lb->history_len][i];
+}
+
+static uint8_t
+device_values_byte(const struct bus_device_t* dev, uint8_t i) {
+	return (i < 8) ? dev->mem[i] : dev->mem[BUS_MEM_CFG_FLAGS];
+}
+
+static void
+device_mem_next(struct bus_device_t* dev) {
+	if(dev->addr >= BUS_MEM_SIZE) {
+		device_rx(dev, DEV_IDLE);
+	} else if(dev->cmd == BUS_FUNCCMD_RD_MEM) {
+		const uint8_t byte = dev->mem[dev->addr];
+
+		dev->crc = _crc16_update(dev->crc, byte);
+		device_send(dev, DEV_MEM_DATA, byte);
+	} else {
+		device_rx(dev, DEV_MEM_DATA);
+	}
+}
+
+static void
+device_values_next(struct bus_device_t* dev) {
+	uint8_t byte;
+
+	if(dev->index < BUS_VALUES_LEN) {
+		byte = device_values_byte(dev, dev->index);
+		dev->crc = _crc16_update(dev->crc, byte);
+	} else if(dev->index == BUS_VALUES_LEN) {
+		byte = dev->crc;
+	} else if(dev->index == BUS_VALUES_LEN + 1) {
+		byte = dev->crc >> 8;
+	} else {
+		dev->mem[BUS_MEM_CFG_FLAGS] &= ~BUS_CFG_FLAG_CHANGED;
+		device_rx(dev, DEV_IDLE);
+		return;
+	}
+
+	dev->index++;
+	device_send(dev, DEV_RD_VALUES, byte);
+}
+
+static void
+device_history_next(struct bus_loopback_t* lb, struct bus_device_t* dev) {
+	uint8_t byte;
+
+	if(dev->addr <= dev->history_count) {
+		byte = device_history_byte(lb, dev, dev->addr, dev->index);
+		dev->crc = _crc16_update(dev->crc, byte);
+		if(++dev->index == BUS_HISTORY_RECORD_LEN) {
+			dev->index = 0;
+			dev->addr++;
+		}
+	} else if(dev->index == 0) {
+		byte = dev->crc;
+		dev->index++;
+	} else if(dev->index == 1) {
+		byte = dev->crc >> 8;
+		dev->index++;
+	} else {
+		device_rx(dev, DEV_IDLE);
+		return;
+	}
+
+	device_send(dev, DEV_RD_HISTORY, byte);
+}
+
+static void
+device_next(struct bus_loopback_t* lb, struct bus_device_t* dev, uint8_t byte) {
+	switch(dev->state) {
+	case DEV_ROM_CMD:
+		dev->index = 0;
+		if(byte == BUS_ROMCMD_READ) {
+			device_send(dev, DEV_ROM_READ, dev->rom[0]);
+		} else if(byte == BUS_ROMCMD_MATCH) {
+			device_rx(dev, DEV_ROM_MATCH);
+		} else if((byte == BUS_ROMCMD_SEARCH)
+		    || ((byte == BUS_ROMCMD_ALARM_SEARCH)
+		        && (dev->mem[BUS_MEM_CFG_FLAGS] & (BUS_CFG_FLAG_ALARM|BUS_CFG_FLAG_ERROR|BUS_CFG_FLAG_CHANGED))
+		    )
+		) {
+			goto search_bit;
+		} else if(byte == BUS_ROMCMD_SKIP) {
+			device_rx(dev, DEV_FUNC_CMD);
+		} else {
+			device_rx(dev, DEV_IDLE);
+		}
+		break;
+
+	case DEV_ROM_READ:
+		if(++dev->index == 8)
+			device_rx(dev, DEV_FUNC_CMD);
+		else
+			device_send(dev, DEV_ROM_READ, dev->rom[dev->index]);
+		break;
+
+	case DEV_ROM_MATCH:
+		if(byte != dev->rom[dev->index])
+			device_rx(dev, DEV_IDLE);
+		else if(++dev->index == 8)
+			device_rx(dev, DEV_FUNC_CMD);
+		else
+			device_rx(dev, DEV_ROM_MATCH);
+		break;
+
+	case DEV_SEARCH_BIT:
+		device_send(dev, DEV_SEARCH_CMP, ~device_rom_bit(dev));
+		dev->count = 1;
+		break;
+
+	case DEV_SEARCH_CMP:
+		device_rx(dev, DEV_SEARCH_DIR);
+		dev->count = 1;
+		break;
+
+	case DEV_SEARCH_DIR:
+		if((byte >> 7) != device_rom_bit(dev)) {
+			device_rx(dev, DEV_IDLE);
+			break;
+		}
+		if(++dev->index == 64) {
+			device_rx(dev, DEV_FUNC_CMD);
+			break;
+		}
+search_bit:
+		device_send(dev, DEV_SEARCH_BIT, device_rom_bit(dev));
+		dev->count = 1;
+		break;
+
+	case DEV_FUNC_CMD:
+		dev->cmd = byte;
+		dev->index = 0;
+		if((byte == BUS_FUNCCMD_RD_MEM) || (byte == BUS_FUNCCMD_WR_MEM)) {
+			dev->crc = _crc16_update(0, byte);
+			device_rx(dev, DEV_MEM_ADDR);
+		} else if(byte == BUS_FUNCCMD_CONVERT) {
+			device_rx(dev, DEV_CONVERT_ARGS);
+		} else if((byte == BUS_FUNCCMD_COMMIT_MEM)
+		    || (byte == BUS_FUNCCMD_RECALL_MEM)
+		    || (byte == BUS_FUNCCMD_CONVERT_T)
+		) {
+			device_run(lb, dev, byte);
+		} else if(byte == BUS_FUNCCMD_RD_VALUES) {
+			dev->crc = _crc16_update(0, byte);
+			device_values_next(dev);
+		} else if(byte == BUS_FUNCCMD_RD_HISTORY) {
+			dev->crc = _crc16_update(0, byte);
+			dev->addr = 0;
+			device_history_next(lb, dev);
+		} else {
+			device_rx(dev, DEV_IDLE);
+		}
+		break;
+
+	case DEV_MEM_ADDR:
+		if(dev->index++ == 0) {
+			dev->addr = byte;
+			dev->crc = _crc16_update(dev->crc, byte);
+			device_rx(dev, DEV_MEM_ADDR);
+		} else {
+			dev->crc = _crc16_update(dev->crc, 0);
+			dev->ack = (dev->addr == 0);
+			device_mem_next(dev);
+		}
+		break;
+
+	case DEV_MEM_DATA:
+		if(dev->cmd == BUS_FUNCCMD_WR_MEM) {
+			dev->mem[dev->addr] = byte;
+			dev->crc = _crc16_update(dev->crc, byte);
+		}
+
+		if((++dev->addr & 7) == 0) {
+			dev->index = 0;
+			device_send(dev, DEV_MEM_CRC, dev->crc);
+		} else {
+			device_mem_next(dev);
+		}
+		break;
+
+	case DEV_MEM_CRC:
+		if(dev->index++ == 0) {
+			device_send(dev, DEV_MEM_CRC, dev->crc >> 8);
+		} else {
+			// Reading out the whole value page acknowledges it.
+			if(dev->ack && (dev->addr == 8) && (dev->cmd == BUS_FUNCCMD_RD_MEM))
+				dev->mem[BUS_MEM_CFG_FLAGS] &= ~BUS_CFG_FLAG_CHANGED;
+			dev->crc = 0;
+			device_mem_next(dev);
+		}
+		break;
+
+	case DEV_CONVERT_ARGS:
+		if(dev->index++ == 0)
+			device_rx(dev, DEV_CONVERT_ARGS);
+		else
+			device_run(lb, dev, BUS_FUNCCMD_CONVERT);
+		break;
+
+	case DEV_RD_VALUES:
+		device_values_next(dev);
+		break;
+
+	case DEV_RD_HISTORY:
+		device_history_next(lb, dev);
+		break;
+
+	default:
+		dev->count = 8;
+		break;
+	}
+}
+
+//!	Returns the level `dev` is driving the bus to during this slot.
+static uint8_t
+device_level(struct bus_loopback_t* lb, struct bus_device_t* dev) {
+	if(dev->state == DEV_BUSY) {
+		if(lb->now_us < dev->busy_until)
+			return 0;
+
+		if((dev->cmd == BUS_FUNCCMD_CONVERT) || (dev->cmd == BUS_FUNCCMD_CONVERT_T)) {
+			device_convert(dev);
+			device_record(lb, dev);
+		}
+		device_rx(dev, DEV_IDLE);
+	}
+
+	return (dev->tx && !(dev->byte & 1)) ? 0 : 1;
+}
+
+// ----------------------------------------------------------------------------
+#pragma mark -
+#pragma mark Loopback Transport
+
+// Only devices that are taking part get looked at, which is what lets
+// a bus of thousands of devices run quickly: after the first byte of
+// a MATCH, or the first few bits of a SEARCH, nearly every device has
+// dropped out until the next reset pulse. Devices that are sending,
+// or busy, are visited every slot since they decide the level of the
+// bus. Devices that are receiving are parked on a wheel of slots and
+// only visited once their byte is complete, when they pick it up from
+// the recent bus levels.
+//
+// SEARCH gets special treatment, since every device takes part in at
+// least the first byte of it. The devices searching are kept sorted by
+// ROM ID in the order SEARCH sends the bits, so the devices still
+// taking part are always a contiguous range of them. Each bit of the
+// search then only has to look at the ends of that range.
+
+//!	Puts device `i` wherever its state says it should be looked at next.
+static void
+loopback_file(struct bus_loopback_t* lb, uint32_t i) {
+	const struct bus_device_t* const dev = &lb->devices[i];
+	uint8_t spoke;
+
+	if(dev->state == DEV_IDLE)
+		return;
+
+	if((dev->state == DEV_SEARCH_BIT) && (dev->index == 0)) {
+		lb->searching[lb->search_hi++] = i;
+		return;
+	}
+
+	if(dev->tx || (dev->state == DEV_BUSY)) {
+		lb->next_sending[lb->next_sending_count++] = i;
+		return;
+	}
+
+	spoke = (lb->slot + dev->count) % BUS_LOOPBACK_WHEEL;
+	lb->wheel[spoke][lb->wheel_count[spoke]++] = i;
+}
+
+//!	Returns the current SEARCH bit of the `n`th device searching.
+static uint8_t
+loopback_search_bit(const struct bus_loopback_t* lb, uint32_t n) {
+	return (lb->keys[lb->searching[n]] >> (63 - lb->search_bit)) & 1;
+}
+
+//!	Runs one slot of a SEARCH: the bit, its complement, or the direction.
+static uint8_t
+loopback_search_slot(struct bus_loopback_t* lb, uint8_t level) {
+	uint32_t lo = lb->search_lo;
+	uint32_t hi = lb->search_hi;
+
+	if(lb->search_step == 0) {
+		// Anyone with a 0 pulls the bus low: that's the first of them.
+		level &= loopback_search_bit(lb, lo);
+	} else if(lb->search_step == 1) {
+		// Anyone with a 1 pulls the bus low: that's the last of them.
+		level &= !loopback_search_bit(lb, hi - 1);
+	}
+
+	if(++lb->search_step != 3)
+		return level;
+
+	// Direction slot: everyone who doesn't match it drops out.
+	while(lo < hi) {
+		const uint32_t mid = lo + (hi - lo) / 2;
+
+		if(loopback_search_bit(lb, mid))
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+	if(level)
+		lb->search_lo = lo;
+	else
+		lb->search_hi = lo;
+
+	lb->search_step = 0;
+
+	if(++lb->search_bit == 64) {
+		// Whoever is left has been selected.
+		for(uint32_t n = lb->search_lo; n != lb->search_hi; n++) {
+			struct bus_device_t* const dev = &lb->devices[lb->searching[n]];
+
+			dev->index = 64;
+			device_rx(dev, DEV_FUNC_CMD);
+			loopback_file(lb, lb->searching[n]);
+		}
+		lb->search_lo = lb->search_hi = 0;
+		lb->search_bit = 0;
+	}
+
+	return level;
+}
+
+static bool
+loopback_reset(void* context) {
+	struct bus_loopback_t* const lb = context;
+	uint8_t spoke;
+	uint32_t* swap;
+
+	lb->now_us += lb->timing->reset;
+
+	// A reset pulse abandons whatever the devices were doing.
+	lb->sending_count = 0;
+	lb->next_sending_count = 0;
+	for(spoke = 0; spoke != BUS_LOOPBACK_WHEEL; spoke++)
+		lb->wheel_count[spoke] = 0;
+
+	lb->search_lo = 0;
+	lb->search_hi = 0;
+	lb->search_bit = 0;
+	lb->search_step = 0;
+
+	// Filed in SEARCH order, so that any SEARCH starts out sorted.
+	for(uint32_t i = 0; i != lb->count; i++) {
+		device_rx(&lb->devices[lb->order[i]], DEV_ROM_CMD);
+		loopback_file(lb, lb->order[i]);
+	}
+
+	swap = lb->sending;
+	lb->sending = lb->next_sending;
+	lb->next_sending = swap;
+	lb->sending_count = lb->next_sending_count;
+
+	return lb->count != 0;
+}
+
+static uint8_t
+loopback_touch_bit(void* context, uint8_t bit) {
+	struct bus_loopback_t* const lb = context;
+	uint8_t level = bit;
+	uint8_t spoke;
+	uint32_t due;
+	uint32_t* swap;
+
+	lb->now_us += lb->timing->slot;
+
+	// Wired-AND: any device pulling low wins.
+	for(uint32_t i = 0; i != lb->sending_count; i++)
+		level &= device_level(lb, &lb->devices[lb->sending[i]]);
+
+	lb->slot++;
+	lb->next_sending_count = 0;
+
+	if(lb->search_lo != lb->search_hi)
+		level = loopback_search_slot(lb, level);
+
+	lb->levels = (lb->levels >> 1) | ((uint64_t)level << 63);
+
+	for(uint32_t i = 0; i != lb->sending_count; i++) {
+		struct bus_device_t* const dev = &lb->devices[lb->sending[i]];
+
+		if(dev->state != DEV_BUSY) {
+			dev->byte >>= 1;
+			if(level)
+				dev->byte |= 0x80;
+
+			if(!--dev->count)
+				device_next(lb, dev, dev->byte);
+		}
+		loopback_file(lb, lb->sending[i]);
+	}
+
+	// Receivers whose byte ended with this slot.
+	spoke = lb->slot % BUS_LOOPBACK_WHEEL;
+	due = lb->wheel_count[spoke];
+	lb->wheel_count[spoke] = 0;
+
+	for(uint32_t i = 0; i != due; i++) {
+		struct bus_device_t* const dev = &lb->devices[lb->wheel[spoke][i]];
+
+		dev->byte = lb->levels >> 56;
+		device_next(lb, dev, dev->byte);
+		loopback_file(lb, lb->wheel[spoke][i]);
+	}
+
+	swap = lb->sending;
+	lb->sending = lb->next_sending;
+	lb->next_sending = swap;
+	lb->sending_count = lb->next_sending_count;
+
+	return level;
+}
+
+static const uint64_t* loopback_sort_keys;
+
+static int
+loopback_order_compare(const void* a, const void* b) {
+	const uint64_t key_a = loopback_sort_keys[*(const uint32_t*)a];
+	const uint64_t key_b = loopback_sort_keys[*(const uint32_t*)b];
+
+	return (key_a > key_b) - (key_a < key_b);
+}
+
+struct bus_loopback_t*
+bus_loopback_create(
+	uint32_t count,
+	uint64_t serial,
+	const struct bus_timing_t* timing
+) {
+	const size_t n = count ? count : 1;
+	struct bus_loopback_t* lb = calloc(1, sizeof(*lb));
+	bool ok;
+
+	if(!lb)
+		return NULL;
+
+	lb->devices = calloc(n, sizeof(*lb->devices));
+	lb->order = calloc(n, sizeof(uint32_t));
+	lb->keys = calloc(n, sizeof(uint64_t));
+	lb->searching = calloc(n, sizeof(uint32_t));
+	lb->sending = calloc(n, sizeof(uint32_t));
+	lb->next_sending = calloc(n, sizeof(uint32_t));
+	ok = lb->devices && lb->order && lb->keys && lb->searching
+		&& lb->sending && lb->next_sending;
+
+	for(uint8_t spoke = 0; spoke != BUS_LOOPBACK_WHEEL; spoke++) {
+		lb->wheel[spoke] = calloc(n, sizeof(uint32_t));
+		ok = ok && lb->wheel[spoke];
+	}
+
+	if(!ok) {
+		bus_loopback_free(lb);
+		return NULL;
+	}
+
+	lb->timing = timing;
+	lb->count = count;
+	lb->convert_us = 150000;
+	lb->commit_us = 60000;
+	lb->history_len = 4;
+
+	for(uint32_t i = 0; i != count; i++, serial++) {
+		struct bus_device_t* const dev = &lb->devices[i];
+
+		dev->rom[0] = BUS_TYPE_MOIST;
+		for(uint8_t j = 0; j != 6; j++)
+			dev->rom[1 + j] = serial >> (8 * j);
+		dev->rom[7] = bus_crc8(dev->rom, 7);
+
+		// Same defaults as cfg_eeprom and calib_eeprom in main.c.
+		dev->mem[BUS_MEM_ALARM_LOW] = 0x00;
+		dev->mem[BUS_MEM_ALARM_HIGH] = 0xFF;
+		dev->mem[BUS_MEM_CFG_FLAGS] = 0x04;
+		dev->mem[0x10] = 0x69;
+		dev->mem[0x11] = 0x11;
+		dev->mem[0x12] = 0x06;
+
+		dev->seed = (uint32_t)serial;
+		device_convert(dev);
+		device_rx(dev, DEV_IDLE);
+
+		// SEARCH sends bit 0 of the first byte first.
+		for(uint8_t j = 0; j != 64; j++) {
+			lb->keys[i] <<= 1;
+			lb->keys[i] |= (dev->rom[j >> 3] >> (j & 7)) & 1;
+		}
+		lb->order[i] = i;
+	}
+
+	loopback_sort_keys = lb->keys;
+	qsort(lb->order, count, sizeof(uint32_t), loopback_order_compare);
+
+	return lb;
+}
+
+void
+bus_loopback_free(struct bus_loopback_t* loopback) {
+	if(loopback) {
+		free(loopback->devices);
+		free(loopback->order);
+		free(loopback->keys);
+		free(loopback->searching);
+		free(loopback->sending);
+		free(loopback->next_sending);
+		for(uint8_t spoke = 0; spoke != BUS_LOOPBACK_WHEEL; spoke++)
+			free(loopback->wheel[spoke]);
+		free(loopback);
+	}
+}
+
+void
+bus_loopback_transport(
+	struct bus_loopback_t* loopback,
+	struct bus_transport_t* transport
+) {
+	transport->reset = loopback_reset;
+	transport->touch_bit = loopback_touch_bit;
+	transport->context = loopback;
+}
@@ -0,0 +1,302 @@
+/*	@title Host Bus Master Library
+**
+**	Talks to the sensor from the master's side of the bus: the ROM
+**	layer (SEARCH, ALARM SEARCH, MATCH, SKIP) and the function
+**	commands, as implemented by main.c. Everything is built on top of
+**	a transport that can issue a reset pulse and run a single time
+**	slot, so the same code can drive a hardware bus adapter or the
+**	loopback bus of simulated devices below.
+**
+**	@legal
+**	This package is free software; you can redistribute it and/or
+**	modify it under the terms of the GNU General Public License
+**	version 2 as published by the Free Software Foundation.
+**
+**	This package is distributed in the hope that it will be useful,
+**	but WITHOUT ANY WARRANTY; without even the implied warranty of
+**	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+**	General Public License for more details.
+**	@endlegal
+*/
+
+#ifndef __BUSMASTER_H__
+#define __BUSMASTER_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// ----------------------------------------------------------------------------
+#pragma mark Protocol Constants
+
+// These mirror the enums in main.c.
+#define BUS_ROMCMD_READ				(0x33)
+#define BUS_ROMCMD_MATCH			(0x55)
+#define BUS_ROMCMD_SKIP				(0xCC)
+#define BUS_ROMCMD_SEARCH			(0xF0)
+#define BUS_ROMCMD_ALARM_SEARCH		(0xEC)
+
+#define BUS_FUNCCMD_RD_MEM			(0xAA)
+#define BUS_FUNCCMD_WR_MEM			(0x55)
+#define BUS_FUNCCMD_CONVERT			(0x3C)
+#define BUS_FUNCCMD_COMMIT_MEM		(0x48)
+#define BUS_FUNCCMD_RECALL_MEM		(0xB8)
+#define BUS_FUNCCMD_CONVERT_T		(0x44)
+#define BUS_FUNCCMD_RD_VALUES		(0xA0)
+#define BUS_FUNCCMD_RD_HISTORY		(0xA1)
+
+#define BUS_TYPE_MOIST				(0xA0)	//!< Family code of the sensor
+
+#define BUS_MEM_SIZE				(23)	//!< Bytes of addressable memory
+#define BUS_MEM_ALARM_LOW			(0x08)
+#define BUS_MEM_ALARM_HIGH			(0x09)
+#define BUS_MEM_CFG_FLAGS			(0x0A)
+
+#define BUS_CFG_FLAG_ALARM			(1<<7)
+#define BUS_CFG_FLAG_ERROR			(1<<6)
+#define BUS_CFG_FLAG_CHANGED		(1<<4)
+#define BUS_VALUES_LEN				(9)		//!< RD_VALUES frame, without CRC
+#define BUS_HISTORY_RECORD_LEN		(3)		//!< RD_HISTORY header and records
+#define BUS_HISTORY_MAX				(254)	//!< Most records a device can hold
+
+enum {
+	BUS_OK = 0,
+	BUS_ERR_NO_PRESENCE = -1,	//!< Nobody answered the reset pulse
+	BUS_ERR_CRC = -2,			//!< A CRC didn't check out
+	BUS_ERR_TIMEOUT = -3,		//!< The device stayed busy for too long
+	BUS_ERR_RANGE = -4,			//!< Address out of range
+};
+
+// ----------------------------------------------------------------------------
+#pragma mark -
+#pragma mark Transport
+
+//!	Time taken by the bus primitives, in microseconds.
+struct bus_timing_t {
+	const char* name;
+	double	slot;
+	double	reset;			//!< Reset pulse plus presence detect
+};
+
+extern const struct bus_timing_t bus_timing_standard;
+extern const struct bus_timing_t bus_timing_overdrive;
+extern const struct bus_timing_t bus_timing_foxbus;
+
+struct bus_transport_t {
+	//!	Sends a reset pulse, returns true if a presence pulse was seen.
+	bool (*reset)(void* context);
+
+	//!	Runs a single time slot, writing `bit`. Writing a '1' is also
+	//!	how a bit is read, so this returns the level at the sample point.
+	uint8_t (*touch_bit)(void* context, uint8_t bit);
+
+	void* context;
+};
+
+// ----------------------------------------------------------------------------
+#pragma mark -
+#pragma mark Bus Master
+
+struct bus_stats_t {
+	uint32_t	resets;
+	uint64_t	slots;
+	uint64_t	bytes;		//!< Whole bytes read or written
+	double		time_us;	//!< Estimated from the bus timing
+};
+
+struct bus_master_t {
+	const struct bus_transport_t* transport;
+	const struct bus_timing_t* timing;
+	struct bus_stats_t stats;
+
+	//! Read slots to poll a busy device for before giving up.
+	uint32_t busy_timeout;
+};
+
+extern void bus_init(
+	struct bus_master_t* master,
+	const struct bus_transport_t* transport,
+	const struct bus_timing_t* timing
+);
+
+extern bool bus_reset(struct bus_master_t* master);
+extern uint8_t bus_touch_bit(struct bus_master_t* master, uint8_t bit);
+extern void bus_write_byte(struct bus_master_t* master, uint8_t byte);
+extern uint8_t bus_read_byte(struct bus_master_t* master);
+
+//!	Sends a reset pulse followed by MATCH and `rom`, or by SKIP if `rom` is NULL.
+extern int bus_select(struct bus_master_t* master, const uint8_t* rom);
+
+//!	Reads the ROM ID of the only device on the bus with READ.
+extern int bus_read_rom(struct bus_master_t* master, uint8_t* rom);
+
+//!	Polls read slots until the device stops answering with zeros.
+extern int bus_wait_busy(struct bus_master_t* master);
+
+// ----------------------------------------------------------------------------
+#pragma mark -
+#pragma mark Search
+
+//!	State of a SEARCH or ALARM SEARCH, kept from one device to the next
+//!	so that each pass only re-walks the branch it has yet to take.
+struct bus_search_t {
+	uint8_t	cmd;				//!< BUS_ROMCMD_SEARCH or BUS_ROMCMD_ALARM_SEARCH
+	uint8_t	rom[8];				//!< The most recently found ROM ID
+	int8_t	last_discrepancy;	//!< Bit where the last pass took the 0 branch
+	bool	done;
+};
+
+extern void bus_search_begin(struct bus_search_t* search, uint8_t cmd);
+
+//!	Reads one bit and its complement, then writes the direction to take.
+//!	Returns the bit, complement and direction in bits 0, 1 and 2.
+extern uint8_t bus_triplet(struct bus_master_t* master, uint8_t dir);
+
+//!	Finds the next device. Returns 1 and fills in `search->rom`
+//!	if one was found, 0 once all have been found, or an error.
+extern int bus_search_next(struct bus_master_t* master, struct bus_search_t* search);
+
+// ----------------------------------------------------------------------------
+#pragma mark -
+#pragma mark Function Commands
+
+//!	Reads `len` bytes of memory starting at `addr`, checking the CRC16
+//!	at every page boundary.
+extern int bus_read_mem(
+	struct bus_master_t* master,
+	const uint8_t* rom,
+	uint8_t addr,
+	uint8_t* data,
+	uint8_t len
+);
+
+//!	Writes `len` bytes of memory starting at `addr`, checking the CRC16
+//!	the device sends back at every page boundary.
+extern int bus_write_mem(
+	struct bus_master_t* master,
+	const uint8_t* rom,
+	uint8_t addr,
+	const uint8_t* data,
+	uint8_t len
+);
+
+//!	Runs CONVERT_T, COMMIT_MEM or RECALL_MEM and waits for it to finish.
+extern int bus_command(struct bus_master_t* master, const uint8_t* rom, uint8_t cmd);
+
+struct bus_values_t {
+	uint16_t	moisture;
+	uint16_t	raw;
+	int16_t		temp;
+	uint16_t	voltage;
+	uint8_t		flags;		//!< CFG_FLAGS
+};
+
+//!	Reads the value page and status flags with RD_VALUES.
+extern int bus_read_values(
+	struct bus_master_t* master,
+	const uint8_t* rom,
+	struct bus_values_t* values
+);
+
+struct bus_record_t {
+	uint16_t	moisture;
+	int8_t		temp;		//!< Whole degrees C
+};
+
+//!	Reads the measurement history with RD_HISTORY, oldest record first.
+//!	`records` must have room for BUS_HISTORY_MAX of them. `seq` is the
+//!	number of records the device has made, counting the newest.
+extern int bus_read_history(
+	struct bus_master_t* master,
+	const uint8_t* rom,
+	uint16_t* seq,
+	struct bus_record_t* records,
+	uint8_t* count
+);
+
+//!	Starts a conversion on every device at once with SKIP and
+//!	CONVERT_T, and then reads each of the `count` devices in turn.
+//!	Returns the number of devices that could not be read.
+extern int bus_poll_all(
+	struct bus_master_t* master,
+	const uint8_t (*roms)[8],
+	uint32_t count,
+	struct bus_values_t* values
+);
+
+extern uint8_t bus_crc8(const uint8_t* data, uint8_t len);
+
+// ----------------------------------------------------------------------------
+#pragma mark -
+#pragma mark Loopback Transport
+
+//!	A simulated device on the loopback bus. `mem` holds the value,
+//!	configuration and calibration pages, laid out as in main.c.
+struct bus_device_t {
+	uint8_t		rom[8];
+	uint8_t		mem[24];
+
+	uint8_t		state;
+	bool		tx;
+	uint8_t		byte;
+	uint8_t		count;
+	uint8_t		cmd;
+	uint8_t		index;
+	uint8_t		addr;
+	uint16_t	crc;
+	bool		ack;			//!< Set if the read started with the value page
+	uint32_t	seed;
+	double		busy_until;
+
+	// Every conversion is recorded, see bus_loopback_t.history_len.
+	uint8_t		history[BUS_HISTORY_MAX][BUS_HISTORY_RECORD_LEN];
+	uint8_t		history_head;
+	uint8_t		history_count;
+	uint16_t	history_seq;
+};
+
+#define BUS_LOOPBACK_WHEEL			(9)		//!< Longer than the longest byte
+
+struct bus_loopback_t {
+	const struct bus_timing_t* timing;
+	struct bus_device_t* devices;
+	uint32_t	count;
+	double		now_us;
+
+	double		convert_us;		//!< Time taken by CONVERT_T
+	double		commit_us;		//!< Time taken by COMMIT_MEM and RECALL_MEM
+	uint8_t		history_len;	//!< Records kept by each device, up to BUS_HISTORY_MAX
+
+	uint64_t	slot;			//!< Slots run so far
+	uint64_t	levels;			//!< Recent bus levels, newest in the top bit
+
+	// Indexes of the devices taking part, see busmaster.c.
+	uint32_t*	order;			//!< All devices, in SEARCH order
+	uint64_t*	keys;			//!< ROM IDs, first SEARCH bit on top
+	uint32_t*	searching;		//!< Devices in a SEARCH, in SEARCH order
+	uint32_t	search_lo;
+	uint32_t	search_hi;
+	uint8_t		search_bit;
+	uint8_t		search_step;
+	uint32_t*	sending;
+	uint32_t	sending_count;
+	uint32_t*	next_sending;
+	uint32_t	next_sending_count;
+	uint32_t*	wheel[BUS_LOOPBACK_WHEEL];
+	uint32_t	wheel_count[BUS_LOOPBACK_WHEEL];
+};
+
+//!	Creates `count` devices with sequential serial numbers from `serial`.
+extern struct bus_loopback_t* bus_loopback_create(
+	uint32_t count,
+	uint64_t serial,
+	const struct bus_timing_t* timing
+);
+
+extern void bus_loopback_free(struct bus_loopback_t* loopback);
+
+extern void bus_loopback_transport(
+	struct bus_loopback_t* loopback,
+	struct bus_transport_t* transport
+);
+
+#endif // __BUSMASTER_H__
@@ -0,0 +1,11 @@
+/*	@title Host shim for <avr/cpufunc.h> */
+
+#ifndef __HOST_AVR_CPUFUNC_H__
+#define __HOST_AVR_CPUFUNC_H__
+
+#include <avr/io.h>
+
+#define _NOP()				sim_delay_cycles(SIM_CYCLES_NOP)
+#define _MemoryBarrier()	__asm__ __volatile__ ("" ::: "memory")
+
+#endif // __HOST_AVR_CPUFUNC_H__
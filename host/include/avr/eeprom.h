@@ -0,0 +1,55 @@
+/*	@title Host shim for <avr/eeprom.h>
+**
+**	EEPROM variables live in their own section of host memory, which
+**	keeps them laid out in declaration order just like on the target.
+**	Each byte actually written starts an EEPROM programming period,
+**	which, like on the target, runs on while the firmware gets on with
+**	other things. Anything else touching the EEPROM waits it out first.
+*/
+
+#ifndef __HOST_AVR_EEPROM_H__
+#define __HOST_AVR_EEPROM_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <avr/io.h>
+
+#define EEMEM	__attribute__ ((section(".eeprom")))
+
+#define eeprom_busy_wait()		sim_eeprom_busy_wait()
+#define eeprom_is_ready()		sim_eeprom_is_ready()
+
+static inline uint8_t
+eeprom_read_byte(const uint8_t* p) {
+	sim_eeprom_busy_wait();
+	return *p;
+}
+
+static inline uint16_t
+eeprom_read_word(const uint16_t* p) {
+	sim_eeprom_busy_wait();
+	return *p;
+}
+
+static inline void
+eeprom_write_byte(uint8_t* p, uint8_t value) {
+	sim_eeprom_busy_wait();
+	*p = value;
+	sim_eeprom_program();
+}
+
+static inline void
+eeprom_update_byte(uint8_t* p, uint8_t value) {
+	if(eeprom_read_byte(p) != value)
+		eeprom_write_byte(p, value);
+}
+
+// The block functions are kept out of line (see sim.c), since main.c
+// deliberately reads and writes several adjacent pages in one go.
+extern void eeprom_read_block(void* dst, const void* src, size_t n);
+extern void eeprom_write_block(const void* src, void* dst, size_t n);
+extern void eeprom_update_block(const void* src, void* dst, size_t n);
+
+#endif // __HOST_AVR_EEPROM_H__
@@ -0,0 +1,26 @@
+/*	@title Host shim for <avr/interrupt.h>
+**
+**	Interrupt service routines become ordinary functions which the
+**	simulator or a test harness may call directly.
+*/
+
+#ifndef __HOST_AVR_INTERRUPT_H__
+#define __HOST_AVR_INTERRUPT_H__
+
+#include <avr/io.h>
+
+#define sei()	do { sim_interrupts_enabled = 1; } while(0)
+#define cli()	do { sim_interrupts_enabled = 0; } while(0)
+
+#define ISR(vector, ...) \
+	void vector(void); \
+	void vector(void)
+
+#define EMPTY_INTERRUPT(vector) \
+	void vector(void); \
+	void vector(void) { }
+
+#define ISR_NAKED
+#define ISR_NOBLOCK
+
+#endif // __HOST_AVR_INTERRUPT_H__
@@ -0,0 +1,245 @@
+/*	@title Host shim for <avr/io.h>
+**
+**	Maps the ATtiny25/ATtiny13A I/O registers used by main.c onto the
+**	simulated registers in host/sim.c. Reads of PINB and ADC and every
+**	sbi()/cbi() go through the simulator so that it can model the
+**	sensing circuit and keep an estimated cycle count.
+*/
+
+#ifndef __HOST_AVR_IO_H__
+#define __HOST_AVR_IO_H__
+
+#include <stdint.h>
+
+#include "../../sim.h"
+
+#if !defined(__AVR_ATtiny25__) && !defined(__AVR_ATtiny13A__) \
+	&& !defined(__AVR_ATtiny13__)
+#define __AVR_ATtiny25__ 1
+#endif
+
+// ----------------------------------------------------------------------------
+#pragma mark Special Function Register Helpers
+
+#define _BV(bit)						(1 << (bit))
+#define bit_is_set(sfr, bit)			((sfr) & _BV(bit))
+#define bit_is_clear(sfr, bit)			(!((sfr) & _BV(bit)))
+#define loop_until_bit_is_set(sfr, bit) \
+	do { sim_poll_begin(); } while(sim_poll_end(bit_is_clear(sfr, bit)))
+#define loop_until_bit_is_clear(sfr, bit) \
+	do { sim_poll_begin(); } while(sim_poll_end(bit_is_set(sfr, bit)))
+
+// Route bit set/clear through the simulator so that register
+// side-effects (pin edges, ADC start) are observed.
+#define sbi(x, y)	sim_reg_write(&(x), (uint8_t)((x) | (uint8_t)(1 << (y))))
+#define cbi(x, y)	sim_reg_write(&(x), (uint8_t)((x) & (uint8_t) ~(1 << (y))))
+
+// ----------------------------------------------------------------------------
+#pragma mark -
+#pragma mark Memory Sizes
+
+#if defined(__AVR_ATtiny25__)
+#define FLASHEND	(0x7FF)
+#define RAMEND		(0xDF)
+#define E2END		(0x7F)
+#else
+#define FLASHEND	(0x3FF)
+#define RAMEND		(0x9F)
+#define E2END		(0x3F)
+#endif
+
+// ----------------------------------------------------------------------------
+#pragma mark -
+#pragma mark Registers
+
+#define PINB		sim_read_pinb()
+#define DDRB		sim_reg_ddrb
+#define PORTB		sim_reg_portb
+
+#define ADC			sim_read_adc()
+#define ADCW		ADC
+#define ADMUX		sim_reg_admux
+#define ADCSRA		sim_reg_adcsra
+#define ADCSRB		sim_reg_adcsrb
+#define ACSR		sim_reg_acsr
+#define DIDR0		sim_reg_didr0
+
+#define MCUCR		sim_reg_mcucr
+#define MCUSR		sim_reg_mcusr
+#define GIMSK		sim_reg_gimsk
+#define GIFR		sim_reg_gifr
+#define PCMSK		sim_reg_pcmsk
+
+#define TCCR0A		sim_reg_tccr0a
+#define TCCR0B		sim_reg_tccr0b
+#define TCNT0		sim_reg_tcnt0
+#define OCR0A		sim_reg_ocr0a
+#define OCR0B		sim_reg_ocr0b
+#define GTCCR		sim_reg_gtccr
+
+#if defined(__AVR_ATtiny25__)
+#define TIMSK		sim_reg_timsk
+#define TIFR		sim_reg_tifr
+#define TCCR1		sim_reg_tccr1
+#define TCNT1		sim_reg_tcnt1
+#define OCR1A		sim_reg_ocr1a
+#define OCR1B		sim_reg_ocr1b
+#define OCR1C		sim_reg_ocr1c
+#define WDTCR		sim_reg_wdtcr
+#define USICR		sim_reg_usicr
+#define USISR		sim_reg_usisr
+#define USIDR		sim_reg_usidr
+#define USIBR		sim_reg_usibr
+#else
+#define TIMSK0		sim_reg_timsk
+#define TIFR0		sim_reg_tifr
+#define WDTCR		sim_reg_wdtcr
+#endif
+
+#define EECR		sim_reg_eecr
+
+// ----------------------------------------------------------------------------
+#pragma mark -
+#pragma mark Bit Definitions
+
+// PORTB/DDRB/PINB
+#define PB0			0
+#define PB1			1
+#define PB2			2
+#define PB3			3
+#define PB4			4
+#define PB5			5
+
+// ADMUX
+#define MUX0		0
+#define MUX1		1
+#define MUX2		2
+#define MUX3		3
+#define REFS2		4
+#define ADLAR		5
+#define REFS0		6
+#define REFS1		7
+
+// ADCSRA
+#define ADPS0		0
+#define ADPS1		1
+#define ADPS2		2
+#define ADIE		3
+#define ADIF		4
+#define ADATE		5
+#define ADSC		6
+#define ADEN		7
+
+// ACSR
+#define ACIS0		0
+#define ACIS1		1
+#define ACIE		3
+#define ACI			4
+#define ACO			5
+#define ACBG		6
+#define ACD			7
+
+// MCUCR
+#define ISC00		0
+#define ISC01		1
+#define SM0			3
+#define SM1			4
+#define SE			5
+#define PUD			6
+#define BODSE		2
+#define BODS		7
+
+// MCUSR
+#define PORF		0
+#define EXTRF		1
+#define BORF		2
+#define WDRF		3
+
+// GIMSK/GIFR
+#define PCIE		5
+#define INT0		6
+#define PCIF		5
+#define INTF0		6
+
+// TIMSK/TIMSK0 and TIFR/TIFR0
+#if defined(__AVR_ATtiny25__)
+#define TOIE0		1
+#define TOIE1		2
+#define OCIE0B		3
+#define OCIE0A		4
+#define OCIE1B		5
+#define OCIE1A		6
+#define TOV0		1
+#define TOV1		2
+#define OCF0B		3
+#define OCF0A		4
+#define OCF1B		5
+#define OCF1A		6
+#else
+#define TOIE0		1
+#define OCIE0A		2
+#define OCIE0B		3
+#define TOV0		1
+#define OCF0A		2
+#define OCF0B		3
+#endif
+
+// TCCR0A/TCCR0B
+#define WGM00		0
+#define WGM01		1
+#define CS00		0
+#define CS01		1
+#define CS02		2
+#define WGM02		3
+
+// TCCR1
+#define CS10		0
+#define CS11		1
+#define CS12		2
+#define CS13		3
+#define CTC1		7
+
+// GTCCR
+#define PSR0		0
+#define PSR1		1
+#define FOC1A		2
+#define FOC1B		3
+#define COM1B0		4
+#define COM1B1		5
+#define PWM1B		6
+#define TSM			7
+
+// WDTCR
+#define WDP0		0
+#define WDP1		1
+#define WDP2		2
+#define WDE			3
+#define WDCE		4
+#define WDP3		5
+#define WDIE		6
+#define WDIF		7
+
+// USICR
+#define USITC		0
+#define USICLK		1
+#define USICS0		2
+#define USICS1		3
+#define USIWM0		4
+#define USIWM1		5
+#define USIOIE		6
+#define USISIE		7
+
+// USISR
+#define USICNT0		0
+#define USIDC		4
+#define USIPF		5
+#define USIOIF		6
+#define USISIF		7
+
+// EECR
+#define EERE		0
+#define EEPE		1
+#define EEMPE		2
+#define EERIE		3
+
+#endif // __HOST_AVR_IO_H__
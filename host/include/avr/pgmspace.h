@@ -0,0 +1,16 @@
+/*	@title Host shim for <avr/pgmspace.h>
+**
+**	Flash is ordinary host memory, so program space reads are plain loads.
+*/
+
+#ifndef __HOST_AVR_PGMSPACE_H__
+#define __HOST_AVR_PGMSPACE_H__
+
+#include <stdint.h>
+
+#define PROGMEM
+
+#define pgm_read_byte(p)		(*(const uint8_t*)(p))
+#define pgm_read_word(p)		(*(const uint16_t*)(p))
+
+#endif // __HOST_AVR_PGMSPACE_H__
@@ -0,0 +1,21 @@
+/*	@title Host shim for <avr/sleep.h> */
+
+#ifndef __HOST_AVR_SLEEP_H__
+#define __HOST_AVR_SLEEP_H__
+
+#include <avr/io.h>
+
+#define SLEEP_MODE_IDLE			(0)
+#define SLEEP_MODE_ADC			_BV(SM0)
+#define SLEEP_MODE_PWR_DOWN		_BV(SM1)
+
+#define set_sleep_mode(mode) \
+	do { MCUCR = (MCUCR & (uint8_t) ~(_BV(SM0) | _BV(SM1))) | (mode); } while(0)
+
+#define sleep_enable()		do { MCUCR |= _BV(SE); } while(0)
+#define sleep_disable()		do { MCUCR &= (uint8_t) ~_BV(SE); } while(0)
+#define sleep_cpu()			sim_sleep()
+#define sleep_mode() \
+	do { sleep_enable(); sleep_cpu(); sleep_disable(); } while(0)
+
+#endif // __HOST_AVR_SLEEP_H__
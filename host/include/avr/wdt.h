@@ -0,0 +1,27 @@
+/*	@title Host shim for <avr/wdt.h> */
+
+#ifndef __HOST_AVR_WDT_H__
+#define __HOST_AVR_WDT_H__
+
+#include <avr/io.h>
+
+#define WDTO_15MS	0
+#define WDTO_30MS	1
+#define WDTO_60MS	2
+#define WDTO_120MS	3
+#define WDTO_250MS	4
+#define WDTO_500MS	5
+#define WDTO_1S		6
+#define WDTO_2S		7
+#define WDTO_4S		8
+#define WDTO_8S		9
+
+#define wdt_reset()			sim_wdt_reset()
+#define wdt_enable(value) \
+	do { \
+		sim_wdt_reset(); \
+		WDTCR = _BV(WDE) | ((value) & 7) | (((value) & 8) ? _BV(WDP3) : 0); \
+	} while(0)
+#define wdt_disable()		do { WDTCR = 0; } while(0)
+
+#endif // __HOST_AVR_WDT_H__
@@ -0,0 +1,44 @@
+/*	@title Host shim for <util/crc16.h>
+**
+**	C equivalents of the avr-libc assembly CRC routines, taken from
+**	the avr-libc documentation.
+*/
+
+#ifndef __HOST_UTIL_CRC16_H__
+#define __HOST_UTIL_CRC16_H__
+
+#include <stdint.h>
+
+static inline uint16_t
+_crc16_update(uint16_t crc, uint8_t a) {
+	crc ^= a;
+	for(uint8_t i = 0; i < 8; ++i) {
+		if(crc & 1)
+			crc = (crc >> 1) ^ 0xA001;
+		else
+			crc = (crc >> 1);
+	}
+	return crc;
+}
+
+static inline uint16_t
+_crc_ccitt_update(uint16_t crc, uint8_t data) {
+	data ^= (uint8_t)(crc & 0xff);
+	data ^= data << 4;
+	return ((((uint16_t)data << 8) | (crc >> 8)) ^ (uint8_t)(data >> 4)
+	        ^ ((uint16_t)data << 3));
+}
+
+static inline uint8_t
+_crc_ibutton_update(uint8_t crc, uint8_t data) {
+	crc = crc ^ data;
+	for(uint8_t i = 0; i < 8; i++) {
+		if(crc & 0x01)
+			crc = (crc >> 1) ^ 0x8C;
+		else
+			crc >>= 1;
+	}
+	return crc;
+}
+
+#endif // __HOST_UTIL_CRC16_H__
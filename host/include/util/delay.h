@@ -0,0 +1,21 @@
+/*	@title Host shim for <util/delay.h>
+**
+**	Delays do not actually wait; they just advance the simulated
+**	cycle count.
+*/
+
+#ifndef __HOST_UTIL_DELAY_H__
+#define __HOST_UTIL_DELAY_H__
+
+#include <avr/io.h>
+
+#ifndef F_CPU
+#error F_CPU must be defined
+#endif
+
+#define _delay_us(us)	sim_delay_cycles((uint32_t)((double)(us) * (F_CPU) / 1e6))
+#define _delay_ms(ms)	sim_delay_cycles((uint32_t)((double)(ms) * (F_CPU) / 1e3))
+#define _delay_loop_1(n)	sim_delay_cycles((uint32_t)(n) * 3)
+#define _delay_loop_2(n)	sim_delay_cycles((uint32_t)(n) * 4)
+
+#endif // __HOST_UTIL_DELAY_H__
@@ -0,0 +1,441 @@
+/*	@title Build Configuration Matrix
+**
+**	Prints one line of the build matrix (see `make matrix`) for the
+**	configuration main.c was built with: flash and RAM used on the
+**	target (when passed in with -f and -r, since only avr-gcc knows;
+**	with -l, a build that leaves too little SRAM for the stack fails),
+**	the cycles taken by one conversion with the default settings, and
+**	the cycles taken by a whole READMEM transaction of the value page,
+**	from the reset pulse to the last CRC byte. Cycles are only charged
+**	for register accesses, delays, pin polls and interrupts, so the
+**	cost of the firmware's own arithmetic is not included.
+**
+**	The transaction is run through main() itself, with a scripted
+**	master on the simulated bus. Its length is set by the master, so
+**	what is reported is the time the device spent awake for it. With
+**	-t, the bus during that transaction is written out as a VCD trace
+**	for host/bus-trace to decode (see `make bus-trace`).
+**
+**	@legal
+**	This package is free software; you can redistribute it and/or
+**	modify it under the terms of the GNU General Public License
+**	version 2 as published by the Free Software Foundation.
+**
+**	This package is distributed in the hope that it will be useful,
+**	but WITHOUT ANY WARRANTY; without even the implied warranty of
+**	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+**	General Public License for more details.
+**	@endlegal
+*/
+
+#include "../main.c"
+
+#undef main
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define US_TO_CYCLES(us)	((uint64_t)((us) * (F_CPU / 1000000.0) + 0.5))
+
+#define MAX_INTERVALS		(256)
+#define MAX_EDGES			(1024)
+#define RD_MEM_LEN			(10)	//!< Value page and its CRC
+
+#if defined(__AVR_ATtiny25__)
+#define DEVICE_NAME "attiny25"
+#else
+#define DEVICE_NAME "attiny13a"
+#endif
+
+#if COMM_PHY_PROTO == COMM_PHY_1WIRE
+#define PHY_NAME "1-Wire"
+#elif COMM_PHY_PROTO == COMM_PHY_FxB
+#define PHY_NAME "Fox-Bus"
+#else
+#define PHY_NAME "2-Wire"
+#endif
+
+//!	Build switches shown by -S, after main.c has worked out their defaults.
+#define SWITCH(x)	{ #x, (x) }
+static const struct {
+	const char* name;
+	uint8_t on;
+} switches[] = {
+	SWITCH(DEVICE_IS_SPACE_CONSTRAINED),
+	SWITCH(SUPPORT_DEVICE_NAMING),
+	SWITCH(SUPPORT_CONVERT_INDICATOR),
+	SWITCH(USE_WATCHDOG),
+	SWITCH(USE_IDLE_SLEEP),
+	SWITCH(SUPPORT_VOLT_READING),
+	SWITCH(SUPPORT_TEMP_READING),
+	SWITCH(USE_ADC_ISR),
+	SWITCH(EMULATE_DS18B20),
+	SWITCH(DO_FILTERING),
+	SWITCH(SUPPORT_FILTER_MEDIAN),
+	SWITCH(SUPPORT_FILTER_TRIMMED_MEAN),
+	SWITCH(SUPPORT_FILTER_EWMA),
+	SWITCH(DO_CALIBRATION),
+	SWITCH(SUPPORT_CALIB_TABLE),
+	SWITCH(SUPPORT_TEMP_COMPENSATION),
+	SWITCH(SUPPORT_RD_VALUES),
+	SWITCH(SUPPORT_CHANGE_ALARM),
+	SWITCH(SUPPORT_ADAPTIVE_OVERSAMPLE),
+	SWITCH(USE_ISR_SLAVE),
+	SWITCH(SUPPORT_AUTO_CONVERT),
+	SWITCH(SUPPORT_OVERDRIVE),
+	SWITCH(SUPPORT_HISTORY),
+	SWITCH(SUPPORT_CFG_JOURNAL),
+	SWITCH(USE_RESPONSE_CACHE),
+	SWITCH(SUPPORT_CONVERT_SELECT),
+};
+
+struct figures_t {
+	uint64_t	cycles;
+	uint64_t	active;			//!< Cycles spent awake
+};
+
+static void
+figures_begin(struct figures_t* figures) {
+	figures->cycles = sim_stats.cycles;
+	figures->active = sim_stats.state_cycles[SIM_POWER_ACTIVE];
+}
+
+static void
+figures_end(struct figures_t* figures) {
+	figures->cycles = sim_stats.cycles - figures->cycles;
+	figures->active = sim_stats.state_cycles[SIM_POWER_ACTIVE] - figures->active;
+}
+
+// ----------------------------------------------------------------------------
+#pragma mark -
+#pragma mark Scripted Bus Master
+
+// Not scripted for 2-Wire.
+#if COMM_PHY_PROTO != COMM_PHY_2WIRE
+
+//!	Master timing, in microseconds. See bus-timing.c.
+#if COMM_PHY_PROTO == COMM_PHY_1WIRE
+#define MASTER_SLOT			(70)
+#define MASTER_WRITE1_LOW	(6)
+#define MASTER_WRITE0_LOW	(60)
+#define MASTER_READ_SAMPLE	(15)
+#define MASTER_RESET_LOW	(480)
+#define MASTER_RESET_HIGH	(480)
+#elif COMM_PHY_PROTO == COMM_PHY_FxB
+#define MASTER_SLOT			(300)
+#define MASTER_WRITE1_LOW	(5)
+#define MASTER_MARK_DELAY	(10)
+#define MASTER_MARK_LOW		(20)
+#define MASTER_READ_SAMPLE	(5 + 7.5)
+#define MASTER_RESET_LOW	(480)
+#define MASTER_RESET_HIGH	(20)
+#endif
+
+struct interval_t {
+	uint64_t start;
+	uint64_t end;
+};
+
+struct edge_t {
+	uint64_t cycle;
+	uint8_t low;
+};
+
+static struct interval_t intervals[MAX_INTERVALS];
+static uint16_t interval_count;
+static uint16_t interval_next;		//!< First interval that hasn't ended yet
+
+static struct edge_t edges[MAX_EDGES];
+static uint16_t edge_count;
+
+static uint64_t samples[RD_MEM_LEN * 8];
+static uint8_t sample_count;
+
+static uint64_t script_cycle;		//!< Where the script is up to
+static uint64_t deadline;
+static jmp_buf deadline_jmp;
+
+static struct figures_t* measure;	//!< Starts being taken at the first interval
+static uint64_t measure_start;
+
+// The device only ever moves forward in time,
+// so there is no need to look at every interval.
+static uint8_t
+master_level(uint64_t cycle) {
+	if(cycle > deadline)
+		longjmp(deadline_jmp, 1);
+
+	if(measure && (cycle >= measure_start)) {
+		figures_begin(measure);
+		measure = NULL;
+	}
+
+	while((interval_next < interval_count) && (intervals[interval_next].end <= cycle))
+		interval_next++;
+
+	return (interval_next == interval_count) || (cycle < intervals[interval_next].start);
+}
+
+static uint64_t
+master_next_edge(uint64_t cycle) {
+	for(uint16_t i = interval_next; i < interval_count; i++) {
+		if(intervals[i].end > cycle)
+			return (intervals[i].start > cycle) ? intervals[i].start : intervals[i].end;
+	}
+
+	// Make sure a stuck device still reaches the deadline.
+	return (deadline != UINT64_MAX) ? deadline + 1 : UINT64_MAX;
+}
+
+static void
+slave_changed(uint8_t pulling_low, uint64_t cycle) {
+	if(edge_count < MAX_EDGES) {
+		edges[edge_count].cycle = cycle;
+		edges[edge_count].low = pulling_low;
+		edge_count++;
+	}
+}
+
+static const struct sim_bus_t master_bus = {
+	.master_level		= master_level,
+	.master_next_edge	= master_next_edge,
+	.slave_changed		= slave_changed,
+};
+
+static void
+master_pull(uint64_t start, double low_us) {
+	if(interval_count < MAX_INTERVALS) {
+		intervals[interval_count].start = start;
+		intervals[interval_count].end = start + US_TO_CYCLES(low_us);
+		interval_count++;
+	}
+}
+
+static uint8_t
+slave_low_at(uint64_t cycle) {
+	uint8_t low = 0;
+
+	for(uint16_t i = 0; (i < edge_count) && (edges[i].cycle <= cycle); i++)
+		low = edges[i].low;
+	return low;
+}
+
+static void
+script_reset() {
+	master_pull(script_cycle, MASTER_RESET_LOW);
+	script_cycle += US_TO_CYCLES(MASTER_RESET_LOW + MASTER_RESET_HIGH);
+#if COMM_PHY_PROTO == COMM_PHY_FxB
+	// Presence is a '0' sent in the first slot after the reset.
+	master_pull(script_cycle, MASTER_WRITE1_LOW);
+	script_cycle += US_TO_CYCLES(MASTER_SLOT);
+#endif
+}
+
+static void
+script_write_byte(uint8_t byte) {
+	for(uint8_t i = 0; i != 8; i++, byte >>= 1) {
+#if COMM_PHY_PROTO == COMM_PHY_1WIRE
+		master_pull(script_cycle, (byte & 1) ? MASTER_WRITE1_LOW : MASTER_WRITE0_LOW);
+#else
+		master_pull(script_cycle, MASTER_WRITE1_LOW);
+		if(byte & 1)
+			master_pull(
+				script_cycle + US_TO_CYCLES(MASTER_WRITE1_LOW + MASTER_MARK_DELAY),
+				MASTER_MARK_LOW
+			);
+#endif
+		script_cycle += US_TO_CYCLES(MASTER_SLOT);
+	}
+}
+
+static void
+script_read_byte() {
+	for(uint8_t i = 0; i != 8; i++) {
+		master_pull(script_cycle, MASTER_WRITE1_LOW);
+		samples[sample_count++] = script_cycle + US_TO_CYCLES(MASTER_READ_SAMPLE);
+		script_cycle += US_TO_CYCLES(MASTER_SLOT);
+	}
+}
+#endif
+
+// ----------------------------------------------------------------------------
+#pragma mark -
+#pragma mark Measurements
+
+static struct figures_t convert;
+#if COMM_PHY_PROTO != COMM_PHY_2WIRE
+static struct figures_t rd_mem;
+static bool rd_mem_ok;
+static FILE* rd_mem_trace;
+#endif
+
+//!	Runs one conversion with the settings from EEPROM.
+static void
+run_convert() {
+	sim_reset();
+
+	DDRB = _BV(MOIST_COLLECTOR_PIN) | _BV(MOIST_DRIVE_PIN);
+	PORTB = ~(_BV(COMM_SDA) | _BV(MOIST_COLLECTOR_PIN) | _BV(MOIST_DRIVE_PIN));
+#if SUPPORT_VOLT_READING || SUPPORT_TEMP_READING
+	ADCSRA = _BV(ADEN) | _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0);
+#endif
+	do_recall();
+	sei();
+
+	figures_begin(&convert);
+	do_convert(CONVERT_ALL);
+	figures_end(&convert);
+}
+
+#if COMM_PHY_PROTO != COMM_PHY_2WIRE
+//!	Powers up main() and runs READMEM on the value page against it.
+static void
+run_rd_mem() {
+	static jmp_buf device_reset_jmp;
+	uint16_t crc = 0;
+
+	sim_reset();
+	sim_trace_start(rd_mem_trace);
+	sim_bus = &master_bus;
+	sim_reg_mcusr = _BV(PORF);
+	interval_count = interval_next = 0;
+	edge_count = 0;
+	sample_count = 0;
+
+	// Give the device a while to settle into its idle loop.
+	// The transaction starts with the reset pulse.
+	measure_start = script_cycle = US_TO_CYCLES(10000);
+	measure = &rd_mem;
+	script_reset();
+	script_write_byte(COMM_ROMCMD_SKIP);
+	script_write_byte(COMM_FUNCCMD_RD_MEM);
+	script_write_byte(0x00);
+	script_write_byte(0x00);
+	for(uint8_t i = 0; i != RD_MEM_LEN; i++)
+		script_read_byte();
+	deadline = script_cycle;
+
+	if(!setjmp(deadline_jmp)) {
+		sim_reset_jmp = &device_reset_jmp;
+		setjmp(device_reset_jmp);
+		sim_interrupts_enabled = 0;
+		firmware_main();
+	}
+	sim_reset_jmp = NULL;
+	sim_trace_start(NULL);
+	figures_end(&rd_mem);
+
+	// Check the CRC, which covers the command and address too.
+	crc = _crc16_update(crc, COMM_FUNCCMD_RD_MEM);
+	crc = _crc16_update(crc, 0x00);
+	crc = _crc16_update(crc, 0x00);
+	for(uint8_t i = 0; i != RD_MEM_LEN; i++) {
+		uint8_t byte = 0;
+
+		for(uint8_t j = 0; j != 8; j++)
+			if(!slave_low_at(samples[i * 8 + j]))
+				byte |= (1 << j);
+		if(i < 8)
+			crc = _crc16_update(crc, byte);
+		else
+			crc ^= (uint16_t)byte << (8 * (i - 8));
+	}
+	rd_mem_ok = (crc == 0);
+}
+#endif
+
+// ----------------------------------------------------------------------------
+#pragma mark -
+#pragma mark Main
+
+static void
+usage(const char* name) {
+	fprintf(stderr,
+		"usage: %s [-H] [-S] [-n name] [-f bytes] [-r bytes] [-l bytes] [-t file]\n"
+		"\n"
+		"  -H        Print the column headings and exit\n"
+		"  -S        Print the build switches and exit\n"
+		"  -n name   Name of this configuration (base)\n"
+		"  -f bytes  Flash used on the target\n"
+		"  -r bytes  RAM used on the target\n"
+		"  -l bytes  Most RAM that still leaves room for the stack\n"
+		"  -t file   Write a VCD trace of the READMEM transaction\n",
+		name
+	);
+}
+
+int
+main(int argc, char* argv[]) {
+	const char* name = "base";
+	const char* flash = "-";
+	const char* ram = "-";
+	long ram_limit = -1;
+	bool ram_ok;
+	int c;
+
+	while((c = getopt(argc, argv, "HSn:f:r:l:t:h")) != -1) {
+		switch(c) {
+		case 'H':
+			// The simulator only charges for what touches the hardware,
+			// so builds that differ in their arithmetic alone (such as
+			// DO_CALIBRATION or DO_FILTERING) can show the same cycles.
+			printf("(*) cycles exclude computation: only register accesses,"
+				" delays, pin polls and interrupts are counted\n");
+			printf("%-9s %-8s %-30s %6s %5s %10s %9s %10s %10s %4s\n",
+				"device", "phy", "config", "flash", "ram",
+				"conv-cyc*", "conv-ms*", "rdmem-cyc*", "rdmem-act*", "stat");
+			return 0;
+		case 'S':
+			for(uint8_t i = 0; i != sizeof(switches) / sizeof(*switches); i++)
+				printf("%s=%d ", switches[i].name, switches[i].on ? 1 : 0);
+			printf("\n");
+			return 0;
+		case 'n': name = optarg; break;
+		case 'f': flash = optarg; break;
+		case 'r': ram = optarg; break;
+		case 'l': ram_limit = strtol(optarg, NULL, 0); break;
+		case 't':
+#if COMM_PHY_PROTO != COMM_PHY_2WIRE
+			if(!(rd_mem_trace = fopen(optarg, "w"))) {
+				perror(optarg);
+				return 1;
+			}
+#endif
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	run_convert();
+#if COMM_PHY_PROTO != COMM_PHY_2WIRE
+	run_rd_mem();
+	if(rd_mem_trace)
+		fclose(rd_mem_trace);
+#endif
+
+	ram_ok = (ram_limit < 0) || (strtol(ram, NULL, 0) <= ram_limit);
+
+	printf("%-9s %-8s %-30s %6s %5s %10llu %9.3f ",
+		DEVICE_NAME,
+		PHY_NAME,
+		name,
+		flash,
+		ram,
+		(unsigned long long)convert.cycles,
+		convert.cycles * 1000.0 / F_CPU
+	);
+#if COMM_PHY_PROTO != COMM_PHY_2WIRE
+	printf("%10llu %10llu %4s\n",
+		(unsigned long long)rd_mem.cycles,
+		(unsigned long long)rd_mem.active,
+		!rd_mem_ok ? "ERR" : !ram_ok ? "RAM" : "ok"
+	);
+	return !rd_mem_ok || !ram_ok;
+#else
+	printf("%10s %10s %4s\n", "-", "-", ram_ok ? "ok" : "RAM");
+	return !ram_ok;
+#endif
+}
@@ -0,0 +1,361 @@
+/*	@title Power Budget Report
+**
+**	Runs main.c through the situations that make up its day on a
+**	battery powered bus, and reports how long it spends in each
+**	power state and the supply charge it draws:
+**
+**	 *	quiet: the bus is idle, so the device sits in the
+**		wait_for_reset loop of main().
+**	 *	traffic: the master keeps talking to other devices, opening
+**		a slot every 70µs, which the device has to watch.
+**	 *	convert: one full conversion, as run for CONVERT.
+**	 *	period: one conversion per period with the bus quiet in
+**		between, worked out from the quiet and convert figures. This
+**		is the energy per measurement.
+**
+**	Currents come from sim_model, and may be overridden with -c. Wake
+**	latency is the longest time from an interrupt coming in while
+**	asleep to its handler running. Build with USE_IDLE_SLEEP=0 for
+**	the figures of a device which never sleeps between transactions.
+**
+**	@legal
+**	This package is free software; you can redistribute it and/or
+**	modify it under the terms of the GNU General Public License
+**	version 2 as published by the Free Software Foundation.
+**
+**	This package is distributed in the hope that it will be useful,
+**	but WITHOUT ANY WARRANTY; without even the implied warranty of
+**	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+**	General Public License for more details.
+**	@endlegal
+*/
+
+#include "../main.c"
+
+#undef main
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#if COMM_PHY_PROTO == COMM_PHY_2WIRE
+#error power only supports single-wire physical protocols
+#endif
+
+#define US_TO_CYCLES(us)	((uint64_t)((us) * (F_CPU / 1000000.0) + 0.5))
+#define CYCLES_TO_MS(c)		((double)(c) * 1000.0 / F_CPU)
+#define CYCLES_TO_US(c)		((double)(c) * 1000000.0 / F_CPU)
+
+#define SLOT_PERIOD			(70)	//!< Slot period of the traffic, in µs
+#define SLOT_LOW			(6)		//!< Low time opening each slot, in µs
+
+#if USE_IDLE_SLEEP
+#define BUILD_NAME "sleep"
+#else
+#define BUILD_NAME "spin"
+#endif
+
+#if defined(__AVR_ATtiny25__)
+#define DEVICE_NAME "attiny25"
+#else
+#define DEVICE_NAME "attiny13a"
+#endif
+
+// ----------------------------------------------------------------------------
+#pragma mark Bus Traffic
+
+static uint64_t traffic_start;		//!< First slot, zero for a quiet bus
+static uint64_t traffic_end;
+
+// The device may well be asleep when time is up, so
+// the bus gets us out of there when it gets there.
+static uint64_t deadline;
+static jmp_buf deadline_jmp;
+
+static uint8_t
+master_level(uint64_t cycle) {
+	if(cycle >= deadline)
+		longjmp(deadline_jmp, 1);
+
+	if(!traffic_start || (cycle < traffic_start) || (cycle >= traffic_end))
+		return 1;
+	return (cycle - traffic_start) % US_TO_CYCLES(SLOT_PERIOD) >= US_TO_CYCLES(SLOT_LOW);
+}
+
+static uint64_t
+master_next_edge(uint64_t cycle) {
+	const uint64_t period = US_TO_CYCLES(SLOT_PERIOD);
+	uint64_t phase;
+
+	uint64_t ret;
+
+	if(!traffic_start || (cycle >= traffic_end))
+		ret = UINT64_MAX;
+	else if(cycle < traffic_start)
+		ret = traffic_start;
+	else if((phase = (cycle - traffic_start) % period) < US_TO_CYCLES(SLOT_LOW))
+		ret = cycle - phase + US_TO_CYCLES(SLOT_LOW);
+	else
+		ret = cycle - phase + period;
+
+	return (deadline < ret) ? deadline : ret;
+}
+
+static const struct sim_bus_t master_bus = {
+	.master_level		= master_level,
+	.master_next_edge	= master_next_edge,
+};
+
+// ----------------------------------------------------------------------------
+#pragma mark -
+#pragma mark Device Setup
+
+static bool auto_convert;
+
+//!	Mirrors the register setup performed by main() after a hard reset.
+static void
+device_start() {
+	sim_reset();
+	sim_bus = &master_bus;
+	traffic_start = 0;
+	deadline = UINT64_MAX;
+
+	DDRB = _BV(MOIST_COLLECTOR_PIN) | _BV(MOIST_DRIVE_PIN);
+	PORTB = ~(_BV(COMM_SDA) | _BV(MOIST_COLLECTOR_PIN) | _BV(MOIST_DRIVE_PIN));
+	TIMSK0 = _BV(TOIE0);
+#if SUPPORT_AUTO_CONVERT
+	TCCR1 = _BV(CS13) | _BV(CS12) | _BV(CS11) | _BV(CS10);
+	sbi(TIMSK, TOIE1);
+#endif
+#if SUPPORT_CONVERT_INDICATOR && (COMM_PHY_PROTO == COMM_PHY_1WIRE)
+	OCR0A = (uint8_t)((uint32_t)OWSLAVE_T_X * F_CPU / (8l * 1000000l));
+#elif SUPPORT_CONVERT_INDICATOR && (COMM_PHY_PROTO == COMM_PHY_FxB)
+	OCR0A = (uint8_t)((uint32_t)COMM_FxB_T_BUSY * F_CPU / (8l * 1000000l));
+#endif
+#if SUPPORT_VOLT_READING || SUPPORT_TEMP_READING
+	ADCSRA = _BV(ADEN) | _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0);
+#endif
+	sbi(PCMSK, COMM_SDA);
+	sbi(GIMSK, PCIE);
+#if USE_WATCHDOG
+	wdt_enable(WDTO_MAX);
+#endif
+	sei();
+
+	do_recall();
+#if SUPPORT_AUTO_CONVERT
+	if(auto_convert)
+		cfg.flags |= CFG_FLAG_AUTO_CONVERT;
+#endif
+#if SUPPORT_OVERDRIVE
+	comm_overdrive = false;
+#endif
+}
+
+//!	Runs the wait_for_reset loop in main() until `cycles` have passed.
+static void
+device_idle(uint64_t cycles) {
+	deadline = sim_stats.cycles + cycles;
+	if(setjmp(deadline_jmp)) {
+		deadline = UINT64_MAX;
+		return;
+	}
+
+	for(;;) {
+		sbi(PCMSK, COMM_SDA);
+		sbi(GIMSK, PCIE);
+		sei();
+
+#if COMM_IS_INTERRUPT_DRIVEN
+		comm_isr_service();
+#endif
+
+#if SUPPORT_CFG_JOURNAL && COMM_IS_INTERRUPT_DRIVEN
+		cfg_commit_step();
+#endif
+
+#if SUPPORT_AUTO_CONVERT
+		if(auto_convert_is_due())
+			do_auto_convert();
+#endif
+
+#if USE_WATCHDOG
+		wdt_reset();
+#endif
+
+#if USE_IDLE_SLEEP
+		idle_sleep();
+#endif
+	}
+}
+
+// ----------------------------------------------------------------------------
+#pragma mark -
+#pragma mark Report
+
+static double quiet_ms = 30000;
+static double period_ms = 60000;
+
+struct figures_t {
+	uint64_t	cycles;
+	uint64_t	state_cycles[SIM_POWER_STATES];
+	double		charge;				//!< µC
+	uint32_t	wakeups;
+	uint32_t	wake_latency;
+};
+
+static void
+figures_take(struct figures_t* figures) {
+	figures->cycles = sim_stats.cycles;
+	memcpy(figures->state_cycles, sim_stats.state_cycles, sizeof(figures->state_cycles));
+	figures->charge = sim_stats.charge;
+	figures->wakeups = sim_stats.wakeups;
+	figures->wake_latency = sim_stats.wake_latency;
+}
+
+static void
+report(const char* scenario, const struct figures_t* figures) {
+	const double ms = CYCLES_TO_MS(figures->cycles);
+	double pct[SIM_POWER_STATES];
+
+	for(uint8_t i = 0; i != SIM_POWER_STATES; i++)
+		pct[i] = figures->cycles ? 100.0 * figures->state_cycles[i] / figures->cycles : 0;
+
+	printf("%-9s %-5s %-9s %-8s %12.3f %6.2f %6.2f %6.2f %6.2f %9.2f %10.3f %9.3f %7lu %7.2f\n",
+		DEVICE_NAME,
+		BUILD_NAME,
+		scenario,
+#if COMM_PHY_PROTO == COMM_PHY_1WIRE
+		"1-Wire",
+#else
+		"Fox-Bus",
+#endif
+		ms,
+		pct[SIM_POWER_ACTIVE],
+		pct[SIM_POWER_IDLE],
+		pct[SIM_POWER_ADC],
+		pct[SIM_POWER_DOWN],
+		ms ? figures->charge / ms * 1000.0 : 0,
+		figures->charge,
+		figures->charge * sim_model.vcc,
+		(unsigned long)figures->wakeups,
+		CYCLES_TO_US(figures->wake_latency)
+	);
+}
+
+static void
+run() {
+	struct figures_t quiet;
+	struct figures_t traffic;
+	struct figures_t convert;
+	struct figures_t period;
+	double idle_cycles;
+
+	device_start();
+	device_idle(US_TO_CYCLES(quiet_ms * 1000));
+	figures_take(&quiet);
+	report("quiet", &quiet);
+
+	device_start();
+	traffic_start = sim_stats.cycles + US_TO_CYCLES(SLOT_PERIOD);
+	traffic_end = traffic_start + US_TO_CYCLES(1000000);
+	device_idle(traffic_end + US_TO_CYCLES(SLOT_PERIOD) - sim_stats.cycles);
+	figures_take(&traffic);
+	report("traffic", &traffic);
+
+	device_start();
+	do_convert(CONVERT_ALL);
+	figures_take(&convert);
+	report("convert", &convert);
+
+	// Scale the quiet figures to whatever is left of the period.
+	idle_cycles = US_TO_CYCLES(period_ms * 1000) - (double)convert.cycles;
+	if(idle_cycles < 0)
+		idle_cycles = 0;
+	period = convert;
+	period.cycles += idle_cycles;
+	for(uint8_t i = 0; i != SIM_POWER_STATES; i++)
+		period.state_cycles[i] += quiet.state_cycles[i] * idle_cycles / quiet.cycles;
+	period.charge += quiet.charge * idle_cycles / quiet.cycles;
+	period.wakeups += quiet.wakeups * idle_cycles / quiet.cycles;
+	if(quiet.wake_latency > period.wake_latency)
+		period.wake_latency = quiet.wake_latency;
+	report("period", &period);
+}
+
+static void
+usage(const char* name) {
+	fprintf(stderr,
+		"usage: %s [-H] [-q ms] [-p ms] [-v vcc] [-a] [-c state=uA]\n"
+		"\n"
+		"  -H          Print the column headings and exit\n"
+		"  -q ms       Length of the quiet bus scenario (%g)\n"
+		"  -p ms       Time between measurements for the period figures (%g)\n"
+		"  -v vcc      Supply voltage, for the energy figures (%g)\n"
+		"  -a          Turn on AUTO_CONVERT\n"
+		"  -c state=uA Current of active, idle, adc, down, adc-on or wdt\n",
+		name,
+		quiet_ms,
+		period_ms,
+		sim_model.vcc
+	);
+}
+
+//!	Parses a -c argument into sim_model.
+static int
+set_current(const char* arg) {
+	static const char* names[] = { "active", "idle", "adc", "down" };
+	const char* eq = strchr(arg, '=');
+	size_t len;
+
+	if(!eq)
+		return -1;
+	len = eq - arg;
+
+	for(uint8_t i = 0; i != SIM_POWER_STATES; i++) {
+		if((strlen(names[i]) == len) && !strncmp(arg, names[i], len)) {
+			sim_model.current[i] = atof(eq + 1);
+			return 0;
+		}
+	}
+	if((len == 6) && !strncmp(arg, "adc-on", len)) {
+		sim_model.adc_current = atof(eq + 1);
+		return 0;
+	}
+	if((len == 3) && !strncmp(arg, "wdt", len)) {
+		sim_model.wdt_current = atof(eq + 1);
+		return 0;
+	}
+	return -1;
+}
+
+int
+main(int argc, char* argv[]) {
+	int c;
+
+	while((c = getopt(argc, argv, "Hq:p:v:ac:h")) != -1) {
+		switch(c) {
+		case 'H':
+			printf("%-9s %-5s %-9s %-8s %12s %6s %6s %6s %6s %9s %10s %9s %7s %7s\n",
+				"device", "build", "scenario", "phy", "ms",
+				"act%", "idle%", "adc%", "down%",
+				"avg-uA", "charge-uC", "energy-uJ", "wakes", "wake-us");
+			return 0;
+		case 'q': quiet_ms = atof(optarg); break;
+		case 'p': period_ms = atof(optarg); break;
+		case 'v': sim_model.vcc = atof(optarg); break;
+		case 'a': auto_convert = true; break;
+		case 'c':
+			if(set_current(optarg) == 0)
+				break;
+			// Fall through
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	run();
+
+	return 0;
+}
@@ -0,0 +1,482 @@
+/*	@title EEPROM Provisioning
+**
+**	Makes the EEPROM images for a production run: a random serial
+**	number for each device, checked against a registry of the ones
+**	already handed out, plus the configuration and calibration pages
+**	it should start out with. Each image is written as Intel HEX, ready
+**	for `avrdude -U eeprom:w:file:i`.
+**
+**	The pages start out as the defaults in main.c, which -s changes
+**	for every device and each line of a -c file for one device. A line
+**	is a list of field=value pairs, see `fields` below for the names.
+**	The configuration journal is erased along with them, so that the
+**	device starts out with the pages written here.
+**
+**	@legal
+**	This package is free software; you can redistribute it and/or
+**	modify it under the terms of the GNU General Public License
+**	version 2 as published by the Free Software Foundation.
+**
+**	This package is distributed in the hope that it will be useful,
+**	but WITHOUT ANY WARRANTY; without even the implied warranty of
+**	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+**	General Public License for more details.
+**	@endlegal
+*/
+
+#include "../main.c"
+
+#undef main
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/file.h>
+
+// Where avrdude expects EEPROM contents in an Intel HEX file.
+#define HEX_EEPROM_SEGMENT		(0x0081)
+#define HEX_RECORD_LEN			(16)
+
+#define PAGES_LEN				(sizeof(struct cfg_t) + sizeof(struct calib_t))
+
+// Where the EEPROM variables end up on the target, which packs them one
+// after the other in the order of the EEPROM Layout section of main.c.
+// The host pads the larger ones, so their addresses here are no help.
+#define EEPROM_CFG_OFFSET		(sizeof(comm_addr))
+
+#if SUPPORT_CFG_JOURNAL
+static const uint16_t eeprom_journal_offset = EEPROM_CFG_OFFSET + PAGES_LEN
+#if SUPPORT_CALIB_TABLE
+	+ sizeof(calib_table_eeprom)
+#endif
+#if SUPPORT_DEVICE_NAMING
+	+ sizeof(device_name)
+#endif
+	;
+#endif
+
+// ----------------------------------------------------------------------------
+#pragma mark CRC
+
+static uint8_t crc8_table[256];
+
+//!	Same CRC as _crc_ibutton_update(), a byte at a time.
+static void
+crc8_init() {
+	for(unsigned i = 0; i != 256; i++) {
+		uint8_t crc = i;
+
+		for(uint8_t j = 0; j != 8; j++)
+			crc = (crc & 1) ? (crc >> 1) ^ 0x8C : crc >> 1;
+		crc8_table[i] = crc;
+	}
+}
+
+static uint8_t
+crc8(const uint8_t* data, uint8_t len) {
+	uint8_t crc = 0;
+
+	while(len--)
+		crc = crc8_table[crc ^ *data++];
+	return crc;
+}
+
+// ----------------------------------------------------------------------------
+#pragma mark -
+#pragma mark Serial Registry
+
+//!	Set of serial numbers, kept as open-addressed hash table.
+struct serial_set_t {
+	uint64_t*	slots;		//!< Zero for an empty slot, never a serial
+	size_t		size;		//!< Always a power of two
+	size_t		count;
+};
+
+static struct serial_set_t taken;
+
+static size_t
+serial_hash(uint64_t serial, size_t size) {
+	serial ^= serial >> 29;
+	serial *= 0xBF58476D1CE4E5B9ull;
+	serial ^= serial >> 32;
+	return (size_t)serial & (size - 1);
+}
+
+//!	Returns false if `serial` was already in the set.
+static bool
+serial_add(uint64_t serial) {
+	size_t i;
+
+	if((taken.count + 1) * 2 > taken.size) {
+		struct serial_set_t old = taken;
+
+		taken.size = old.size ? old.size * 2 : 1024;
+		taken.slots = calloc(taken.size, sizeof(*taken.slots));
+		if(!taken.slots) {
+			fprintf(stderr, "Out of memory\n");
+			exit(1);
+		}
+		for(i = 0; i != old.size; i++) {
+			size_t j;
+
+			if(!old.slots[i])
+				continue;
+			j = serial_hash(old.slots[i], taken.size);
+			while(taken.slots[j])
+				j = (j + 1) & (taken.size - 1);
+			taken.slots[j] = old.slots[i];
+		}
+		free(old.slots);
+	}
+
+	i = serial_hash(serial, taken.size);
+	while(taken.slots[i]) {
+		if(taken.slots[i] == serial)
+			return false;
+		i = (i + 1) & (taken.size - 1);
+	}
+	taken.slots[i] = serial;
+	taken.count++;
+	return true;
+}
+
+static uint64_t
+rom_serial(const comm_addr_t* rom) {
+	uint64_t serial = 0;
+
+	for(int8_t i = 5; i >= 0; i--)
+		serial = (serial << 8) | rom->s.serial[i];
+	return serial;
+}
+
+//!	Loads every ROM ID in the registry, one per line in the
+//!	same form as bus-poll prints them, into `taken`.
+static int
+registry_load(FILE* file, const char* path) {
+	char line[64];
+	unsigned lineno = 0;
+
+	rewind(file);
+	while(fgets(line, sizeof(line), file)) {
+		comm_addr_t rom;
+		char* p = line;
+
+		lineno++;
+		while(*p == ' ' || *p == '\t')
+			p++;
+		if(*p == '#' || *p == '\n' || !*p)
+			continue;
+
+		for(uint8_t i = 0; i != 8; i++) {
+			unsigned byte;
+
+			if(sscanf(p + i * 2, "%2x", &byte) != 1) {
+				fprintf(stderr, "%s:%u: bad ROM ID\n", path, lineno);
+				return -1;
+			}
+			rom.d[i] = byte;
+		}
+		serial_add(rom_serial(&rom));
+	}
+	if(ferror(file)) {
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+// ----------------------------------------------------------------------------
+#pragma mark -
+#pragma mark Settings
+
+struct field_t {
+	const char*	name;
+	uint8_t		offset;		//!< Into the configuration and calibration pages
+};
+
+#define CFG_FIELD(x)		{ #x, offsetof(struct cfg_t, x) }
+#define CALIB_FIELD(n, x)	{ n, sizeof(struct cfg_t) + offsetof(struct calib_t, x) }
+
+static const struct field_t fields[] = {
+	CFG_FIELD(alarm_low),
+	CFG_FIELD(alarm_high),
+	CFG_FIELD(flags),
+	CFG_FIELD(delta_moisture),
+	CFG_FIELD(delta_temp),
+	CALIB_FIELD("range", range),
+	CALIB_FIELD("offset", offset),
+	CALIB_FIELD("calib_flags", flags),
+	CALIB_FIELD("temp_offset", temp_offset),
+	CALIB_FIELD("precision", precision),
+	CALIB_FIELD("filter", filter),
+};
+
+//!	Applies a single field=value to `pages`.
+static int
+set_field(uint8_t* pages, const char* arg) {
+	const char* eq = strchr(arg, '=');
+	size_t len;
+	char* end;
+	long value;
+
+	if(!eq)
+		return -1;
+	len = eq - arg;
+
+	value = strtol(eq + 1, &end, 0);
+	if((end == eq + 1) || *end || (value < -128) || (value > 255))
+		return -1;
+
+	for(uint8_t i = 0; i != sizeof(fields) / sizeof(*fields); i++) {
+		if((strlen(fields[i].name) == len) && !strncmp(arg, fields[i].name, len)) {
+			pages[fields[i].offset] = (uint8_t)value;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+//!	Applies every field=value on `line` to `pages`.
+static int
+set_fields(uint8_t* pages, char* line) {
+	for(char* arg = strtok(line, " \t\r\n"); arg; arg = strtok(NULL, " \t\r\n")) {
+		if(set_field(pages, arg) != 0) {
+			fprintf(stderr, "Bad setting \"%s\"\n", arg);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+// ----------------------------------------------------------------------------
+#pragma mark -
+#pragma mark Intel HEX
+
+static void
+hex_record(FILE* out, uint8_t type, uint16_t addr, const uint8_t* data, uint8_t len) {
+	uint8_t sum = len + (addr >> 8) + addr + type;
+
+	fprintf(out, ":%02X%04X%02X", len, addr, type);
+	for(uint8_t i = 0; i != len; i++) {
+		fprintf(out, "%02X", data[i]);
+		sum += data[i];
+	}
+	fprintf(out, "%02X\n", (uint8_t)-sum);
+}
+
+static void
+hex_data(FILE* out, uint16_t addr, const uint8_t* data, size_t len) {
+	while(len) {
+		const uint8_t n = (len > HEX_RECORD_LEN) ? HEX_RECORD_LEN : len;
+
+		hex_record(out, 0x00, addr, data, n);
+		addr += n;
+		data += n;
+		len -= n;
+	}
+}
+
+static void
+write_image(FILE* out, const comm_addr_t* rom, const uint8_t* pages) {
+	const uint8_t segment[2] = { HEX_EEPROM_SEGMENT >> 8, HEX_EEPROM_SEGMENT & 0xFF };
+
+	hex_record(out, 0x04, 0, segment, sizeof(segment));
+	hex_data(out, 0, rom->d, sizeof(rom->d));
+	hex_data(out, EEPROM_CFG_OFFSET, pages, PAGES_LEN);
+#if SUPPORT_CFG_JOURNAL
+	{
+		uint8_t erased[sizeof(cfg_journal)];
+
+		memset(erased, 0xFF, sizeof(erased));
+		hex_data(out, eeprom_journal_offset, erased, sizeof(erased));
+	}
+#endif
+	hex_record(out, 0x01, 0, NULL, 0);
+}
+
+// ----------------------------------------------------------------------------
+#pragma mark -
+#pragma mark Main
+
+//!	Picks a serial number which isn't taken yet.
+static void
+make_rom(comm_addr_t* rom, FILE* random) {
+	rom->s.type = COMM_TYPE_MOIST;
+	do {
+		if(fread(rom->s.serial, 5, 1, random) != 1) {
+			fprintf(stderr, "Out of random numbers\n");
+			exit(1);
+		}
+
+		// Randomly-generated serial numbers have 0xFF
+		// for the most significant byte.
+		rom->s.serial[5] = 0xFF;
+	} while(!serial_add(rom_serial(rom)));
+	rom->s.crc = crc8(rom->d, 7);
+}
+
+static void
+usage(const char* name) {
+	fprintf(stderr,
+		"usage: %s [-r registry] [-n count] [-o prefix] [-c file] [-s field=value]...\n"
+		"\n"
+		"  -r registry    ROM IDs handed out so far, which new ones are added to\n"
+		"  -n count       Number of devices (1)\n"
+		"  -o prefix      Write each image to <prefix><ROM ID>.hex, instead of\n"
+		"                 the only image to the standard output\n"
+		"  -c file        Settings for each device, one line per device\n"
+		"  -s field=value Setting for every device\n",
+		name
+	);
+}
+
+int
+main(int argc, char* argv[]) {
+	uint8_t defaults[PAGES_LEN];
+	const char* registry_path = NULL;
+	const char* prefix = NULL;
+	FILE* settings = NULL;
+	FILE* registry = NULL;
+	FILE* random;
+	unsigned long count = 1;
+	bool count_given = false;
+	unsigned long n;
+	char line[256];
+	int c;
+
+	crc8_init();
+	memcpy(defaults, &cfg_eeprom, sizeof(cfg_eeprom));
+	memcpy(defaults + sizeof(cfg_eeprom), &calib_eeprom, sizeof(calib_eeprom));
+
+	// The ROM ID of a device which was never provisioned.
+	serial_add(rom_serial(&comm_addr));
+
+	while((c = getopt(argc, argv, "r:n:o:c:s:h")) != -1) {
+		switch(c) {
+		case 'r': registry_path = optarg; break;
+		case 'n': count = strtoul(optarg, NULL, 0); count_given = true; break;
+		case 'o': prefix = optarg; break;
+		case 'c':
+			settings = fopen(optarg, "r");
+			if(!settings) {
+				fprintf(stderr, "%s: %s\n", optarg, strerror(errno));
+				return 1;
+			}
+			break;
+		case 's':
+			if(set_field(defaults, optarg) == 0)
+				break;
+			fprintf(stderr, "Bad setting \"%s\"\n", optarg);
+			// Fall through
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if(!prefix && (settings || (count != 1))) {
+		fprintf(stderr, "Only one image can go to the standard output, use -o\n");
+		return 1;
+	}
+
+	if(registry_path) {
+		registry = fopen(registry_path, "a+");
+		if(!registry) {
+			fprintf(stderr, "%s: %s\n", registry_path, strerror(errno));
+			return 1;
+		}
+
+		// Other stations may be provisioning from the same registry.
+		if(flock(fileno(registry), LOCK_EX) != 0) {
+			fprintf(stderr, "%s: %s\n", registry_path, strerror(errno));
+			return 1;
+		}
+		if(registry_load(registry, registry_path) != 0)
+			return 1;
+	}
+
+	random = fopen("/dev/urandom", "r");
+	if(!random) {
+		fprintf(stderr, "/dev/urandom: %s\n", strerror(errno));
+		return 1;
+	}
+
+	// Without -n, a settings file makes as many images as it has lines.
+	if(settings && !count_given)
+		count = ULONG_MAX;
+
+	for(n = 0; n != count; n++) {
+		uint8_t pages[PAGES_LEN];
+		comm_addr_t rom;
+		FILE* out = stdout;
+		char path[PATH_MAX];
+
+		memcpy(pages, defaults, PAGES_LEN);
+		if(settings) {
+			// Skip over blank lines and comments.
+			do {
+				if(!fgets(line, sizeof(line), settings))
+					break;
+				line[strcspn(line, "#")] = 0;
+			} while(!line[strspn(line, " \t\r\n")]);
+			if(feof(settings))
+				break;
+			if(set_fields(pages, line) != 0)
+				return 1;
+		}
+
+		make_rom(&rom, random);
+
+		// Recorded before the image is written, so
+		// that a serial can never be handed out twice.
+		if(registry) {
+			for(uint8_t i = 0; i != 8; i++)
+				fprintf(registry, "%02x", rom.d[i]);
+			fputc('\n', registry);
+			if(fflush(registry) != 0) {
+				fprintf(stderr, "%s: %s\n", registry_path, strerror(errno));
+				return 1;
+			}
+		}
+
+		if(prefix) {
+			int len = snprintf(path, sizeof(path), "%s", prefix);
+
+			for(uint8_t i = 0; i != 8; i++)
+				len += snprintf(path + len, sizeof(path) - len, "%02x", rom.d[i]);
+			snprintf(path + len, sizeof(path) - len, ".hex");
+
+			out = fopen(path, "w");
+			if(!out) {
+				fprintf(stderr, "%s: %s\n", path, strerror(errno));
+				return 1;
+			}
+		}
+
+		write_image(out, &rom, pages);
+
+		if(prefix) {
+			if(fclose(out) != 0) {
+				fprintf(stderr, "%s: %s\n", path, strerror(errno));
+				return 1;
+			}
+			printf("%s\n", path);
+		}
+	}
+
+	if(settings && count_given && (n != count)) {
+		fprintf(stderr, "Only %lu lines of settings for %lu devices\n", n, count);
+		return 1;
+	}
+
+	if(registry && (fsync(fileno(registry)) != 0)) {
+		fprintf(stderr, "%s: %s\n", registry_path, strerror(errno));
+		return 1;
+	}
+
+	return 0;
+}
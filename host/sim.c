@@ -0,0 +1,928 @@
+/*	@title Host Simulation Layer
+**
+**	See sim.h for an overview.
+**
+**	@legal
+**	This package is free software; you can redistribute it and/or
+**	modify it under the terms of the GNU General Public License
+**	version 2 as published by the Free Software Foundation.
+**
+**	This package is distributed in the hope that it will be useful,
+**	but WITHOUT ANY WARRANTY; without even the implied warranty of
+**	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+**	General Public License for more details.
+**	@endlegal
+*/
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <avr/io.h>
+#include <avr/eeprom.h>
+
+#include "sim.h"
+
+// ----------------------------------------------------------------------------
+#pragma mark Pin Assignments
+
+// These must match the defaults in main.c.
+
+#ifndef COMM_SDA
+#define COMM_SDA				(0)		//!< PB0, MOSI
+#endif
+
+#ifndef MOIST_DRIVE_PIN
+#define MOIST_DRIVE_PIN			(4)		//!< PB4
+#endif
+
+#ifndef MOIST_COLLECTOR_PIN
+#define MOIST_COLLECTOR_PIN		(3)		//!< PB3
+#endif
+
+#define MUX_MASK				(0x0F)
+#define MUX_TEMP_SENSOR			(0x0F)
+#define MUX_VBG					(0x0C)
+
+#define SIM_VBG					(1.1)	//!< Bandgap reference, in volts
+
+// ----------------------------------------------------------------------------
+#pragma mark -
+#pragma mark Globals
+
+volatile uint8_t sim_reg_ddrb;
+volatile uint8_t sim_reg_portb;
+volatile uint8_t sim_reg_admux;
+volatile uint8_t sim_reg_adcsra;
+volatile uint8_t sim_reg_adcsrb;
+volatile uint8_t sim_reg_acsr;
+volatile uint8_t sim_reg_didr0;
+volatile uint8_t sim_reg_mcucr;
+volatile uint8_t sim_reg_mcusr;
+volatile uint8_t sim_reg_gimsk;
+volatile uint8_t sim_reg_gifr;
+volatile uint8_t sim_reg_pcmsk;
+volatile uint8_t sim_reg_timsk;
+volatile uint8_t sim_reg_tifr;
+volatile uint8_t sim_reg_tccr0a;
+volatile uint8_t sim_reg_tccr0b;
+volatile uint8_t sim_reg_tcnt0;
+volatile uint8_t sim_reg_ocr0a;
+volatile uint8_t sim_reg_ocr0b;
+volatile uint8_t sim_reg_tccr1;
+volatile uint8_t sim_reg_tcnt1;
+volatile uint8_t sim_reg_ocr1a;
+volatile uint8_t sim_reg_ocr1b;
+volatile uint8_t sim_reg_ocr1c;
+volatile uint8_t sim_reg_gtccr;
+volatile uint8_t sim_reg_wdtcr;
+volatile uint8_t sim_reg_usicr;
+volatile uint8_t sim_reg_usisr;
+volatile uint8_t sim_reg_usidr;
+volatile uint8_t sim_reg_usibr;
+volatile uint8_t sim_reg_eecr;
+
+volatile uint8_t sim_interrupts_enabled;
+
+struct sim_model_t sim_model = {
+	.moist_pulses	= 60.0,
+	.moist_noise	= 0.0,
+	.vcc			= 5.0,
+	.temp_c			= 25.0,
+
+	// Rough typical figures for an ATtiny25 at 8 MHz and 5 V.
+	.current = {
+		[SIM_POWER_ACTIVE]	= 4400.0,
+		[SIM_POWER_IDLE]	= 1100.0,
+		[SIM_POWER_ADC]		= 400.0,
+		[SIM_POWER_DOWN]	= 0.2,
+	},
+	.adc_current	= 250.0,
+	.wdt_current	= 5.0,
+};
+
+struct sim_stats_t sim_stats;
+uint64_t sim_poll_cycles;
+
+// Analog state of the sensing circuit.
+static double collector_level;		//!< Fraction of Vcc on the collector
+static double charge_ratio;			//!< Fraction of the gap closed per pulse
+
+static uint16_t adc_result;
+static uint16_t adc_sampled;		//!< Result of the conversion in progress
+static uint64_t adc_done;			//!< Cycle it finishes at, zero if idle
+static uint8_t adc_warm;
+
+static uint8_t power_state;			//!< One of enum sim_power_t
+static uint8_t waking;				//!< Set until the waking interrupt runs
+static uint64_t wake_event;			//!< Cycle the waking interrupt came in at
+
+static uint64_t wdt_start;			//!< Cycle the watchdog was last reset at
+
+static uint64_t eeprom_done;		//!< Cycle the EEPROM write in progress finishes at
+
+static uint8_t oc1b_level;			//!< Level of the Timer1 OC1B output
+
+static FILE* trace_file;
+static uint64_t trace_cycles;		//!< Time of the last timestamp written
+
+//!	The timers stop along with the I/O clock in the deeper sleep modes.
+static uint8_t
+clk_io_running() {
+	return power_state < SIM_POWER_ADC;
+}
+
+// ----------------------------------------------------------------------------
+#pragma mark -
+#pragma mark Analog Models
+
+static void
+moist_begin() {
+	double pulses = sim_model.moist_pulses;
+
+	if(sim_model.moist_noise > 0)
+		pulses += sim_model.moist_noise * ((double)rand() / RAND_MAX - 0.5);
+
+	if(pulses < 1.0)
+		pulses = 1.0;
+
+	// Each pulse closes a fixed fraction of the remaining gap between
+	// the collector voltage and Vcc, so solve for the fraction which
+	// crosses the Vcc/2 input threshold after `pulses` pulses.
+	charge_ratio = 1.0 - pow(0.5, 1.0 / pulses);
+	collector_level = 0;
+	sim_stats.moist_samples++;
+}
+
+//!	Returns true if the drive pin is an output and is high, taking
+//!	into account OC1B overriding PORTB when it is connected.
+static uint8_t
+drive_is_high(uint8_t ddrb, uint8_t portb) {
+	if(!(ddrb & _BV(MOIST_DRIVE_PIN)))
+		return 0;
+#if defined(__AVR_ATtiny25__) && (MOIST_DRIVE_PIN == PB4)
+	if(sim_reg_gtccr & _BV(COM1B1))
+		return oc1b_level;
+#endif
+	return (portb & _BV(MOIST_DRIVE_PIN)) != 0;
+}
+
+static void
+moist_update(uint8_t old_ddrb, uint8_t old_portb, uint8_t was_driven_high) {
+	const uint8_t coll = _BV(MOIST_COLLECTOR_PIN);
+	const uint8_t is_driven_high = drive_is_high(sim_reg_ddrb, sim_reg_portb);
+	const uint8_t was_flushing = (old_ddrb & coll) && !(old_portb & coll);
+
+	if((sim_reg_ddrb & coll) && !(sim_reg_portb & coll)) {
+		// Collector is being held low, which drains the
+		// holding capacitor.
+		collector_level = 0;
+		return;
+	}
+
+	// Releasing the collector starts a new measurement.
+	if(was_flushing)
+		moist_begin();
+
+	if(is_driven_high && !was_driven_high) {
+		collector_level += (1.0 - collector_level) * charge_ratio;
+		sim_stats.moist_pulses++;
+	}
+}
+
+//!	Samples the selected input and schedules the end of the conversion.
+static void
+adc_start() {
+	uint16_t prescale = 1 << (sim_reg_adcsra & (_BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0)));
+	double result;
+
+	if(prescale == 1)
+		prescale = 2;
+
+	switch(sim_reg_admux & MUX_MASK) {
+	case MUX_TEMP_SENSOR:
+		// ~1 LSB/°C, 300 LSB at 25°C (Datasheet, table 17-2)
+		result = 300.0 + (sim_model.temp_c - 25.0);
+		break;
+	case MUX_VBG:
+		result = SIM_VBG * 1024.0 / sim_model.vcc;
+		break;
+	default:
+		// Unconnected inputs float up to Vcc via their pull-ups.
+		result = 1023;
+		break;
+	}
+
+	if(result < 0)
+		result = 0;
+	if(result > 1023)
+		result = 1023;
+
+	adc_sampled = (uint16_t)(result + 0.5);
+	adc_done = sim_stats.cycles
+		+ (uint32_t)prescale * (adc_warm ? SIM_ADC_CLOCKS : SIM_ADC_CLOCKS_FIRST);
+	adc_warm = 1;
+}
+
+static uint64_t
+adc_cycles_to_event() {
+	if(!adc_done)
+		return UINT64_MAX;
+	return adc_done - sim_stats.cycles;
+}
+
+static void
+adc_step() {
+	if(!adc_done || (sim_stats.cycles < adc_done))
+		return;
+
+	adc_done = 0;
+	adc_result = adc_sampled;
+	sim_reg_adcsra &= (uint8_t) ~_BV(ADSC);
+	sim_reg_adcsra |= _BV(ADIF);
+	sim_stats.adc_conversions++;
+}
+
+// ----------------------------------------------------------------------------
+#pragma mark -
+#pragma mark Timer/Counter0
+
+static uint32_t timer0_residue;		//!< Cycles not yet counted as a tick
+
+static uint16_t
+timer0_prescale() {
+	static const uint16_t prescale[8] = { 0, 1, 8, 64, 256, 1024, 0, 0 };
+
+	return prescale[sim_reg_tccr0b & (_BV(CS02) | _BV(CS01) | _BV(CS00))];
+}
+
+static uint8_t
+timer0_top() {
+	return (sim_reg_tccr0a & _BV(WGM01)) ? sim_reg_ocr0a : 0xFF;
+}
+
+//! Number of cycles until Timer0 next sets one of its flags.
+static uint64_t
+timer0_cycles_to_event() {
+	const uint16_t prescale = timer0_prescale();
+	uint16_t ticks;
+
+	if(!prescale)
+		return UINT64_MAX;
+
+	if(sim_reg_tcnt0 < sim_reg_ocr0a)
+		ticks = sim_reg_ocr0a - sim_reg_tcnt0;
+	else
+		ticks = timer0_top() - sim_reg_tcnt0 + 1;
+
+	return (uint64_t)ticks * prescale - timer0_residue;
+}
+
+static void
+timer0_step(uint64_t cycles) {
+	const uint16_t prescale = timer0_prescale();
+
+	if(!prescale) {
+		timer0_residue = 0;
+		return;
+	}
+
+	cycles += timer0_residue;
+
+	while(cycles >= prescale) {
+		cycles -= prescale;
+		if(sim_reg_tcnt0 == timer0_top()) {
+			sim_reg_tcnt0 = 0;
+			if(!(sim_reg_tccr0a & _BV(WGM01)))
+				sim_reg_tifr |= _BV(TOV0);
+		} else {
+			sim_reg_tcnt0++;
+		}
+		if(sim_reg_tcnt0 == sim_reg_ocr0a)
+			sim_reg_tifr |= _BV(OCF0A);
+	}
+
+	timer0_residue = (uint32_t)cycles;
+}
+
+// ----------------------------------------------------------------------------
+#pragma mark -
+#pragma mark Timer/Counter1
+
+#if defined(__AVR_ATtiny25__)
+static uint32_t timer1_residue;
+
+static uint16_t
+timer1_prescale() {
+	const uint8_t cs = sim_reg_tccr1 & (_BV(CS13) | _BV(CS12) | _BV(CS11) | _BV(CS10));
+
+	return cs ? (uint16_t)(1 << (cs - 1)) : 0;
+}
+
+static uint8_t
+timer1_top() {
+	if((sim_reg_tccr1 & _BV(CTC1)) || (sim_reg_gtccr & _BV(PWM1B)))
+		return sim_reg_ocr1c;
+	return 0xFF;
+}
+
+//!	Sets the OC1B output, which in PWM mode goes high at BOTTOM and
+//!	low on a compare match with OCR1B.
+static void
+timer1_set_oc1b(uint8_t level) {
+	const uint8_t was_driven_high = drive_is_high(sim_reg_ddrb, sim_reg_portb);
+
+	if(level == oc1b_level)
+		return;
+
+	oc1b_level = level;
+	moist_update(sim_reg_ddrb, sim_reg_portb, was_driven_high);
+}
+
+static uint64_t
+timer1_cycles_to_event() {
+	const uint16_t prescale = timer1_prescale();
+
+	if(!prescale)
+		return UINT64_MAX;
+
+	return (uint64_t)(timer1_top() - sim_reg_tcnt1 + 1) * prescale - timer1_residue;
+}
+
+static void
+timer1_step(uint64_t cycles) {
+	const uint16_t prescale = timer1_prescale();
+
+	if(!prescale) {
+		timer1_residue = 0;
+		return;
+	}
+
+	cycles += timer1_residue;
+
+	while(cycles >= prescale) {
+		cycles -= prescale;
+		if(sim_reg_tcnt1 == timer1_top()) {
+			sim_reg_tcnt1 = 0;
+			sim_reg_tifr |= _BV(TOV1);
+		} else {
+			sim_reg_tcnt1++;
+		}
+		if(sim_reg_gtccr & _BV(PWM1B)) {
+			if(sim_reg_tcnt1 == 0)
+				timer1_set_oc1b(1);
+			if(sim_reg_tcnt1 == sim_reg_ocr1b)
+				timer1_set_oc1b(0);
+		}
+	}
+
+	timer1_residue = (uint32_t)cycles;
+}
+#else
+#define timer1_cycles_to_event()	UINT64_MAX
+#define timer1_step(cycles)			do { } while(0)
+#endif
+
+// ----------------------------------------------------------------------------
+#pragma mark -
+#pragma mark Interrupts
+
+// Interrupt vectors that the firmware may or may not implement.
+// Vectors which aren't implemented behave like __bad_interrupt.
+extern void PCINT0_vect(void) __attribute__ ((weak));
+extern void TIM0_COMPA_vect(void) __attribute__ ((weak));
+extern void TIM0_OVF_vect(void) __attribute__ ((weak));
+extern void ADC_vect(void) __attribute__ ((weak));
+extern void EE_RDY_vect(void) __attribute__ ((weak));
+extern void WDT_vect(void) __attribute__ ((weak));
+#if defined(__AVR_ATtiny25__)
+extern void TIM1_OVF_vect(void) __attribute__ ((weak));
+#endif
+
+const struct sim_bus_t* sim_bus;
+jmp_buf* sim_reset_jmp;
+
+static uint8_t last_sda_level = 1;
+
+// ----------------------------------------------------------------------------
+#pragma mark -
+#pragma mark Bus Trace
+
+// VCD identifiers of the traced signals.
+#define TRACE_SDA				'!'
+#define TRACE_DRIVE				'"'
+
+static void
+trace_change(char id, uint8_t level) {
+	if(!trace_file)
+		return;
+
+	if(sim_stats.cycles != trace_cycles) {
+		trace_cycles = sim_stats.cycles;
+		fprintf(trace_file, "#%llu\n",
+			(unsigned long long)((double)trace_cycles * 1e9 / F_CPU + 0.5));
+	}
+	fprintf(trace_file, "%u%c\n", level ? 1 : 0, id);
+}
+
+void
+sim_trace_start(FILE* file) {
+	trace_file = file;
+	if(!file)
+		return;
+
+	trace_cycles = sim_stats.cycles;
+	fprintf(file,
+		"$timescale 1ns $end\n"
+		"$scope module bus $end\n"
+		"$var wire 1 %c sda $end\n"
+		"$var wire 1 %c drive $end\n"
+		"$upscope $end\n"
+		"$enddefinitions $end\n"
+		"#%llu\n"
+		"$dumpvars\n"
+		"%u%c\n"
+		"%u%c\n"
+		"$end\n",
+		TRACE_SDA,
+		TRACE_DRIVE,
+		(unsigned long long)((double)trace_cycles * 1e9 / F_CPU + 0.5),
+		last_sda_level,
+		TRACE_SDA,
+		bit_is_set(sim_reg_ddrb, COMM_SDA) != 0,
+		TRACE_DRIVE
+	);
+}
+
+static void
+device_reset() {
+	sim_stats.resets++;
+	if(sim_reset_jmp)
+		longjmp(*sim_reset_jmp, 1);
+}
+
+static void
+call_vector(void (*vector)(void)) {
+	if(!vector) {
+		// __bad_interrupt jumps to the reset vector.
+		device_reset();
+		return;
+	}
+
+	sim_interrupts_enabled = 0;
+	sim_stats.interrupts++;
+	sim_delay_cycles(SIM_CYCLES_ISR);
+	if(waking) {
+		waking = 0;
+		if(sim_stats.cycles - wake_event > sim_stats.wake_latency)
+			sim_stats.wake_latency = (uint32_t)(sim_stats.cycles - wake_event);
+	}
+	vector();
+	sim_interrupts_enabled = 1;
+}
+
+//!	EEPROM ready can wake us from any sleep mode but power-down.
+static uint8_t
+eeprom_ready_can_wake() {
+	return (sim_stats.cycles >= eeprom_done) && (power_state != SIM_POWER_DOWN);
+}
+
+//!	Returns true if an enabled interrupt is waiting to be serviced.
+static uint8_t
+interrupt_pending() {
+	if(!sim_interrupts_enabled)
+		return 0;
+
+	return ((sim_reg_gifr & _BV(PCIF)) && (sim_reg_gimsk & _BV(PCIE)))
+#if defined(__AVR_ATtiny25__)
+		|| ((sim_reg_tifr & _BV(TOV1)) && (sim_reg_timsk & _BV(TOIE1)))
+#endif
+		|| ((sim_reg_tifr & _BV(TOV0)) && (sim_reg_timsk & _BV(TOIE0)))
+		|| ((sim_reg_eecr & _BV(EERIE)) && eeprom_ready_can_wake())
+		|| ((sim_reg_adcsra & _BV(ADIF)) && (sim_reg_adcsra & _BV(ADIE)))
+		|| ((sim_reg_tifr & _BV(OCF0A)) && (sim_reg_timsk & _BV(OCIE0A)))
+		|| ((sim_reg_wdtcr & _BV(WDIF)) && (sim_reg_wdtcr & _BV(WDIE)));
+}
+
+static void
+dispatch_interrupts() {
+	// Asleep, nothing runs until sim_sleep() has woken us up.
+	if(power_state != SIM_POWER_ACTIVE)
+		return;
+
+	// Checked in vector-table order, which is also the
+	// hardware priority order.
+	while(sim_interrupts_enabled) {
+		if((sim_reg_gifr & _BV(PCIF)) && (sim_reg_gimsk & _BV(PCIE))) {
+			sim_reg_gifr &= (uint8_t) ~_BV(PCIF);
+			call_vector(PCINT0_vect);
+#if defined(__AVR_ATtiny25__)
+		} else if((sim_reg_tifr & _BV(TOV1)) && (sim_reg_timsk & _BV(TOIE1))) {
+			sim_reg_tifr &= (uint8_t) ~_BV(TOV1);
+			call_vector(TIM1_OVF_vect);
+#endif
+		} else if((sim_reg_tifr & _BV(TOV0)) && (sim_reg_timsk & _BV(TOIE0))) {
+			sim_reg_tifr &= (uint8_t) ~_BV(TOV0);
+			call_vector(TIM0_OVF_vect);
+		} else if((sim_reg_eecr & _BV(EERIE)) && (sim_stats.cycles >= eeprom_done)) {
+			// There is no flag, the interrupt keeps
+			// coming for as long as EERIE is set.
+			call_vector(EE_RDY_vect);
+		} else if((sim_reg_adcsra & _BV(ADIF)) && (sim_reg_adcsra & _BV(ADIE))) {
+			sim_reg_adcsra &= (uint8_t) ~_BV(ADIF);
+			call_vector(ADC_vect);
+		} else if((sim_reg_tifr & _BV(OCF0A)) && (sim_reg_timsk & _BV(OCIE0A))) {
+			sim_reg_tifr &= (uint8_t) ~_BV(OCF0A);
+			call_vector(TIM0_COMPA_vect);
+		} else if((sim_reg_wdtcr & _BV(WDIF)) && (sim_reg_wdtcr & _BV(WDIE))) {
+			// In interrupt and system reset mode, the next
+			// time-out resets unless WDIE is set again.
+			sim_reg_wdtcr &= (uint8_t) ~_BV(WDIF);
+			if(sim_reg_wdtcr & _BV(WDE))
+				sim_reg_wdtcr &= (uint8_t) ~_BV(WDIE);
+			call_vector(WDT_vect);
+		} else {
+			break;
+		}
+	}
+}
+
+uint8_t
+sim_sda_level() {
+	if(sim_reg_ddrb & _BV(COMM_SDA))
+		return 0;
+	if(sim_bus && sim_bus->master_level)
+		return sim_bus->master_level(sim_stats.cycles);
+	return 1;
+}
+
+static void
+update_pins() {
+	const uint8_t level = sim_sda_level();
+
+	if(level != last_sda_level) {
+		last_sda_level = level;
+		trace_change(TRACE_SDA, level);
+		if(sim_reg_pcmsk & _BV(COMM_SDA))
+			sim_reg_gifr |= _BV(PCIF);
+	}
+}
+
+// ----------------------------------------------------------------------------
+#pragma mark -
+#pragma mark Watchdog
+
+//! Number of cycles until the watchdog times out.
+static uint64_t
+wdt_cycles_to_event() {
+	const uint8_t wdp = (sim_reg_wdtcr & (_BV(WDP2) | _BV(WDP1) | _BV(WDP0)))
+		| ((sim_reg_wdtcr & _BV(WDP3)) ? 8 : 0);
+	uint64_t end;
+
+	if(!(sim_reg_wdtcr & (_BV(WDE) | _BV(WDIE))))
+		return UINT64_MAX;
+
+	// 2K cycles of the 128kHz watchdog oscillator, doubled per step.
+	end = wdt_start + ((uint64_t)F_CPU * 2048 / 128000 << wdp);
+
+	return (end > sim_stats.cycles) ? end - sim_stats.cycles : 0;
+}
+
+static void
+wdt_step() {
+	if(wdt_cycles_to_event())
+		return;
+
+	wdt_start = sim_stats.cycles;
+	if(sim_reg_wdtcr & _BV(WDIE))
+		sim_reg_wdtcr |= _BV(WDIF);
+	else
+		device_reset();
+}
+
+void
+sim_wdt_reset() {
+	wdt_start = sim_stats.cycles;
+}
+
+// ----------------------------------------------------------------------------
+#pragma mark -
+#pragma mark Register Access Hooks
+
+uint8_t
+sim_read_pinb() {
+	uint8_t ret = sim_reg_portb & ~sim_reg_ddrb;	// Pulled-up inputs
+
+	ret |= sim_reg_portb & sim_reg_ddrb;			// Driven outputs
+
+	if(sim_sda_level())
+		ret |= _BV(COMM_SDA);
+	else
+		ret &= (uint8_t) ~_BV(COMM_SDA);
+
+	if(!(sim_reg_ddrb & _BV(MOIST_COLLECTOR_PIN))) {
+		if(collector_level >= 0.5)
+			ret |= _BV(MOIST_COLLECTOR_PIN);
+		else
+			ret &= (uint8_t) ~_BV(MOIST_COLLECTOR_PIN);
+	}
+
+	sim_stats.pin_polls++;
+	sim_delay_cycles(SIM_CYCLES_PIN_POLL + sim_model.poll_overhead);
+
+	return ret;
+}
+
+uint16_t
+sim_read_adc() {
+	return adc_result;
+}
+
+void
+sim_reg_write(volatile uint8_t* reg, uint8_t value) {
+	const uint8_t old_ddrb = sim_reg_ddrb;
+	const uint8_t old_portb = sim_reg_portb;
+	const uint8_t was_driven_high = drive_is_high(old_ddrb, old_portb);
+
+	if((reg == &sim_reg_gifr) || (reg == &sim_reg_tifr)) {
+		// Interrupt flags are cleared by writing a one to them. Like
+		// the real sbi instruction on these parts, this clears every
+		// flag which happened to be set.
+		*reg &= (uint8_t) ~value;
+		sim_delay_cycles(SIM_CYCLES_SBI_CBI);
+		return;
+	}
+
+	if(reg == &sim_reg_adcsra) {
+		const uint8_t busy = (sim_reg_adcsra & _BV(ADSC)) && (value & _BV(ADEN));
+
+		// ADIF is cleared by writing a one to it, and ADSC stays
+		// set until the conversion is over.
+		sim_reg_adcsra = (value & (uint8_t) ~(_BV(ADIF) | _BV(ADSC)))
+			| (sim_reg_adcsra & (uint8_t) ~value & _BV(ADIF))
+			| (busy ? _BV(ADSC) : 0);
+
+		if(!(value & _BV(ADEN))) {
+			adc_warm = 0;
+			adc_done = 0;
+		} else if(!busy && (value & _BV(ADSC))) {
+			sim_reg_adcsra |= _BV(ADSC);
+			adc_start();
+		}
+		sim_delay_cycles(SIM_CYCLES_SBI_CBI);
+		return;
+	}
+
+	*reg = value;
+
+	if((reg == &sim_reg_ddrb) || (reg == &sim_reg_portb)) {
+		moist_update(old_ddrb, old_portb, was_driven_high);
+
+		if((old_ddrb ^ sim_reg_ddrb) & _BV(COMM_SDA)) {
+			trace_change(TRACE_DRIVE, bit_is_set(sim_reg_ddrb, COMM_SDA));
+			if(sim_bus && sim_bus->slave_changed)
+				sim_bus->slave_changed(
+					bit_is_set(sim_reg_ddrb, COMM_SDA) != 0,
+					sim_stats.cycles
+				);
+		}
+		update_pins();
+	}
+
+	sim_delay_cycles(SIM_CYCLES_SBI_CBI);
+}
+
+//! Number of cycles until the next timer, ADC, watchdog or bus event.
+static uint64_t
+cycles_to_event() {
+	uint64_t next = wdt_cycles_to_event();
+	uint64_t event;
+
+	if(clk_io_running()) {
+		event = timer0_cycles_to_event();
+		if(event < next)
+			next = event;
+
+		event = timer1_cycles_to_event();
+		if(event < next)
+			next = event;
+	}
+
+	// The ADC clock keeps going in every mode but power-down.
+	if(power_state != SIM_POWER_DOWN) {
+		event = adc_cycles_to_event();
+		if(event < next)
+			next = event;
+	}
+
+	if((sim_reg_eecr & _BV(EERIE)) && (eeprom_done > sim_stats.cycles)) {
+		event = eeprom_done - sim_stats.cycles;
+		if(event < next)
+			next = event;
+	}
+
+	if(sim_bus && sim_bus->master_next_edge) {
+		event = sim_bus->master_next_edge(sim_stats.cycles);
+		if(event != UINT64_MAX && event - sim_stats.cycles < next)
+			next = event - sim_stats.cycles;
+	}
+
+	return next;
+}
+
+//!	Charges `cycles` to the current power state.
+static void
+account(uint64_t cycles) {
+	double current = sim_model.current[power_state];
+
+	if(sim_reg_adcsra & _BV(ADEN))
+		current += sim_model.adc_current;
+	if(sim_reg_wdtcr & (_BV(WDE) | _BV(WDIE)))
+		current += sim_model.wdt_current;
+
+	sim_stats.state_cycles[power_state] += cycles;
+	sim_stats.charge += current * cycles / F_CPU;
+}
+
+//!	Advances simulated time, servicing any timer and
+//!	bus events (and their interrupts) along the way.
+void
+sim_delay_cycles(uint32_t cycles) {
+	const uint64_t target = sim_stats.cycles + cycles;
+
+	dispatch_interrupts();
+
+	while(sim_stats.cycles < target) {
+		uint64_t next = cycles_to_event();
+
+		if(next > target - sim_stats.cycles)
+			next = target - sim_stats.cycles;
+
+		account(next);
+		if(clk_io_running()) {
+			timer0_step(next);
+			timer1_step(next);
+		}
+		sim_stats.cycles += next;
+
+		if(power_state != SIM_POWER_DOWN)
+			adc_step();
+		wdt_step();
+		update_pins();
+		dispatch_interrupts();
+	}
+}
+
+//!	Sleeps in the mode selected in MCUCR until an enabled interrupt
+//!	comes in, which is then serviced once we are awake again. In ADC
+//!	Noise Reduction mode the timers stop, and a conversion is started
+//!	if the ADC is enabled and idle. In power-down everything but the
+//!	watchdog and the pin change detector stops.
+void
+sim_sleep() {
+	const uint8_t sm = sim_reg_mcucr & (_BV(SM1) | _BV(SM0));
+	uint32_t wake = SIM_CYCLES_WAKE;
+
+	// Without SE, SLEEP does nothing.
+	if(!(sim_reg_mcucr & _BV(SE))) {
+		sim_delay_cycles(SIM_CYCLES_NOP);
+		return;
+	}
+
+	if(sm == _BV(SM0)) {
+		power_state = SIM_POWER_ADC;
+		if((sim_reg_adcsra & _BV(ADEN)) && !(sim_reg_adcsra & _BV(ADSC))) {
+			sim_reg_adcsra |= _BV(ADSC);
+			adc_start();
+		}
+	} else if(sm == _BV(SM1)) {
+		power_state = SIM_POWER_DOWN;
+		wake += SIM_CYCLES_STARTUP;
+	} else {
+		power_state = SIM_POWER_IDLE;
+	}
+
+	while(!interrupt_pending()) {
+		const uint64_t next = cycles_to_event();
+
+		// Nothing left that could ever wake us up.
+		if(next == UINT64_MAX)
+			break;
+
+		if(next > UINT32_MAX)
+			sim_delay_cycles(UINT32_MAX);
+		else
+			sim_delay_cycles(next ? (uint32_t)next : SIM_CYCLES_NOP);
+	}
+
+	if(interrupt_pending()) {
+		sim_stats.wakeups++;
+		wake_event = sim_stats.cycles;
+		waking = 1;
+	}
+
+	// The CPU stays halted while the clocks start up again,
+	// and only then services the interrupt.
+	power_state = SIM_POWER_IDLE;
+	sim_delay_cycles(wake);
+	power_state = SIM_POWER_ACTIVE;
+	dispatch_interrupts();
+}
+
+// ----------------------------------------------------------------------------
+#pragma mark -
+#pragma mark EEPROM
+
+#define EEPROM_WRITE_CYCLES		((uint32_t)(0.0034 * F_CPU))	//!< 3.4ms
+
+//!	Checks EEPE, which takes about as long as polling a pin.
+uint8_t
+sim_eeprom_is_ready() {
+	const uint8_t ready = sim_stats.cycles >= eeprom_done;
+
+	sim_delay_cycles(SIM_CYCLES_PIN_POLL);
+	return ready;
+}
+
+void
+sim_eeprom_busy_wait() {
+	if(sim_stats.cycles < eeprom_done)
+		sim_delay_cycles((uint32_t)(eeprom_done - sim_stats.cycles));
+}
+
+//!	Starts programming a byte, once the last one is done.
+void
+sim_eeprom_program() {
+	sim_eeprom_busy_wait();
+	eeprom_done = sim_stats.cycles + EEPROM_WRITE_CYCLES;
+	sim_delay_cycles(SIM_CYCLES_SBI_CBI);
+}
+
+void
+eeprom_read_block(void* dst, const void* src, size_t n) {
+	uint8_t* d = dst;
+	const uint8_t* s = src;
+
+	sim_eeprom_busy_wait();
+	while(n--)
+		*d++ = *s++;
+}
+
+void
+eeprom_write_block(const void* src, void* dst, size_t n) {
+	uint8_t* d = dst;
+	const uint8_t* s = src;
+
+	while(n--)
+		eeprom_write_byte(d++, *s++);
+}
+
+void
+eeprom_update_block(const void* src, void* dst, size_t n) {
+	uint8_t* d = dst;
+	const uint8_t* s = src;
+
+	while(n--)
+		eeprom_update_byte(d++, *s++);
+}
+
+// ----------------------------------------------------------------------------
+#pragma mark -
+#pragma mark Reset
+
+void
+sim_reset() {
+	memset(&sim_stats, 0, sizeof(sim_stats));
+	sim_reg_ddrb = 0;
+	sim_reg_portb = 0;
+	sim_reg_adcsra = 0;
+	sim_reg_mcusr = 0;
+	sim_reg_gifr = 0;
+	sim_reg_tifr = 0;
+	sim_reg_tccr0a = 0;
+	sim_reg_tccr0b = 0;
+	sim_reg_tcnt0 = 0;
+	sim_reg_tccr1 = 0;
+	sim_reg_tcnt1 = 0;
+	sim_reg_gtccr = 0;
+	sim_reg_timsk = 0;
+	sim_interrupts_enabled = 0;
+	timer0_residue = 0;
+#if defined(__AVR_ATtiny25__)
+	timer1_residue = 0;
+#endif
+	last_sda_level = 1;
+	collector_level = 0;
+	charge_ratio = 0;
+	oc1b_level = 0;
+	adc_warm = 0;
+	adc_done = 0;
+	sim_reg_mcucr = 0;
+	sim_reg_wdtcr = 0;
+	power_state = SIM_POWER_ACTIVE;
+	waking = 0;
+	wdt_start = 0;
+	sim_reg_eecr = 0;
+	eeprom_done = 0;
+	srand(1);
+}
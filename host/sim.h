@@ -0,0 +1,202 @@
+/*	@title Host Simulation Layer
+**
+**	Simulated I/O registers, pins and analog front-end that let main.c
+**	be compiled and exercised on a development host. Every register
+**	access made through the shim headers in host/include is routed
+**	through here so that the sensing circuit can be modeled and an
+**	estimate of the AVR cycle count can be kept.
+**
+**	@legal
+**	This package is free software; you can redistribute it and/or
+**	modify it under the terms of the GNU General Public License
+**	version 2 as published by the Free Software Foundation.
+**
+**	This package is distributed in the hope that it will be useful,
+**	but WITHOUT ANY WARRANTY; without even the implied warranty of
+**	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+**	General Public License for more details.
+**	@endlegal
+*/
+
+#ifndef __SIM_H__
+#define __SIM_H__
+
+#include <setjmp.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// ----------------------------------------------------------------------------
+#pragma mark Estimated Instruction Costs
+
+#define SIM_CYCLES_SBI_CBI			(2)		//!< sbi/cbi on low I/O space
+#define SIM_CYCLES_PIN_POLL			(3)		//!< sbic/sbis plus the loop branch
+#define SIM_CYCLES_NOP				(1)
+#define SIM_CYCLES_ISR				(20)	//!< Vectoring, prologue, epilogue, reti
+#define SIM_CYCLES_WAKE				(6)		//!< Wake-up from idle sleep
+#define SIM_CYCLES_STARTUP			(6)		//!< Extra oscillator start-up after power-down
+
+#define SIM_ADC_CLOCKS_FIRST		(25)	//!< First conversion after ADEN
+#define SIM_ADC_CLOCKS				(13)
+
+// ----------------------------------------------------------------------------
+#pragma mark -
+#pragma mark Simulated Registers
+
+extern volatile uint8_t sim_reg_ddrb;
+extern volatile uint8_t sim_reg_portb;
+extern volatile uint8_t sim_reg_admux;
+extern volatile uint8_t sim_reg_adcsra;
+extern volatile uint8_t sim_reg_adcsrb;
+extern volatile uint8_t sim_reg_acsr;
+extern volatile uint8_t sim_reg_didr0;
+extern volatile uint8_t sim_reg_mcucr;
+extern volatile uint8_t sim_reg_mcusr;
+extern volatile uint8_t sim_reg_gimsk;
+extern volatile uint8_t sim_reg_gifr;
+extern volatile uint8_t sim_reg_pcmsk;
+extern volatile uint8_t sim_reg_timsk;
+extern volatile uint8_t sim_reg_tifr;
+extern volatile uint8_t sim_reg_tccr0a;
+extern volatile uint8_t sim_reg_tccr0b;
+extern volatile uint8_t sim_reg_tcnt0;
+extern volatile uint8_t sim_reg_ocr0a;
+extern volatile uint8_t sim_reg_ocr0b;
+extern volatile uint8_t sim_reg_tccr1;
+extern volatile uint8_t sim_reg_tcnt1;
+extern volatile uint8_t sim_reg_ocr1a;
+extern volatile uint8_t sim_reg_ocr1b;
+extern volatile uint8_t sim_reg_ocr1c;
+extern volatile uint8_t sim_reg_gtccr;
+extern volatile uint8_t sim_reg_wdtcr;
+extern volatile uint8_t sim_reg_usicr;
+extern volatile uint8_t sim_reg_usisr;
+extern volatile uint8_t sim_reg_usidr;
+extern volatile uint8_t sim_reg_usibr;
+extern volatile uint8_t sim_reg_eecr;
+
+extern volatile uint8_t sim_interrupts_enabled;
+
+// ----------------------------------------------------------------------------
+#pragma mark -
+#pragma mark Register Access Hooks
+
+extern uint8_t sim_read_pinb(void);
+extern uint16_t sim_read_adc(void);
+extern void sim_reg_write(volatile uint8_t* reg, uint8_t value);
+extern void sim_delay_cycles(uint32_t cycles);
+extern void sim_sleep(void);
+extern void sim_wdt_reset(void);
+extern uint8_t sim_eeprom_is_ready(void);
+extern void sim_eeprom_busy_wait(void);
+extern void sim_eeprom_program(void);
+
+// ----------------------------------------------------------------------------
+#pragma mark -
+#pragma mark Model Parameters
+
+enum sim_power_t {
+	SIM_POWER_ACTIVE,
+	SIM_POWER_IDLE,
+	SIM_POWER_ADC,				//!< ADC Noise Reduction sleep
+	SIM_POWER_DOWN,
+
+	SIM_POWER_STATES
+};
+
+struct sim_model_t {
+	//! Number of drive pulses needed to charge the collector
+	//! to the pin threshold (Vcc/2) in a single measurement.
+	double	moist_pulses;
+
+	//! Peak-to-peak random variation applied to `moist_pulses`
+	//! at the start of every measurement, in pulses.
+	double	moist_noise;
+
+	double	vcc;			//!< Supply voltage, in volts.
+	double	temp_c;			//!< Die temperature, in degrees C.
+
+	//! Extra cycles charged to every read of PINB, to account for the
+	//! bookkeeping of the loop it sits in. Raising this gives more
+	//! pessimistic (safer) bus timing figures.
+	uint8_t	poll_overhead;
+
+	//! Supply current in each power state, in µA. The ADC and the
+	//! watchdog add their own current on top whenever they are enabled.
+	double	current[SIM_POWER_STATES];
+	double	adc_current;
+	double	wdt_current;
+};
+
+extern struct sim_model_t sim_model;
+
+// ----------------------------------------------------------------------------
+#pragma mark -
+#pragma mark Bus Master
+
+//!	Callbacks describing what the rest of the bus is doing.
+struct sim_bus_t {
+	//! Returns zero if the master is pulling SDA low at `cycle`.
+	uint8_t (*master_level)(uint64_t cycle);
+
+	//! Returns the first cycle after `cycle` at which the master
+	//! changes the level of SDA, or UINT64_MAX if it never does.
+	uint64_t (*master_next_edge)(uint64_t cycle);
+
+	//! Called whenever the device starts or stops pulling SDA low.
+	void (*slave_changed)(uint8_t pulling_low, uint64_t cycle);
+};
+
+//! Set to attach a bus master. When NULL, SDA simply idles high.
+extern const struct sim_bus_t* sim_bus;
+
+//! If set, a reset of the simulated device (such as the timer
+//! overflow used to detect reset pulses) will longjmp() here.
+extern jmp_buf* sim_reset_jmp;
+
+extern uint8_t sim_sda_level(void);
+
+//!	Writes the level of SDA, and whether the device is pulling it low,
+//!	to `file` as a VCD trace from here on, with timestamps counted from
+//!	the last sim_reset(). The trace can be decoded with host/bus-trace.
+//!	NULL stops tracing. The file is left open.
+extern void sim_trace_start(FILE* file);
+
+// ----------------------------------------------------------------------------
+#pragma mark -
+#pragma mark Statistics
+
+struct sim_stats_t {
+	uint64_t	cycles;				//!< Estimated AVR cycles elapsed
+	uint32_t	moist_pulses;		//!< Drive pulses into the sense capacitor
+	uint32_t	moist_samples;		//!< Capacitance measurements started
+	uint32_t	pin_polls;			//!< Reads of PINB
+	uint32_t	adc_conversions;	//!< Completed ADC conversions
+	uint32_t	interrupts;			//!< Interrupt service routines run
+	uint32_t	resets;				//!< Device resets (bad interrupt, etc.)
+	uint64_t	state_cycles[SIM_POWER_STATES];	//!< Cycles spent in each power state
+	double		charge;				//!< Supply charge drawn, in µC
+	uint32_t	wakeups;			//!< Sleeps ended by an interrupt
+	uint32_t	wake_latency;		//!< Most cycles from a waking event to its ISR
+};
+
+extern struct sim_stats_t sim_stats;
+
+extern void sim_reset(void);
+
+//!	Polling loops on registers other than PINB, whose reads cost
+//!	nothing by themselves, still have to let time pass.
+extern uint64_t sim_poll_cycles;
+
+static inline void
+sim_poll_begin(void) {
+	sim_poll_cycles = sim_stats.cycles;
+}
+
+static inline int
+sim_poll_end(int again) {
+	if(sim_stats.cycles == sim_poll_cycles)
+		sim_delay_cycles(SIM_CYCLES_PIN_POLL);
+	return again;
+}
+
+#endif // __SIM_H__
@@ -28,6 +28,7 @@
 #include <avr/wdt.h>
 #include <avr/cpufunc.h>
 #include <avr/sleep.h>
+#include <avr/pgmspace.h>
 
 #include <util/delay.h>
 #include <util/crc16.h>
@@ -37,7 +38,13 @@
 
 // TEMPORARY DEVELOPMENT OVERRIDE OF PHYSICAL BUS PROTOCOL.
 // THIS MUST BE REMOVED BEFORE THE PROJECT IS OFFICIALLY RELEASED.
+#ifndef COMM_PHY_PROTO
 #define COMM_PHY_PROTO			COMM_PHY_1WIRE
+#endif
+
+#ifndef HOST_BUILD
+#define HOST_BUILD				(0)		//!< Set when building for host/.
+#endif
 
 #ifndef FIRMWARE_VERSION
 #define FIRMWARE_VERSION		(0)
@@ -55,6 +62,10 @@
 #define COMM_SCK				(2)		//!< PB2
 #endif
 
+#ifndef COMM_2WIRE_ADDR
+#define COMM_2WIRE_ADDR			(0x20)	//!< 7-bit 2-Wire slave address
+#endif
+
 #define COMM_PHY_FxB			(1)		//!< Fox-Bus™
 #define COMM_PHY_1WIRE			(2)		//!< 1-Wire® Compatible (DO NOT USE)
 #define COMM_PHY_2WIRE			(3)		//!< 2-Wire (SCK/SDA)
@@ -75,6 +86,21 @@
 #define MOIST_FULLY_DRIVE_PULSES    (1)
 #endif
 
+#define MOIST_ENGINE_LOOP			(1)		//!< Pulses from a software loop
+#define MOIST_ENGINE_TIMER			(2)		//!< Pulses from Timer1 on OC1B
+
+#ifndef MOIST_ENGINE
+#define MOIST_ENGINE				MOIST_ENGINE_LOOP
+#endif
+
+#ifndef MOIST_TIMER_PERIOD
+#define MOIST_TIMER_PERIOD			(16)	//!< Cycles between timer pulses, see moist_calc()
+#endif
+
+#ifndef MOIST_TIMER_PULSE
+#define MOIST_TIMER_PULSE			(2)		//!< Cycles the drive pin is high for
+#endif
+
 #ifndef SUPPORT_DEVICE_NAMING
 #define SUPPORT_DEVICE_NAMING		(0)		//!< Not yet implemented.
 #endif
@@ -99,6 +125,10 @@
 #define USE_WATCHDOG				!DEVICE_IS_SPACE_CONSTRAINED
 #endif
 
+#ifndef USE_IDLE_SLEEP
+#define USE_IDLE_SLEEP				(1)		//!< Sleep between bus transactions.
+#endif
+
 #ifndef SUPPORT_VOLT_READING
 #define SUPPORT_VOLT_READING		!DEVICE_IS_SPACE_CONSTRAINED
 #endif
@@ -107,18 +137,121 @@
 #define SUPPORT_TEMP_READING		!DEVICE_IS_SPACE_CONSTRAINED
 #endif
 
+#ifndef USE_ADC_ISR
+#define USE_ADC_ISR					(SUPPORT_TEMP_READING && !DEVICE_IS_SPACE_CONSTRAINED)
+#endif
+
 #ifndef EMULATE_DS18B20
 #define EMULATE_DS18B20				!DEVICE_IS_SPACE_CONSTRAINED
 #endif
 
-#ifndef DO_MEDIAN_FILTERING
-#define DO_MEDIAN_FILTERING			!DEVICE_IS_SPACE_CONSTRAINED
+#ifndef DO_FILTERING
+#define DO_FILTERING				!DEVICE_IS_SPACE_CONSTRAINED
+#endif
+
+// The per-sample filters and the moving average each keep state in
+// SRAM that the 128 bytes of the ATtiny25 can't spare. Without them,
+// CALIB_FILTER still selects between the mean and the median of
+// three readings.
+#ifndef SUPPORT_FILTER_MEDIAN
+#define SUPPORT_FILTER_MEDIAN		(DO_FILTERING && (RAMEND >= 0x15F))
+#endif
+
+#ifndef SUPPORT_FILTER_TRIMMED_MEAN
+#define SUPPORT_FILTER_TRIMMED_MEAN	(DO_FILTERING && (RAMEND >= 0x15F))
+#endif
+
+#ifndef SUPPORT_FILTER_EWMA
+#define SUPPORT_FILTER_EWMA			(DO_FILTERING && (RAMEND >= 0x15F))
 #endif
 
 #ifndef DO_CALIBRATION
 #define DO_CALIBRATION				!DEVICE_IS_SPACE_CONSTRAINED
 #endif
 
+#ifndef SUPPORT_CALIB_TABLE
+#define SUPPORT_CALIB_TABLE			(DO_CALIBRATION && !DEVICE_IS_SPACE_CONSTRAINED)
+#endif
+
+#ifndef CALIB_TABLE_POINTS
+#define CALIB_TABLE_POINTS			(5)		//!< Breakpoints in the calibration table
+#endif
+
+#ifndef SUPPORT_TEMP_COMPENSATION
+#define SUPPORT_TEMP_COMPENSATION	(SUPPORT_TEMP_READING && DO_CALIBRATION)
+#endif
+
+#ifndef SUPPORT_RD_VALUES
+#define SUPPORT_RD_VALUES			!DEVICE_IS_SPACE_CONSTRAINED
+#endif
+
+#ifndef SUPPORT_CHANGE_ALARM
+#define SUPPORT_CHANGE_ALARM		!DEVICE_IS_SPACE_CONSTRAINED
+#endif
+
+#ifndef SUPPORT_CONVERT_SELECT
+#define SUPPORT_CONVERT_SELECT		!DEVICE_IS_SPACE_CONSTRAINED	//!< Honor CONVERT's input select mask
+#endif
+
+#ifndef SUPPORT_ADAPTIVE_OVERSAMPLE
+#define SUPPORT_ADAPTIVE_OVERSAMPLE	!DEVICE_IS_SPACE_CONSTRAINED
+#endif
+
+#ifndef ADAPTIVE_MIN_EXPONENT
+#define ADAPTIVE_MIN_EXPONENT		(2)		//!< Always take at least 4 samples.
+#endif
+
+#ifndef ADAPTIVE_MAX_DEVIATION
+#define ADAPTIVE_MAX_DEVIATION		(127)	//!< Pulses from the first sample
+#endif
+
+#ifndef USE_ISR_SLAVE
+#define USE_ISR_SLAVE				(0)		//!< Handle the bus from interrupts.
+#endif
+
+#ifndef SUPPORT_AUTO_CONVERT
+#define SUPPORT_AUTO_CONVERT		!DEVICE_IS_SPACE_CONSTRAINED
+#endif
+
+#ifndef AUTO_CONVERT_INTERVAL
+#define AUTO_CONVERT_INTERVAL		(8)		//!< Seconds between background conversions.
+#endif
+
+#ifndef SUPPORT_OVERDRIVE
+#define SUPPORT_OVERDRIVE			(!DEVICE_IS_SPACE_CONSTRAINED && !USE_ISR_SLAVE)
+#endif
+
+// The 128 bytes of the ATtiny25 are needed for the stack.
+#ifndef SUPPORT_HISTORY
+#define SUPPORT_HISTORY				(!DEVICE_IS_SPACE_CONSTRAINED && SUPPORT_AUTO_CONVERT && (RAMEND >= 0x15F))
+#endif
+
+#ifndef HISTORY_LEN
+#define HISTORY_LEN					(4)		//!< Records kept in SRAM
+#endif
+
+#ifndef HISTORY_EEPROM_LEN
+#define HISTORY_EEPROM_LEN			(0)		//!< Older records kept in EEPROM
+#endif
+
+#ifndef HISTORY_INTERVAL
+#define HISTORY_INTERVAL			(8)		//!< Background conversions per record
+#endif
+
+#ifndef SUPPORT_CFG_JOURNAL
+#define SUPPORT_CFG_JOURNAL			!DEVICE_IS_SPACE_CONSTRAINED
+#endif
+
+#ifndef CFG_JOURNAL_LEN
+#define CFG_JOURNAL_LEN				(3)		//!< Records COMMITMEM takes turns writing
+#endif
+
+// Keeps the CRCs of what the blocking slave reads out in SRAM, so that
+// they aren't worked out in between slots. Takes 10 bytes.
+#ifndef USE_RESPONSE_CACHE
+#define USE_RESPONSE_CACHE			!DEVICE_IS_SPACE_CONSTRAINED
+#endif
+
 // ----------------------------------------------------------------------------
 #pragma mark -
 #pragma mark Helper Macros
@@ -131,8 +264,18 @@
 #define TIMSK0 TIMSK
 #endif
 
+#if !defined(WDIE) && defined(WDTIE)
+#define WDIE WDTIE
+#endif
+
+// The host build supplies its own versions of these, which
+// let the simulator observe every pin change.
+#ifndef sbi
 #define sbi(x, y)		x |= (uint8_t)(1 << y)		//!< Set bit
+#endif
+#ifndef cbi
 #define cbi(x, y)		x &= (uint8_t) ~(1 << y)	//!< Clear bit
+#endif
 
 #define ATTR_NO_INIT   __attribute__ ((section(".noinit")))
 
@@ -147,8 +290,23 @@
 #define TEMP_RESOLUTION_MASK                (0x7)
 #define OVERSAMPLE_COUNT_EXPONENT_MASK      (0xF)
 
+#define FILTER_MODE_MASK					(0x03)
+#define FILTER_MODE_MEAN					(0)
+#define FILTER_MODE_MEDIAN					(1)
+#define FILTER_MODE_TRIMMED_MEAN			(2)
+#define FILTER_MODE_MEDIAN_OF_READINGS		(3)
+#define FILTER_PARAM_MASK					(0x0C)
+#define FILTER_PARAM_SHIFT					(2)
+#define FILTER_EWMA_MASK					(0x70)
+#define FILTER_EWMA_SHIFT					(4)
+
+#define FILTER_MEDIAN_LEVELS				(3)		//!< Medians of up to 27 samples
+#define FILTER_MAX_TRIM						(4)
+
 #define CFG_FLAG_ALARM						(1<<7)
 #define CFG_FLAG_ERROR						(1<<6)
+#define CFG_FLAG_AUTO_CONVERT				(1<<5)
+#define CFG_FLAG_CHANGED					(1<<4)
 
 typedef uint8_t bool;
 #define true (bool)(1)
@@ -160,9 +318,125 @@ typedef uint8_t bool;
 
 #if COMM_PHY_PROTO == COMM_PHY_1WIRE
 #define OWSLAVE_T_X					(30)	//!< General 1-Wire® delay period
+#define OWSLAVE_T_X_OD				(3)		//!< Overdrive sample/hold period
+#define OWSLAVE_T_PDH_OD			(2)		//!< Overdrive presence delay
+#define OWSLAVE_T_PDL_OD			(10)	//!< Overdrive presence pulse width
+#define OWSLAVE_T_RSTL_OD			(24)	//!< Overdrive reset pulse threshold
+#define OWSLAVE_OD_LOOP_CYCLES		(6l)	//!< Cycles per pass of comm_wait_idle_od()
+#endif
+
+// Overdrive speed is only defined for 1-Wire®.
+#if SUPPORT_OVERDRIVE && (COMM_PHY_PROTO != COMM_PHY_1WIRE)
+#undef SUPPORT_OVERDRIVE
+#define SUPPORT_OVERDRIVE			(0)
+#endif
+
+// The 2-Wire registers already read out in one go, without CRCs.
+#if SUPPORT_RD_VALUES && (COMM_PHY_PROTO == COMM_PHY_2WIRE)
+#undef SUPPORT_RD_VALUES
+#define SUPPORT_RD_VALUES			(0)
+#endif
+
+// There is no ALARM SEARCH on 2-Wire.
+#if SUPPORT_CHANGE_ALARM && (COMM_PHY_PROTO == COMM_PHY_2WIRE)
+#undef SUPPORT_CHANGE_ALARM
+#define SUPPORT_CHANGE_ALARM		(0)
+#endif
+
+// Nor a way to read out more than the registers.
+#if SUPPORT_HISTORY && (COMM_PHY_PROTO == COMM_PHY_2WIRE)
+#undef SUPPORT_HISTORY
+#define SUPPORT_HISTORY				(0)
+#endif
+
+#if (SUPPORT_FILTER_MEDIAN || SUPPORT_FILTER_TRIMMED_MEAN || SUPPORT_FILTER_EWMA) && !DO_FILTERING
+#error SUPPORT_FILTER_MEDIAN, SUPPORT_FILTER_TRIMMED_MEAN and SUPPORT_FILTER_EWMA require DO_FILTERING
+#endif
+
+#if SUPPORT_HISTORY
+#if !SUPPORT_AUTO_CONVERT
+#error SUPPORT_HISTORY requires SUPPORT_AUTO_CONVERT
+#endif
+#if (HISTORY_LEN < 1) || (HISTORY_LEN > 127) || (HISTORY_EEPROM_LEN > 127)
+#error HISTORY_LEN must be 1-127, and HISTORY_EEPROM_LEN 0-127
+#endif
+#if HISTORY_EEPROM_LEN && USE_ISR_SLAVE
+#error HISTORY_EEPROM_LEN cannot be read out from interrupts, see comm_rom
+#endif
+#endif
+
+#if SUPPORT_CFG_JOURNAL && ((CFG_JOURNAL_LEN < 2) || (CFG_JOURNAL_LEN > 127))
+#error CFG_JOURNAL_LEN must be between 2 and 127
+#endif
+
+#if USE_ISR_SLAVE
+#if COMM_PHY_PROTO != COMM_PHY_1WIRE
+#error USE_ISR_SLAVE is only implemented for 1-Wire®
+#endif
+#if SUPPORT_OVERDRIVE
+#error USE_ISR_SLAVE cannot keep up with overdrive speed
+#endif
+#if !SUPPORT_CONVERT_INDICATOR
+#error USE_ISR_SLAVE requires SUPPORT_CONVERT_INDICATOR
+#endif
+#endif
+
+#if (COMM_PHY_PROTO == COMM_PHY_2WIRE) && !defined(USICR)
+#error COMM_PHY_2WIRE requires a device with a USI
+#endif
+
+// The 2-Wire PHY is always interrupt-driven, see USI_OVF_vect.
+#define COMM_IS_INTERRUPT_DRIVEN	(USE_ISR_SLAVE || (COMM_PHY_PROTO == COMM_PHY_2WIRE))
+
+// The interrupt-driven slaves don't hold anything up working out
+// CRCs as they go.
+#if USE_RESPONSE_CACHE && COMM_IS_INTERRUPT_DRIVEN
+#undef USE_RESPONSE_CACHE
+#define USE_RESPONSE_CACHE			(0)
+#endif
+
+#if SUPPORT_AUTO_CONVERT && !defined(TCCR1)
+#error SUPPORT_AUTO_CONVERT requires Timer/Counter1
+#endif
+
+#if MOIST_ENGINE == MOIST_ENGINE_TIMER
+#if !defined(TCCR1)
+#error MOIST_ENGINE_TIMER requires Timer/Counter1
+#endif
+#if MOIST_DRIVE_PIN != 4
+#error MOIST_ENGINE_TIMER requires MOIST_DRIVE_PIN to be OC1B (PB4)
+#endif
+#if (MOIST_TIMER_PERIOD > 256) || (MOIST_TIMER_PULSE >= MOIST_TIMER_PERIOD)
+#error MOIST_TIMER_PERIOD or MOIST_TIMER_PULSE is out of range
+#endif
 #endif
 
+#if USE_ADC_ISR && !SUPPORT_TEMP_READING
+#error USE_ADC_ISR requires SUPPORT_TEMP_READING
+#endif
+
+#if SUPPORT_TEMP_COMPENSATION && !(SUPPORT_TEMP_READING && DO_CALIBRATION)
+#error SUPPORT_TEMP_COMPENSATION requires SUPPORT_TEMP_READING and DO_CALIBRATION
+#endif
+
+#if SUPPORT_CALIB_TABLE && ((CALIB_TABLE_POINTS < 2) || (CALIB_TABLE_POINTS > 9))
+#error CALIB_TABLE_POINTS must be between 2 and 9
+#endif
+
+// ADC conversions, at a prescaler of 1/128, it takes to cover about a
+// millisecond: how long the bandgap reference is given to settle.
+#define ADC_SETTLE_CONVERSIONS		(uint8_t)(((uint32_t)F_CPU / 1000 + 128l * 13 - 1) / (128l * 13))
+
+// Timer1 overflows per background conversion, at a prescaler of 1/16384.
+#define AUTO_CONVERT_TICKS			(uint8_t)((uint32_t)AUTO_CONVERT_INTERVAL * F_CPU / (16384l * 256l))
+
+// Set when values could be read, or a conversion given up on, while a
+// conversion is in progress. Conversions are then made into `value_next`
+// and copied over `value` all at once when they are done.
+#define USE_VALUE_SHADOW			(SUPPORT_AUTO_CONVERT || COMM_IS_INTERRUPT_DRIVEN)
+
 #define COMM_FxB_READ_THRESHOLD		(10)
+#define COMM_FxB_T_BUSY				(5)		//!< Hold time of the busy '0', see TIM0_COMPA_vect
 
 //!	Device Type Codes
 enum {
@@ -177,6 +451,10 @@ enum {
 	COMM_ROMCMD_SKIP=0xCC,           // 11001100b
 	COMM_ROMCMD_SEARCH=0xF0,         // 11110000b
 	COMM_ROMCMD_ALARM_SEARCH=0xEC,   // 11101100b
+#if SUPPORT_OVERDRIVE
+	COMM_ROMCMD_OD_SKIP=0x3C,        // 00111100b
+	COMM_ROMCMD_OD_MATCH=0x69,       // 01101001b
+#endif
 };
 
 //!	Function Commands
@@ -188,6 +466,8 @@ enum {
 	COMM_FUNCCMD_RECALL_MEM=0xB8,
 	COMM_FUNCCMD_CONVERT_T=0x44,
 	COMM_FUNCCMD_RD_SCRATCH=0xBE,
+	COMM_FUNCCMD_RD_VALUES=0xA0,
+	COMM_FUNCCMD_RD_HISTORY=0xA1,
 
 #if SUPPORT_DEVICE_NAMING
 	COMM_FUNCCMD_RD_NAME=0xF1,
@@ -195,6 +475,24 @@ enum {
 #endif
 };
 
+//!	CONVERT Input Select Mask
+//!	As on the DS2450, one bit for each of the 16-bit values in page 0.
+//!	A mask of zero selects everything.
+#define CONVERT_MOISTURE			(3<<0)	// MOISTURE and RAW
+#define CONVERT_TEMP				(1<<2)
+#define CONVERT_VOLT				(1<<3)
+#define CONVERT_ALL					(CONVERT_MOISTURE|CONVERT_TEMP|CONVERT_VOLT)
+
+//!	2-Wire Registers
+enum {
+	COMM_REG_MEM=0x00,               // Memory pages, 0x00-0x17
+	COMM_REG_ROM=0x18,               // ROM ID, 0x18-0x1F
+	COMM_REG_CMD=0x20,               // Function command/status
+#if SUPPORT_CONVERT_SELECT
+	COMM_REG_CONVERT=0x21,           // CONVERT input select mask
+#endif
+};
+
 typedef union {
 	struct {
 		uint8_t type;
@@ -209,7 +507,7 @@ typedef union {
 #pragma mark Memory Page Layout
 
 // Page 1 - Values
-struct {
+struct value_t {
 	uint16_t	moisture;
 	uint16_t	raw;
 	int16_t		temp;
@@ -222,7 +520,19 @@ struct cfg_t {
 	uint8_t	alarm_high;
 
 	uint8_t	flags;
-	uint8_t	reserved[4];
+
+	//! Change alarm thresholds, zero to disable. The moisture
+	//! threshold is in the units of ALARM_LOW and ALARM_HIGH,
+	//! the temperature threshold in 1/16ths of a degree C.
+	uint8_t	delta_moisture;
+	uint8_t	delta_temp;
+
+	//! log2 of the number of samples the last conversion took
+	//! per reading, which can be less than the oversample
+	//! exponent when adaptive oversampling stopped early.
+	uint8_t	oversample;
+
+	uint8_t	reserved[1];
 
 	uint8_t firmware_version;
 } cfg ATTR_NO_INIT;
@@ -234,16 +544,158 @@ struct calib_t {
 	uint8_t flags;
 	int8_t	temp_offset;
 
-	uint8_t reserved[4];
+	//! Adaptive oversampling target for the standard error of the
+	//! mean sample, in 1/16ths of a pulse. Zero always takes every
+	//! sample.
+	uint8_t	precision;
+
+	//! Filter applied to the samples of each reading, see
+	//! FILTER_MODE_MASK, FILTER_PARAM_MASK and FILTER_EWMA_MASK.
+	uint8_t	filter;
+
+	uint8_t reserved[2];
 
 } calib ATTR_NO_INIT;
 
 #if SUPPORT_CONVERT_INDICATOR
+#if HOST_BUILD
+volatile uint8_t was_interrupted;
+#else
 register uint8_t was_interrupted __asm__("r3");
 #endif
+#endif
 
 bool convert_error_occured ATTR_NO_INIT;
 
+#if SUPPORT_ADAPTIVE_OVERSAMPLE
+uint8_t convert_oversample ATTR_NO_INIT;
+#endif
+
+#if USE_ADC_ISR
+//!	ADC Jobs, see adc_step().
+enum {
+	ADC_JOB_NONE,
+	ADC_JOB_VOLT,
+	ADC_JOB_VOLT_TEMP,	//!< Voltage, then temperature
+	ADC_JOB_TEMP,
+};
+
+volatile uint8_t adc_job;
+volatile bool adc_paused;		//!< Set while moisture pulses are counted
+volatile uint8_t adc_discard;	//!< Conversions to throw away first
+volatile uint16_t adc_count;	//!< Conversions left to add to adc_sum
+volatile uint32_t adc_sum;
+#endif
+
+#if SUPPORT_FILTER_MEDIAN || SUPPORT_FILTER_TRIMMED_MEAN
+//!	State of the filter for the reading in progress, see filter_sample().
+union {
+#if SUPPORT_FILTER_MEDIAN
+	//! A median of three at every level, each feeding the next.
+	struct {
+		uint16_t	pending[FILTER_MEDIAN_LEVELS][2];
+		uint8_t		count[FILTER_MEDIAN_LEVELS];
+		uint16_t	last;		//!< Latest median of three samples
+		bool		have_last;
+	} median;
+#endif
+
+#if SUPPORT_FILTER_TRIMMED_MEAN
+	//! The most extreme samples seen so far.
+	struct {
+		uint16_t	low[FILTER_MAX_TRIM];	//!< Lowest first
+		uint16_t	high[FILTER_MAX_TRIM];	//!< Highest first
+	} trim;
+#endif
+} filter_state ATTR_NO_INIT;
+#endif
+
+#if SUPPORT_FILTER_EWMA
+uint32_t filter_ewma ATTR_NO_INIT;			//!< Moving average, in 1/256ths
+uint8_t filter_ewma_exponent ATTR_NO_INIT;	//!< Exponent it was started at plus one, or zero.
+#endif
+
+#if SUPPORT_CALIB_TABLE
+//!	Breakpoint of the calibration table, see calib_table_eeprom.
+struct calib_point_t {
+	uint16_t	raw;		//!< Mean sample, in 1/256ths of a pulse
+	uint16_t	moisture;
+};
+
+uint8_t calib_points ATTR_NO_INIT;		//!< Breakpoints in use, see calib_prepare()
+#endif
+
+#if USE_VALUE_SHADOW
+struct value_t value_next;
+#else
+#define value_next value
+#endif
+
+#if SUPPORT_CHANGE_ALARM
+// The last values the master read out. See ack_values().
+uint16_t ack_moisture;
+#if SUPPORT_TEMP_READING
+int16_t ack_temp;
+#endif
+#endif
+
+#if SUPPORT_AUTO_CONVERT
+volatile uint8_t auto_convert_ticks;	//!< Timer1 overflows since the last conversion.
+#if !COMM_IS_INTERRUPT_DRIVEN
+volatile uint8_t auto_convert_quiet;	//!< Timer1 overflows since the last bus edge.
+#endif
+#endif
+
+#if SUPPORT_HISTORY
+#define HISTORY_RECORD_LEN			(3)		//!< MOISTURE, then TEMPERATURE in whole °C
+
+// Kept across reset pulses, and started over by a hard reset.
+uint8_t history[HISTORY_LEN][HISTORY_RECORD_LEN] ATTR_NO_INIT;
+uint8_t history_head ATTR_NO_INIT;		//!< Where the next record goes
+uint8_t history_count ATTR_NO_INIT;
+#if HISTORY_EEPROM_LEN
+uint8_t history_eeprom_head ATTR_NO_INIT;
+uint8_t history_eeprom_count ATTR_NO_INIT;
+#endif
+uint16_t history_seq ATTR_NO_INIT;		//!< Records made since the hard reset
+uint8_t history_ticks ATTR_NO_INIT;		//!< Background conversions since the last record
+#endif
+
+#if SUPPORT_OVERDRIVE
+// Survives the soft reset caused by a reset pulse, so that we
+// can tell an overdrive reset from a standard-speed one.
+bool comm_overdrive ATTR_NO_INIT;
+#endif
+
+#if SUPPORT_CFG_JOURNAL
+//!	SEQUENCE, then the configuration and calibration pages, then
+//!	the CRC of all of that.
+#define CFG_RECORD_LEN				(2 + sizeof(struct cfg_t) + sizeof(struct calib_t))
+
+uint8_t cfg_journal_slot ATTR_NO_INIT;	//!< Record the next commit goes to
+uint8_t cfg_journal_seq ATTR_NO_INIT;	//!< SEQUENCE of the next commit
+volatile uint8_t cfg_commit_left ATTR_NO_INIT;	//!< Bytes of the commit still to write
+uint8_t cfg_commit_crc ATTR_NO_INIT;
+#endif
+
+#if COMM_IS_INTERRUPT_DRIVEN
+//!	Copy of comm_addr, loaded by do_recall(). Reading the EEPROM from
+//!	an interrupt would clobber any EEPROM access the main context might
+//!	be in the middle of.
+comm_addr_t comm_rom ATTR_NO_INIT;
+#endif
+
+#if USE_RESPONSE_CACHE
+//!	CRCs of what RD_MEM, RD_VALUES and RD_SCRATCH send, see comm_prepare_crcs().
+struct {
+	uint16_t	rd_mem[3];	//!< From address 0x00 or 0x08, then page 1 following page 0
+	uint16_t	rd_values;
+	uint8_t		rd_scratch;
+} comm_crc ATTR_NO_INIT;
+
+bool comm_crc_valid ATTR_NO_INIT;	//!< Cleared whenever the pages change
+#endif
+
 // ----------------------------------------------------------------------------
 #pragma mark -
 #pragma mark EEPROM Layout
@@ -265,17 +717,57 @@ struct calib_t calib_eeprom EEMEM = {
 	.offset			= 0x11,
 	.flags			= 0x06,
 	.temp_offset	= 0x00,
+	.filter			= FILTER_MODE_MEDIAN_OF_READINGS,
+};
+
+#if SUPPORT_CALIB_TABLE
+//!	Piecewise-linear calibration, in order of increasing raw value.
+//!	The table ends at the first breakpoint that isn't above the one
+//!	before it, so an erased table falls back to CALIB_RAW_OFFSET and
+//!	CALIB_RAW_RANGE. Not in the memory map; it is loaded along with
+//!	the calibration page, see calib_prepare().
+struct calib_point_t calib_table_eeprom[CALIB_TABLE_POINTS] EEMEM = {
+	[0 ... CALIB_TABLE_POINTS-1] = { 0xFFFF, 0xFFFF }
 };
+#endif
 
 #if SUPPORT_DEVICE_NAMING
 char device_name[16] EEMEM = "";
 #endif
 
+#if SUPPORT_CFG_JOURNAL
+//!	Where COMMITMEM puts the configuration and calibration pages,
+//!	a record at a time in turn, so that every commit goes to a record
+//!	other than the latest good one. cfg_eeprom and calib_eeprom are
+//!	only used until the first commit. See do_recall().
+uint8_t cfg_journal[CFG_JOURNAL_LEN][CFG_RECORD_LEN] EEMEM = {
+	[0 ... CFG_JOURNAL_LEN-1] = { [0 ... CFG_RECORD_LEN-1] = 0xFF }
+};
+#endif
+
+#if SUPPORT_HISTORY && HISTORY_EEPROM_LEN
+//!	Records pushed out of the SRAM history. Only the
+//!	bookkeeping is in SRAM, so this starts over at power-up too.
+uint8_t history_eeprom[HISTORY_EEPROM_LEN][HISTORY_RECORD_LEN] EEMEM;
+#endif
+
+#if SUPPORT_TEMP_COMPENSATION
+// ----------------------------------------------------------------------------
+#pragma mark -
+#pragma mark Flash Tables
+
+#include "temp-comp.h"
+
+//!	Moisture gain every 2^TEMP_COMP_STEP_SHIFT 1/16ths of a degree from
+//!	TEMP_COMP_MIN, in 1/TEMP_COMP_ONE. Generated by gen-temp-comp.sh.
+static const uint16_t temp_comp_table[TEMP_COMP_POINTS] PROGMEM = TEMP_COMP_TABLE;
+#endif
+
 // ----------------------------------------------------------------------------
 #pragma mark -
 #pragma mark Misc. Helper Functions
 
-#if DO_MEDIAN_FILTERING
+#if DO_FILTERING
 static uint16_t
 median_uint16(
 	uint16_t a, uint16_t b, uint16_t c
@@ -299,9 +791,19 @@ median_uint16(
 #pragma mark -
 #pragma mark Other
 
-#if SUPPORT_CONVERT_INDICATOR
+#if SUPPORT_CONVERT_INDICATOR && !COMM_IS_INTERRUPT_DRIVEN
 static void
 comm_begin_busy() {
+#if SUPPORT_OVERDRIVE
+	// Overdrive slots are too short for the interrupt-driven
+	// busy indicator, so the master has to wait it out. Overdrive
+	// transfers also leave interrupts off, so turn them back on
+	// so that we can still be reset while we are busy.
+	if(comm_overdrive) {
+		sei();
+		return;
+	}
+#endif
 	sbi(TIMSK0, OCIE0A);
 }
 
@@ -311,95 +813,201 @@ comm_end_busy() {
 	cbi(TIMSK0, OCIE0A);
 }
 #else
+#if SUPPORT_OVERDRIVE
+// Overdrive transfers leave interrupts off, see comm_begin_busy() above.
+#define comm_begin_busy()    sei()
+#else
 #define comm_begin_busy()    do {} while(0)
+#endif
 #define comm_end_busy()  do {} while(0)
 #endif
 
+#if COMM_PHY_PROTO != COMM_PHY_2WIRE
 static uint8_t
 get_alarm_condition() {
-	return (cfg.flags&(CFG_FLAG_ALARM|CFG_FLAG_ERROR))!=0;
+	return (cfg.flags&(CFG_FLAG_ALARM|CFG_FLAG_ERROR|CFG_FLAG_CHANGED))!=0;
 }
+#endif
 
-// This is the general capacitance-reading function.
-static uint16_t
-moist_calc() {
-	uint16_t v;
-
-#if SUPPORT_CONVERT_INDICATOR
-again:
+#if SUPPORT_VOLT_READING
+static void
+adc_select_volt() {
+#if defined(__AVR_ATtiny13__) || defined (__AVR_ATtiny13A__)
+	// Vref=Vcc, Input=PORTB2
+	ADMUX = _BV(MUX0);
+	cbi(DDRB, 2);
+	sbi(PORTB, 2);
+#else
+	// Vref=Vcc, Input=Vbg
+	ADMUX = _BV(MUX3) | _BV(MUX2);
 #endif
+}
+#endif // SUPPORT_VOLT_READING
 
-	// Make sure pins are configured.
-	cbi(PORTB, MOIST_DRIVE_PIN);
-	cbi(PORTB, MOIST_COLLECTOR_PIN);
-	sbi(DDRB, MOIST_DRIVE_PIN);
-	sbi(DDRB, MOIST_COLLECTOR_PIN);
+#if SUPPORT_TEMP_READING
+static void
+adc_select_temp() {
+	ADMUX = _BV(REFS1) | _BV(MUX3) | _BV(MUX2) | _BV(MUX1) | _BV(MUX0);
+}
 
-	// Wait long enough for the sensing capacitor to fully flush.
-	_delay_ms(2);
+//!	Turns the sum of the temperature sensor readings, less 270
+//!	apiece, into the TEMPERATURE value.
+static void
+temp_finish(int32_t temp) {
+	temp >>= (cfg.flags&TEMP_RESOLUTION_MASK);
 
-#if SUPPORT_CONVERT_INDICATOR
-	was_interrupted = 0;
-#else
-	cli();
+	temp += calib.temp_offset*2;
+
+#if SUPPORT_VOLT_READING
+	// Adjust for changes in voltage.
+	temp += TEMP_VOLT_COMP_NUMERATOR/value_next.voltage - TEMP_VOLT_COMP_OFFSET;
 #endif
 
-	cbi(DDRB, MOIST_DRIVE_PIN);
-	cbi(DDRB, MOIST_COLLECTOR_PIN);
+	value_next.temp = temp;
+}
+#endif // SUPPORT_TEMP_READING
 
-	for(v = 0;
-	        (v != MOIST_MAX_VALUE) &&
-	    bit_is_clear(PINB, MOIST_COLLECTOR_PIN);
-	    v++
-	) {
-		// Change the pin state to HIGH.
-		sbi(PORTB, MOIST_DRIVE_PIN);
+#if USE_ADC_ISR || USE_IDLE_SLEEP
+//!	Returns true if nothing needs the I/O clock, which stops in
+//!	ADC Noise Reduction sleep and power-down.
+static bool
+clk_io_is_idle() {
+#if COMM_PHY_PROTO == COMM_PHY_2WIRE
+	// The USI can't wake us up in the middle of a byte.
+	return bit_is_clear(USICR, USIOIE);
+#else
+	// Timer0 is timing a bus slot or a reset pulse.
+	return !TCCR0B;
+#endif
+}
+#endif
 
-		// Change the output direction to output.
-		sbi(DDRB, MOIST_DRIVE_PIN);
+#if USE_ADC_ISR
+// The ADC measures the voltage and then the temperature in the background,
+// one conversion per interrupt, while the moisture is sampled. The pulses
+// are counted with the ADC paused, and whatever is left is finished off
+// in ADC Noise Reduction sleep.
 
-		// Change the output direction back to input (Hi-Z).
-		cbi(DDRB, MOIST_DRIVE_PIN);
+static void
+adc_begin_temp() {
+	adc_select_temp();
+	adc_job = ADC_JOB_TEMP;
+	adc_discard = 1;	// The first reading after switching references is off.
+	adc_count = 1 << (4 + (cfg.flags&TEMP_RESOLUTION_MASK));
+	adc_sum = 0;
+}
 
-		// Change the pin state back to LOW.
-		// If we don't do this, then the built-in pull-up will
-		// still be enabled and throw off our readings.
-		cbi(PORTB, MOIST_DRIVE_PIN);
+//!	Takes care of the conversion which just finished, and starts the
+//!	next one unless the job is done or the ADC is paused.
+static void
+adc_step() {
+	if(adc_discard) {
+		adc_discard--;
+	} else {
+		adc_sum += ADC;
+		if(!--adc_count) {
+#if SUPPORT_VOLT_READING
+			if(adc_job != ADC_JOB_TEMP)
+				value_next.voltage = adc_sum;
+			if(adc_job == ADC_JOB_VOLT_TEMP) {
+				adc_begin_temp();
+			} else
+#endif
+			{
+				adc_job = ADC_JOB_NONE;
+				return;
+			}
+		}
+	}
 
-#if SUPPORT_CONVERT_INDICATOR
-		if(was_interrupted)
-			goto again;
+	if(!adc_paused)
+		sbi(ADCSRA, ADSC);
+}
 
-		_NOP();
-#else
-		_delay_us(1);
+static void
+adc_start(uint8_t channels) {
+	adc_paused = false;
+
+#if SUPPORT_VOLT_READING
+	if(channels & CONVERT_VOLT) {
+		adc_select_volt();
+		adc_job = (channels & CONVERT_TEMP) ? ADC_JOB_VOLT_TEMP : ADC_JOB_VOLT;
+		adc_discard = ADC_SETTLE_CONVERSIONS;
+		adc_count = 1;
+		adc_sum = 0;
+	} else
 #endif
+	if(channels & CONVERT_TEMP) {
+		adc_begin_temp();
+	} else {
+		adc_job = ADC_JOB_NONE;
+		return;
 	}
 
-	// Turn interrupts back on.
-#if !SUPPORT_CONVERT_INDICATOR
-	sei();
+	// These also clear any stale ADIF.
+#if SUPPORT_OVERDRIVE
+	// The interrupt would add to our response time, which overdrive
+	// can't afford, so adc_finish() polls for the results instead.
+	if(comm_overdrive)
+		cbi(ADCSRA, ADIE);
+	else
 #endif
+		sbi(ADCSRA, ADIE);
 
-	// Pull both lines low to avoid floating inputs
-	sbi(DDRB, MOIST_DRIVE_PIN);
-	sbi(DDRB, MOIST_COLLECTOR_PIN);
+	sbi(ADCSRA, ADSC);
+}
 
-	return v;
+//!	Stops starting new conversions, and waits for the one in progress
+//!	so that its interrupt can't land in the middle of the pulse count.
+static void
+adc_pause() {
+	adc_paused = true;
+	loop_until_bit_is_clear(ADCSRA, ADSC);
+}
+
+static void
+adc_resume() {
+	adc_paused = false;
+	if(adc_job && bit_is_set(ADCSRA, ADIE) && bit_is_clear(ADCSRA, ADSC))
+		sbi(ADCSRA, ADSC);
+}
+
+static void
+adc_finish(uint8_t channels) {
+	set_sleep_mode(SLEEP_MODE_ADC);
+
+	while(adc_job) {
+		if(bit_is_clear(ADCSRA, ADIE)) {
+			loop_until_bit_is_set(ADCSRA, ADIF);
+			sbi(ADCSRA, ADIF);
+			adc_step();
+			continue;
+		}
+
+		cli();
+		if(adc_job && clk_io_is_idle()) {
+			sleep_enable();
+			sei();
+			sleep_cpu();
+			sleep_disable();
+		}
+		sei();
+	}
+
+	set_sleep_mode(SLEEP_MODE_IDLE);
+	cbi(ADCSRA, ADIE);
+
+	if(channels & CONVERT_TEMP)
+		temp_finish(
+			(int32_t)adc_sum - ((int32_t)270 << (4 + (cfg.flags&TEMP_RESOLUTION_MASK)))
+		);
 }
+#else // USE_ADC_ISR
 
 #if SUPPORT_VOLT_READING
 static void
 convert_volt() {
-#if defined(__AVR_ATtiny13__) || defined (__AVR_ATtiny13A__)
-	// Vref=Vcc, Input=PORTB2
-	ADMUX = _BV(MUX0);
-	cbi(DDRB, 2);
-	sbi(PORTB, 2);
-#else
-	// Vref=Vcc, Input=Vbg
-	ADMUX = _BV(MUX3) | _BV(MUX2);
-#endif
+	adc_select_volt();
 
 	// Throw away the first reading.
 	sbi(ADCSRA, ADSC);
@@ -410,7 +1018,7 @@ convert_volt() {
 	sbi(ADCSRA, ADSC);
 	loop_until_bit_is_clear(ADCSRA, ADSC);
 
-	value.voltage = ADC;
+	value_next.voltage = ADC;
 }
 #endif // SUPPORT_VOLT_READING
 
@@ -419,7 +1027,7 @@ static void
 convert_temp() {
 	int32_t temp = 0;
 
-	ADMUX = _BV(REFS1) | _BV(MUX3) | _BV(MUX2) | _BV(MUX1) | _BV(MUX0);
+	adc_select_temp();
 
 	// Throw away the first reading.
 	sbi(ADCSRA, ADSC);
@@ -431,19 +1039,433 @@ convert_temp() {
 		temp += ADC - 270;
 	}
 
-	temp >>= (cfg.flags&TEMP_RESOLUTION_MASK);
+	temp_finish(temp);
+}
+#endif // SUPPORT_TEMP_READING
 
-	temp += calib.temp_offset*2;
+#endif // USE_ADC_ISR
 
-#if SUPPORT_VOLT_READING
-	// Adjust for changes in voltage.
-	temp += TEMP_VOLT_COMP_NUMERATOR/value.voltage - TEMP_VOLT_COMP_OFFSET;
+// This is the general capacitance-reading function.
+static uint16_t
+moist_calc() {
+	uint16_t v;
+
+#if MOIST_ENGINE == MOIST_ENGINE_TIMER
+	// Timer1 normally paces background conversions, so borrow it
+	// without letting the pulses count as ticks and put it back after.
+	const uint8_t tccr1 = TCCR1;
+	const uint8_t tcnt1 = TCNT1;
+	const uint8_t toie1 = TIMSK & _BV(TOIE1);
+
+	cbi(TIMSK, TOIE1);
+	OCR1C = MOIST_TIMER_PERIOD - 1;
+	OCR1B = MOIST_TIMER_PULSE;
+	TCCR1 = _BV(CS10);
+#endif
+
+#if SUPPORT_CONVERT_INDICATOR
+again:
+#endif
+
+	// Make sure pins are configured.
+	cbi(PORTB, MOIST_DRIVE_PIN);
+	cbi(PORTB, MOIST_COLLECTOR_PIN);
+	sbi(DDRB, MOIST_DRIVE_PIN);
+	sbi(DDRB, MOIST_COLLECTOR_PIN);
+
+	// Wait long enough for the sensing capacitor to fully flush.
+	_delay_ms(2);
+
+#if USE_ADC_ISR
+	adc_pause();
+#endif
+
+#if SUPPORT_CONVERT_INDICATOR
+	was_interrupted = 0;
+#else
+	cli();
+#endif
+
+#if MOIST_ENGINE == MOIST_ENGINE_TIMER
+	// OC1B now drives the pin high at the start of every timer period
+	// and low again MOIST_TIMER_PULSE cycles later. Unlike the loop
+	// below, the drive pin is held low between pulses instead of being
+	// left floating, so the two engines need their own calibration.
+	TCNT1 = 0;
+	GTCCR = _BV(PWM1B) | _BV(COM1B1);
+	sbi(TIFR, TOV1);
+	cbi(DDRB, MOIST_COLLECTOR_PIN);
+
+	// Every pulse also sets TOV1, so the count doesn't depend on how
+	// long a pass of this loop takes, as long as it is under a period.
+	for(v = 0; bit_is_clear(PINB, MOIST_COLLECTOR_PIN);) {
+		if(bit_is_set(TIFR, TOV1)) {
+			sbi(TIFR, TOV1);
+			if(++v == MOIST_MAX_VALUE)
+				break;
+		}
+
+#if SUPPORT_CONVERT_INDICATOR
+		if(was_interrupted) {
+			GTCCR = 0;
+			goto again;
+		}
+#endif
+	}
+
+	// The pulse which tripped the collector may not be counted yet.
+	if(bit_is_set(TIFR, TOV1) && (v != MOIST_MAX_VALUE))
+		v++;
+
+	GTCCR = 0;
+#else
+	cbi(DDRB, MOIST_DRIVE_PIN);
+	cbi(DDRB, MOIST_COLLECTOR_PIN);
+
+	for(v = 0;
+	        (v != MOIST_MAX_VALUE) &&
+	    bit_is_clear(PINB, MOIST_COLLECTOR_PIN);
+	    v++
+	) {
+		// Change the pin state to HIGH.
+		sbi(PORTB, MOIST_DRIVE_PIN);
+
+		// Change the output direction to output.
+		sbi(DDRB, MOIST_DRIVE_PIN);
+
+		// Change the output direction back to input (Hi-Z).
+		cbi(DDRB, MOIST_DRIVE_PIN);
+
+		// Change the pin state back to LOW.
+		// If we don't do this, then the built-in pull-up will
+		// still be enabled and throw off our readings.
+		cbi(PORTB, MOIST_DRIVE_PIN);
+
+#if SUPPORT_CONVERT_INDICATOR
+		if(was_interrupted)
+			goto again;
+
+		_NOP();
+#else
+		_delay_us(1);
+#endif
+	}
+#endif // MOIST_ENGINE
+
+	// Turn interrupts back on.
+#if !SUPPORT_CONVERT_INDICATOR
+	sei();
+#endif
+
+#if USE_ADC_ISR
+	adc_resume();
+#endif
+
+	// Pull both lines low to avoid floating inputs
+	sbi(DDRB, MOIST_DRIVE_PIN);
+	sbi(DDRB, MOIST_COLLECTOR_PIN);
+
+#if MOIST_ENGINE == MOIST_ENGINE_TIMER
+	TCCR1 = tccr1;
+	TCNT1 = tcnt1;
+	sbi(TIFR, TOV1);
+	if(toie1)
+		sbi(TIMSK, TOIE1);
+#endif
+
+	return v;
+}
+
+#if SUPPORT_ADAPTIVE_OVERSAMPLE
+//!	Returns true once the standard error of the mean of the `1<<k`
+//!	samples taken so far is within `calib.precision`. The samples are
+//!	given as deviations `d` from the first, summed and squared-summed.
+static bool
+samples_are_precise(int32_t sum_d, uint32_t sum_d2, uint8_t k) {
+	uint32_t var;
+	const uint32_t a = (sum_d < 0) ? -sum_d : sum_d;
+
+	// Keep the square of the sum in 32 bits.
+	if(a > 0xFFFF)
+		return false;
+
+	// n times the variance of the samples...
+	var = sum_d2 - ((a * a) >> k);
+
+	// ...and from that the variance of the mean, in 1/256ths of a pulse².
+	if(k >= 4)
+		var >>= 2 * k - 8;
+	else
+		var <<= 8 - 2 * k;
+
+	return var <= (uint16_t)calib.precision * calib.precision;
+}
+#endif
+
+#if SUPPORT_FILTER_MEDIAN || SUPPORT_FILTER_TRIMMED_MEAN
+static uint8_t
+filter_param() {
+	return (calib.filter & FILTER_PARAM_MASK) >> FILTER_PARAM_SHIFT;
+}
 #endif
 
-	value.temp = temp;
+#if SUPPORT_FILTER_MEDIAN
+static uint8_t
+filter_median_levels() {
+	const uint8_t levels = filter_param() + 1;
+
+	return (levels > FILTER_MEDIAN_LEVELS) ? FILTER_MEDIAN_LEVELS : levels;
+}
+#endif
+
+#if DO_FILTERING
+static void
+filter_begin() {
+#if SUPPORT_FILTER_MEDIAN
+	if((calib.filter & FILTER_MODE_MASK) == FILTER_MODE_MEDIAN) {
+		for(uint8_t i = 0; i != FILTER_MEDIAN_LEVELS; i++)
+			filter_state.median.count[i] = 0;
+		filter_state.median.have_last = false;
+	}
+#endif
+
+#if SUPPORT_FILTER_TRIMMED_MEAN
+	if((calib.filter & FILTER_MODE_MASK) == FILTER_MODE_TRIMMED_MEAN) {
+		for(uint8_t i = 0; i != FILTER_MAX_TRIM; i++) {
+			filter_state.trim.low[i] = 0xFFFF;
+			filter_state.trim.high[i] = 0;
+		}
+	}
+#endif
+}
+
+//!	Feeds a sample to the filter, returning what it adds to the reading.
+//!	Nothing needs to be kept for more than a few samples, however many
+//!	samples the reading takes. Modes left out of the build take the mean.
+static uint32_t
+filter_sample(uint16_t v) {
+#if SUPPORT_FILTER_MEDIAN || SUPPORT_FILTER_TRIMMED_MEAN
+	const uint8_t mode = calib.filter & FILTER_MODE_MASK;
+#endif
+
+#if SUPPORT_FILTER_MEDIAN
+	if(mode == FILTER_MODE_MEDIAN) {
+		// Median of 3, 9 or 27 samples, as a median of three
+		// medians of three, and so on (a remedian).
+		const uint8_t levels = filter_median_levels();
+		uint16_t weight = 1;
+
+		for(uint8_t level = 0; level != levels; level++) {
+			uint8_t* const count = &filter_state.median.count[level];
+
+			if(*count != 2) {
+				filter_state.median.pending[level][(*count)++] = v;
+				return 0;
+			}
+			*count = 0;
+			v = median_uint16(
+				filter_state.median.pending[level][0],
+				filter_state.median.pending[level][1],
+				v
+			);
+			if(!level) {
+				filter_state.median.last = v;
+				filter_state.median.have_last = true;
+			}
+			weight *= 3;
+		}
+
+		// The median stands in for every sample it was taken from.
+		return (uint32_t)v * weight;
+	}
+#endif
+
+#if SUPPORT_FILTER_TRIMMED_MEAN
+	if(mode == FILTER_MODE_TRIMMED_MEAN) {
+		const uint8_t t = filter_param() + 1;
+		uint16_t x = v;
+
+		// Insert into both sorted lists, dropping whatever falls off the end.
+		for(uint8_t i = 0; i != t; i++) {
+			if(x < filter_state.trim.low[i]) {
+				const uint16_t tmp = filter_state.trim.low[i];
+				filter_state.trim.low[i] = x;
+				x = tmp;
+			}
+		}
+		x = v;
+		for(uint8_t i = 0; i != t; i++) {
+			if(x > filter_state.trim.high[i]) {
+				const uint16_t tmp = filter_state.trim.high[i];
+				filter_state.trim.high[i] = x;
+				x = tmp;
+			}
+		}
+	}
+#endif
+
+	return v;
+}
+
+//!	Finishes a reading of `1<<k` samples which added up to `total`,
+//!	scaling it up to what `1<<exponent` samples would have added up to.
+static uint32_t
+filter_end(uint32_t total, uint8_t k, uint8_t exponent) {
+#if SUPPORT_FILTER_MEDIAN || SUPPORT_FILTER_TRIMMED_MEAN
+	const uint8_t mode = calib.filter & FILTER_MODE_MASK;
+#endif
+
+#if SUPPORT_FILTER_MEDIAN
+	if(mode == FILTER_MODE_MEDIAN) {
+		// Medians still waiting to be combined count as they are. Any
+		// samples left over are replaced by the latest median of three,
+		// so that an outlier right at the end doesn't get through.
+		const uint8_t levels = filter_median_levels();
+		uint16_t weight = 1;
+
+		for(uint8_t level = 0; level != levels; level++) {
+			for(uint8_t i = 0; i != filter_state.median.count[level]; i++) {
+				uint16_t v = filter_state.median.pending[level][i];
+
+				if(!level && filter_state.median.have_last)
+					v = filter_state.median.last;
+				total += (uint32_t)v * weight;
+			}
+			weight *= 3;
+		}
+	}
+#endif
+
+#if SUPPORT_FILTER_TRIMMED_MEAN
+	if(mode == FILTER_MODE_TRIMMED_MEAN) {
+		const uint8_t t = filter_param() + 1;
+		const uint16_t n = (uint16_t)1 << k;
+
+		if(n > 2 * t) {
+			for(uint8_t i = 0; i != t; i++)
+				total -= (uint32_t)filter_state.trim.low[i] + filter_state.trim.high[i];
+			return (total << exponent) / (n - 2 * t);
+		}
+	}
+#endif
+
+	return total << (exponent - k);
+}
+#endif
+
+#if SUPPORT_FILTER_EWMA
+//!	Blends a reading into a moving average that carries over from
+//!	one conversion to the next, if turned on in `calib.filter`.
+static uint16_t
+filter_smooth(uint16_t x) {
+	const uint8_t shift = (calib.filter & FILTER_EWMA_MASK) >> FILTER_EWMA_SHIFT;
+	const uint8_t exponent = (calib.flags & OVERSAMPLE_COUNT_EXPONENT_MASK) + 1;
+	const uint32_t target = (uint32_t)x << 8;
+
+	if(!shift || convert_error_occured)
+		return x;
+
+	if(filter_ewma_exponent != exponent) {
+		// First reading since a hard reset, or the units changed.
+		filter_ewma_exponent = exponent;
+		filter_ewma = target;
+	} else if(target > filter_ewma) {
+		filter_ewma += (target - filter_ewma) >> shift;
+	} else {
+		filter_ewma -= (filter_ewma - target) >> shift;
+	}
+
+	return (filter_ewma + 0x80) >> 8;
 }
 #endif
 
+#if SUPPORT_ADAPTIVE_OVERSAMPLE || DO_FILTERING
+static uint16_t
+read_moisture() {
+	const uint8_t exponent = calib.flags&OVERSAMPLE_COUNT_EXPONENT_MASK;
+	uint32_t total = 0;
+	uint8_t k = exponent;	// log2 of the samples taken, once done
+
+#if SUPPORT_ADAPTIVE_OVERSAMPLE
+	uint16_t first = 0;
+	int32_t sum_d = 0;
+	uint32_t sum_d2 = 0;
+	bool adaptive = calib.precision && (exponent > ADAPTIVE_MIN_EXPONENT);
+
+	k = ADAPTIVE_MIN_EXPONENT;
+#endif
+
+#if DO_FILTERING
+	filter_begin();
+#endif
+
+	for(uint16_t i = 1; ; i++) {
+		const uint16_t sample = moist_calc();
+
+#if DO_FILTERING
+		total += filter_sample(sample);
+#else
+		total += sample;
+#endif
+		if(total > 0xFFFF) {
+			total = 0xFFFF;
+			goto bail;
+		}
+
+		if(i == ((uint16_t)1 << exponent)) {
+			k = exponent;
+			break;
+		}
+
+#if SUPPORT_ADAPTIVE_OVERSAMPLE
+		if(!adaptive)
+			continue;
+
+		if(i == 1) {
+			first = sample;
+		} else {
+			const int16_t d = sample - first;
+
+			// Samples this far apart are never going to settle
+			// early, so just take all of them.
+			if((d > ADAPTIVE_MAX_DEVIATION) || (d < -ADAPTIVE_MAX_DEVIATION)) {
+				adaptive = false;
+				continue;
+			}
+			sum_d += d;
+			sum_d2 += (uint16_t)(d * d);
+		}
+
+		if(i == ((uint16_t)1 << k)) {
+			if(samples_are_precise(sum_d, sum_d2, k))
+				break;
+			k++;
+		}
+#endif
+	}
+
+#if SUPPORT_ADAPTIVE_OVERSAMPLE
+	if(k > convert_oversample)
+		convert_oversample = k;
+#endif
+
+#if DO_FILTERING
+	total = filter_end(total, k, exponent);
+#else
+	// Scale up to what all of the samples would have added up to.
+	total <<= exponent - k;
+#endif
+	if(total > 0xFFFF)
+		total = 0xFFFF;
+
+bail:
+
+	if(!total || (total==0xFFFF))
+		convert_error_occured = 1;
+
+	return total;
+}
+#else
 static uint16_t
 read_moisture() {
 	uint16_t ret = 0;
@@ -464,33 +1486,149 @@ bail:
 
 	return ret;
 }
+#endif
 
+#if SUPPORT_CALIB_TABLE
+//!	Fetches breakpoint `i`. Without a table, CALIB_RAW_OFFSET and
+//!	CALIB_RAW_RANGE make up a single segment spanning the full scale,
+//!	which ends at 1<<16 so that every step of CALIBRATED_BITS is the
+//!	same size.
 static void
-convert_moisture() {
-	uint16_t value_a = 0;
+calib_point(
+	uint8_t i, uint32_t* raw, uint32_t* moisture
+) {
+	if(calib_points) {
+		*raw = eeprom_read_word(&calib_table_eeprom[i].raw);
+		*moisture = eeprom_read_word(&calib_table_eeprom[i].moisture);
+	} else {
+		*raw = (uint32_t)(calib.offset + (i ? calib.range : 0)) << 8;
+		*moisture = i ? ((uint32_t)1 << 16) : 0;
+	}
+}
 
-	value_a = read_moisture();
+//!	Counts the breakpoints of the table, if there is one. Called
+//!	whenever the calibration is recalled or committed.
+static void
+calib_prepare() {
+	calib_points = 1;
+	while(calib_points != CALIB_TABLE_POINTS) {
+		const uint16_t raw = eeprom_read_word(&calib_table_eeprom[calib_points].raw);
+		if((raw == 0xFFFF)
+		    || (raw <= eeprom_read_word(&calib_table_eeprom[calib_points-1].raw))
+		)
+			break;
+		calib_points++;
+	}
 
-#if DO_MEDIAN_FILTERING
-	{
-		uint16_t value_b;
-		uint16_t value_c;
+	if(calib_points < 2)
+		calib_points = 0;
+}
 
-		_delay_ms(3);
+//!	Maps the mean sample `raw`, in 1/256ths of a pulse, to a moisture
+//!	value by interpolating between the breakpoints on either side.
+static uint16_t
+calib_apply(uint32_t raw) {
+	const uint8_t last = (calib_points ? calib_points : 2) - 1;
+	uint32_t raw_a, raw_b;
+	uint32_t moist_a, moist_b;
+	uint8_t i = 0;
 
-		value_b = read_moisture();
+	calib_point(0, &raw_a, &moist_a);
+	if(raw <= raw_a)
+		return moist_a;
 
-		_delay_ms(3);
+	for(;;) {
+		calib_point(i + 1, &raw_b, &moist_b);
+		if(raw < raw_b)
+			break;
+		if(++i == last)
+			return (moist_b > MOIST_MAX_VALUE) ? MOIST_MAX_VALUE : moist_b;
+		raw_a = raw_b;
+		moist_a = moist_b;
+	}
+
+	// raw - raw_a < raw_b - raw_a < 1<<16, and the moisture changes by
+	// at most 1<<16, so this can't overflow. Nor can the result, since
+	// it falls short of moist_b.
+	raw -= raw_a;
+	raw_b -= raw_a;
+	if(moist_b < moist_a)
+		return moist_a - (raw * (moist_a - moist_b)) / raw_b;
+	return moist_a + (raw * (moist_b - moist_a)) / raw_b;
+}
+#endif
+
+#if SUPPORT_TEMP_COMPENSATION
+//!	Scales `moisture` by the gain for the temperature just read,
+//!	interpolated between the two nearest entries of temp_comp_table,
+//!	and rounds it down to CALIBRATED_BITS.
+static uint16_t
+temp_compensate(uint16_t moisture) {
+	const int16_t temp_max = TEMP_COMP_MIN*16 + ((TEMP_COMP_POINTS - 1) << TEMP_COMP_STEP_SHIFT);
+	uint16_t temp;
+	uint32_t gain;
+
+	if(value_next.temp <= TEMP_COMP_MIN*16)
+		temp = 0;
+	else
+		temp = value_next.temp - TEMP_COMP_MIN*16;
+
+	if(value_next.temp >= temp_max) {
+		gain = pgm_read_word(&temp_comp_table[TEMP_COMP_POINTS - 1]);
+	} else {
+		const uint8_t i = temp >> TEMP_COMP_STEP_SHIFT;
+		const uint16_t gain_a = pgm_read_word(&temp_comp_table[i]);
+		const uint16_t gain_b = pgm_read_word(&temp_comp_table[i + 1]);
+		const uint8_t frac = temp & ((1 << TEMP_COMP_STEP_SHIFT) - 1);
+
+		gain = gain_a;
+		if(gain_b > gain_a)
+			gain += ((uint32_t)(gain_b - gain_a) * frac) >> TEMP_COMP_STEP_SHIFT;
+		else
+			gain -= ((uint32_t)(gain_a - gain_b) * frac) >> TEMP_COMP_STEP_SHIFT;
+	}
+
+	gain = (gain * moisture) / TEMP_COMP_ONE;
+	if(gain > MOIST_MAX_VALUE)
+		gain = MOIST_MAX_VALUE;
+
+	return (uint16_t)gain & ~((1<<(16-CALIBRATED_BITS))-1);
+}
+#endif
+
+static void
+convert_moisture() {
+	uint16_t value_a = 0;
+
+	value_a = read_moisture();
 
-		value_c = read_moisture();
+#if DO_FILTERING
+	if((calib.filter & FILTER_MODE_MASK) == FILTER_MODE_MEDIAN_OF_READINGS) {
+		// Each reading takes the mean of its samples.
+		const uint16_t value_b = read_moisture();
+		const uint16_t value_c = read_moisture();
 
 		value_a = median_uint16(value_a, value_b, value_c);
 	}
 #endif
 
-	value.raw = value_a;
+#if SUPPORT_FILTER_EWMA
+	value_a = filter_smooth(value_a);
+#endif
+
+	value_next.raw = value_a;
+
+#if SUPPORT_CALIB_TABLE
+	// Apply calibration
+	value_a = calib_apply(
+		((uint32_t)value_a << 8) >> (calib.flags&OVERSAMPLE_COUNT_EXPONENT_MASK)
+	);
 
-#if DO_CALIBRATION
+#if !SUPPORT_TEMP_COMPENSATION
+	// Otherwise temp_compensate() does this, once the temperature is in.
+	value_a &= ~((1<<(16-CALIBRATED_BITS))-1);
+#endif
+#elif DO_CALIBRATION
 	// Apply calibration
 	{
 		uint16_t tmp = (calib.offset << (calib.flags&OVERSAMPLE_COUNT_EXPONENT_MASK));
@@ -507,83 +1645,513 @@ convert_moisture() {
 			value_a = (1<<CALIBRATED_BITS)-1;
 
 		value_a <<= 16-CALIBRATED_BITS;
+	}
+#endif
+
+	value_next.moisture = value_a;
+}
 
-		// TODO: Compensate for temperature.
+#if SUPPORT_CHANGE_ALARM
+//!	Returns true if `value_next` has moved further than the change
+//!	alarm thresholds from the values the master last read out.
+static bool
+values_have_changed() {
+	uint16_t diff;
+
+	if(cfg.delta_moisture) {
+		if(value_next.moisture > ack_moisture)
+			diff = value_next.moisture - ack_moisture;
+		else
+			diff = ack_moisture - value_next.moisture;
+		if(diff > ((uint16_t)cfg.delta_moisture << 8))
+			return true;
+	}
+
+#if SUPPORT_TEMP_READING
+	if(cfg.delta_temp) {
+		if(value_next.temp > ack_temp)
+			diff = value_next.temp - ack_temp;
+		else
+			diff = ack_temp - value_next.temp;
+		if(diff > cfg.delta_temp)
+			return true;
 	}
 #endif
 
-	value.moisture = value_a;
+	return false;
 }
 
+//!	Called once the master has read out the whole value page.
 static void
-do_convert() {
-	comm_begin_busy();
-	
+ack_values() {
+	ack_moisture = value.moisture;
+#if SUPPORT_TEMP_READING
+	ack_temp = value.temp;
+#endif
+	cfg.flags &= ~CFG_FLAG_CHANGED;
+#if USE_RESPONSE_CACHE
+	comm_crc_valid = false;
+#endif
+}
+#endif
+
+//!	Converts the values selected by `channels`, see CONVERT_ALL.
+//!	The others keep whatever they were.
+static void
+convert_values(uint8_t channels) {
+	uint8_t status = 0;
+
+#if SUPPORT_CONVERT_SELECT
+	if(!channels)
+		channels = CONVERT_ALL;
+#if SUPPORT_VOLT_READING && SUPPORT_TEMP_READING
+	// The temperature is corrected for the voltage it was taken at.
+	if(channels & CONVERT_TEMP)
+		channels |= CONVERT_VOLT;
+#endif
+#else
+	channels = CONVERT_ALL;
+#endif
+
+#if !USE_VALUE_SHADOW
 	// Clear status flags
 	cfg.flags &= ~(CFG_FLAG_ALARM|CFG_FLAG_ERROR);
 	cfg.flags |= CFG_FLAG_ERROR;
+#endif
 	convert_error_occured = false;
+#if SUPPORT_ADAPTIVE_OVERSAMPLE
+	convert_oversample = 0;
+#endif
 	
+#if USE_VALUE_SHADOW && SUPPORT_CONVERT_SELECT
+	value_next = value;
+#endif
+
 #if !DEVICE_IS_SPACE_CONSTRAINED
-	// Set all values to OxFFFF
-	uint8_t i = 7;
-	do { ((uint8_t*)&value)[i]=0xFF; } while(i--);
+	// Set the values being converted to OxFFFF
+	if(channels & CONVERT_MOISTURE) {
+		value_next.moisture = 0xFFFF;
+		value_next.raw = 0xFFFF;
+	}
+	if(channels & CONVERT_TEMP)
+		value_next.temp = (int16_t)0xFFFF;
+	if(channels & CONVERT_VOLT)
+		value_next.voltage = 0xFFFF;
 #endif
 
+#if USE_ADC_ISR
+	adc_start(channels);
+#else
 #if SUPPORT_VOLT_READING
-	convert_volt();
+	if(channels & CONVERT_VOLT)
+		convert_volt();
 #endif
 
 #if SUPPORT_TEMP_READING
-	convert_temp();
+	if(channels & CONVERT_TEMP)
+		convert_temp();
+#endif
+#endif
+
+	if(channels & CONVERT_MOISTURE)
+		convert_moisture();
+
+#if USE_ADC_ISR
+	adc_finish(channels);
 #endif
 
-	convert_moisture();
+#if SUPPORT_TEMP_COMPENSATION
+	if(channels & CONVERT_MOISTURE)
+		value_next.moisture = temp_compensate(value_next.moisture);
+#endif
 
 	{	// Calculate alarm flag.
-		uint8_t moist_h = (value.moisture>>8);
+		uint8_t moist_h = (value_next.moisture>>8);
 
 		if(	(moist_h > cfg.alarm_high) || (moist_h < cfg.alarm_low) )
-			cfg.flags |= CFG_FLAG_ALARM;
+			status |= CFG_FLAG_ALARM;
 	}
 
-	if(!convert_error_occured)
-		cfg.flags &= ~CFG_FLAG_ERROR;
+	if(convert_error_occured)
+		status |= CFG_FLAG_ERROR;
 
+#if USE_VALUE_SHADOW
+	cli();
+#endif
+#if SUPPORT_CHANGE_ALARM
+	// Compared with interrupts off, since the master
+	// might acknowledge the old values at any time.
+	if(values_have_changed())
+		status |= CFG_FLAG_CHANGED;
+#endif
+#if USE_VALUE_SHADOW
+	value = value_next;
+#endif
+	cfg.flags = (cfg.flags & ~(CFG_FLAG_ALARM|CFG_FLAG_ERROR|CFG_FLAG_CHANGED)) | status;
+#if SUPPORT_ADAPTIVE_OVERSAMPLE
+	if(channels & CONVERT_MOISTURE)
+		cfg.oversample = convert_oversample;
+#endif
+#if USE_VALUE_SHADOW
+	sei();
+#endif
+}
+
+#if SUPPORT_RD_VALUES
+#define RD_VALUES_LEN		(9)
+
+//!	Returns byte `i` of the RD_VALUES frame: the value page followed by the status flags.
+static uint8_t
+rd_values_byte(uint8_t i) {
+	return (i < 8) ? ((uint8_t*)&value)[i] : cfg.flags;
+}
+#endif
+
+#if USE_RESPONSE_CACHE
+//!	Works out the CRCs in comm_crc from the pages as they are now.
+//!	Anything that changes the pages clears comm_crc_valid, and then
+//!	either calls this once it is done or leaves it to the main loop.
+static void
+comm_prepare_crcs() {
+	const uint8_t* const pages[2] = { (const uint8_t*)&value, (const uint8_t*)&cfg };
+	uint16_t crc;
+	uint8_t i;
+
+	// Each starts with the command and the address.
+	for(i = 0; i != 2; i++) {
+		crc = _crc16_update(0, COMM_FUNCCMD_RD_MEM);
+		crc = _crc16_update(crc, i * 8);
+		crc = _crc16_update(crc, 0);
+		for(uint8_t j = 0; j != 8; j++)
+			crc = _crc16_update(crc, pages[i][j]);
+		comm_crc.rd_mem[i] = crc;
+	}
+
+	// After the CRC of page 0, the next one starts over.
+	crc = 0;
+	for(i = 0; i != 8; i++)
+		crc = _crc16_update(crc, pages[1][i]);
+	comm_crc.rd_mem[2] = crc;
+
+#if SUPPORT_RD_VALUES
+	crc = _crc16_update(0, COMM_FUNCCMD_RD_VALUES);
+	for(i = 0; i != RD_VALUES_LEN; i++)
+		crc = _crc16_update(crc, rd_values_byte(i));
+	comm_crc.rd_values = crc;
+#endif
+
+#if EMULATE_DS18B20
+	crc = 0;
+	for(i = 0; i != 8; i++)
+		crc = _crc_ibutton_update(crc, (i < 2) ? ((uint8_t*)&value.temp)[i] : 0);
+	comm_crc.rd_scratch = crc;
+#endif
+
+	comm_crc_valid = true;
+}
+#endif
+
+static void
+do_convert(uint8_t channels) {
+	comm_begin_busy();
+#if USE_RESPONSE_CACHE
+	comm_crc_valid = false;
+#endif
+	convert_values(channels);
+#if USE_RESPONSE_CACHE
+	comm_prepare_crcs();
+#endif
 	comm_end_busy();
 }
 
+#if SUPPORT_AUTO_CONVERT
+static bool
+auto_convert_is_due() {
+	return (cfg.flags & CFG_FLAG_AUTO_CONVERT)
+		&& (auto_convert_ticks >= AUTO_CONVERT_TICKS)
+#if !COMM_IS_INTERRUPT_DRIVEN
+		// The bus interrupts would only keep cutting in while
+		// the master talks to someone else.
+		&& (auto_convert_quiet >= 2)
+#endif
+		;
+}
+#endif
+
+#if SUPPORT_HISTORY
+static uint8_t
+history_total() {
+#if HISTORY_EEPROM_LEN
+	return history_eeprom_count + history_count;
+#else
+	return history_count;
+#endif
+}
+
+//!	Returns byte `i` of record `n` of the RD_HISTORY frame. Record
+//!	0 is the header (SEQ and COUNT), followed by the history from
+//!	oldest to newest.
+static uint8_t
+history_byte(uint8_t n, uint8_t i) {
+	uint8_t index;
+
+	if(n-- == 0)
+		return (i < 2) ? ((uint8_t*)&history_seq)[i] : history_total();
+
+#if HISTORY_EEPROM_LEN
+	if(n < history_eeprom_count) {
+		index = (history_eeprom_head >= history_eeprom_count)
+			? history_eeprom_head - history_eeprom_count
+			: history_eeprom_head + HISTORY_EEPROM_LEN - history_eeprom_count;
+		index += n;
+		if(index >= HISTORY_EEPROM_LEN)
+			index -= HISTORY_EEPROM_LEN;
+		return eeprom_read_byte(&history_eeprom[index][i]);
+	}
+	n -= history_eeprom_count;
+#endif
+
+	index = (history_head >= history_count)
+		? history_head - history_count
+		: history_head + HISTORY_LEN - history_count;
+	index += n;
+	if(index >= HISTORY_LEN)
+		index -= HISTORY_LEN;
+	return history[index][i];
+}
+#endif
+
+#if SUPPORT_CFG_JOURNAL
+//!	Writes the next byte of the commit in progress, if the EEPROM is
+//!	ready for it. Only bytes which differ from what the record held
+//!	before are actually written. Returns true until the commit is done.
+static bool
+cfg_commit_step() {
+	const uint8_t left = cfg_commit_left;
+	const uint8_t i = CFG_RECORD_LEN - left;
+	uint8_t byte;
+
+	if(!left)
+		return false;
+	if(!eeprom_is_ready())
+		return true;
+
+	if(i == 0) {
+		byte = cfg_journal_seq;
+		cfg_commit_crc = 0;
+	} else if(left == 1) {
+		byte = cfg_commit_crc;
+	} else {
+		byte = ((const uint8_t*)&cfg)[i - 1];
+	}
+	cfg_commit_crc = _crc_ibutton_update(cfg_commit_crc, byte);
+	eeprom_update_byte(&cfg_journal[cfg_journal_slot][i], byte);
+
+	cli();
+	// Unless the pages were written to in the meantime,
+	// which starts the commit over, see cfg_commit_restart().
+	if(cfg_commit_left == left) {
+		if(left == 1) {
+			if(++cfg_journal_slot == CFG_JOURNAL_LEN)
+				cfg_journal_slot = 0;
+			cfg_journal_seq++;
+		}
+		cfg_commit_left = left - 1;
+	}
+	sei();
+
+	return cfg_commit_left != 0;
+}
+
+#if COMM_IS_INTERRUPT_DRIVEN
+//!	Has a commit in progress start over, so that its record doesn't
+//!	end up with some pages from before a write and some from after.
+static void
+cfg_commit_restart() {
+	if(cfg_commit_left)
+		cfg_commit_left = CFG_RECORD_LEN;
+}
+#endif
+#endif
+
+//!	Loads the configuration and calibration pages. With
+//!	SUPPORT_CFG_JOURNAL, they come from the record of cfg_journal
+//!	with the latest SEQUENCE whose CRC checks out, so a commit cut
+//!	short by a reset or power loss leaves the one before it in place.
 static void
 do_recall() {
+#if SUPPORT_CFG_JOURNAL
+	uint8_t latest = CFG_JOURNAL_LEN;
+	uint8_t seq = 0;
+
+	// Finish any commit in progress first, it's the latest now.
+	while(cfg_commit_step()) { }
+
+	for(uint8_t slot = 0; slot != CFG_JOURNAL_LEN; slot++) {
+		uint8_t crc = 0;
+		uint8_t i;
+
+		// A good record has a CRC over all of it, CRC included, of zero.
+		for(i = 0; i != CFG_RECORD_LEN; i++)
+			crc = _crc_ibutton_update(crc, eeprom_read_byte(&cfg_journal[slot][i]));
+		if(crc)
+			continue;
+
+		i = eeprom_read_byte(&cfg_journal[slot][0]);
+		if((latest == CFG_JOURNAL_LEN) || ((int8_t)(i - seq) > 0)) {
+			latest = slot;
+			seq = i;
+		}
+	}
+
+	if(latest == CFG_JOURNAL_LEN) {
+		// Nothing has been committed yet.
+		cfg_journal_slot = 0;
+		cfg_journal_seq = 0;
+	} else {
+		cfg_journal_slot = latest + 1;
+		if(cfg_journal_slot == CFG_JOURNAL_LEN)
+			cfg_journal_slot = 0;
+		cfg_journal_seq = seq + 1;
+	}
+#endif
+
 	eeprom_busy_wait();
 	eeprom_read_block(
 		&cfg,
-		&cfg_eeprom,
+#if SUPPORT_CFG_JOURNAL
+		(latest != CFG_JOURNAL_LEN) ? (const void*)&cfg_journal[latest][1] :
+#endif
+		(const void*)&cfg_eeprom,
 		sizeof(cfg_eeprom) + sizeof(calib_eeprom)
 	);
 	cfg.firmware_version = FIRMWARE_VERSION;
+#if COMM_IS_INTERRUPT_DRIVEN
+	eeprom_read_block(&comm_rom, &comm_addr, sizeof(comm_rom));
+#endif
+#if SUPPORT_CALIB_TABLE
+	calib_prepare();
+#endif
+#if USE_RESPONSE_CACHE
+	comm_prepare_crcs();
+#endif
 }
 
+//!	Saves the configuration and calibration pages. With
+//!	SUPPORT_CFG_JOURNAL, the interrupt-driven slave only starts the
+//!	commit here, and the main loop writes it out in between
+//!	everything else, see cfg_commit_step().
 static void
 do_commit() {
 #if USE_WATCHDOG
 	wdt_reset();
 #endif
+#if SUPPORT_CALIB_TABLE
+	// Before the commit gets going, so that we don't
+	// have to wait on it to read the table back in.
+	calib_prepare();
+#endif
+#if SUPPORT_CFG_JOURNAL
+	cli();
+	cfg_commit_left = CFG_RECORD_LEN;
+	sei();
+#if !COMM_IS_INTERRUPT_DRIVEN
+	// ROM commands read the ROM ID straight out of the EEPROM,
+	// which they can't wait on, so we finish while still busy.
+	while(cfg_commit_step()) {
+#if USE_WATCHDOG
+		wdt_reset();
+#endif
+	}
+	eeprom_busy_wait();
+#endif
+#else
 	eeprom_update_block(
 		&cfg,
 		&cfg_eeprom,
 		sizeof(cfg_eeprom) + sizeof(calib_eeprom)
 	);
 	eeprom_busy_wait();
+#endif
+}
+
+// ----------------------------------------------------------------------------
+#pragma mark -
+#pragma mark Bus Communications Functions
+
+#if !COMM_IS_INTERRUPT_DRIVEN
+#if SUPPORT_OVERDRIVE
+static void comm_reset(void) __attribute__ ((noreturn));
+
+//!	Resets the device the same way a reset pulse does.
+static void
+comm_reset() {
+	// Let the timer overflow. There is no handler for the overflow
+	// interrupt, so __bad_interrupt takes us to address 0x0000.
+	TCNT0 = 0xFF;
+	TCCR0B = (1 << 0);
+	sei();
+	for(;;)
+		_NOP();
 }
 
-// ----------------------------------------------------------------------------
-#pragma mark -
-#pragma mark Bus Communications Functions
+static void
+comm_send_presence_od() {
+	// Going through the reset vector takes longer than the overdrive
+	// presence delay allows, so this is sent as soon as the end of
+	// the reset pulse has been seen.
+	_delay_us(OWSLAVE_T_PDH_OD);
+	sbi(DDRB, COMM_SDA);
+	_delay_us(OWSLAVE_T_PDL_OD);
+	cbi(DDRB, COMM_SDA);
+}
+
+//!	Waits for the bus to go idle at overdrive speed.
+//!	The pin-change interrupt alone takes up a good part of an overdrive
+//!	slot, so interrupts stay off for the whole of an overdrive transfer
+//!	and reset pulses are detected here instead.
+static void
+comm_wait_idle_od() {
+	uint8_t low_time = 0;
+
+	// The master may release the bus for as little as 1µs between
+	// slots, so this loop has to stay tight. Each pass takes about
+	// OWSLAVE_OD_LOOP_CYCLES cycles.
+	while(bit_is_clear(PINB, COMM_SDA)) {
+		if(++low_time == 0xFF) {
+			// Standard-speed reset pulse. Drop out of
+			// overdrive and take the usual reset path.
+			comm_overdrive = false;
+			comm_reset();
+		}
+	}
+
+	if(low_time >= (uint8_t)((uint32_t)OWSLAVE_T_RSTL_OD * F_CPU / (OWSLAVE_OD_LOOP_CYCLES * 1000000l))) {
+		comm_send_presence_od();
+		comm_reset();
+	}
+}
+#endif
 
 static uint8_t
 comm_read_bit() {
 #if COMM_PHY_PROTO == COMM_PHY_1WIRE
+#if SUPPORT_OVERDRIVE
+	if(comm_overdrive) {
+		cli();
+		comm_wait_idle_od();
+
+		// Wait for the slot to open.
+		loop_until_bit_is_clear(PINB, COMM_SDA);
+
+		// Wait until we should sample.
+		_delay_us(OWSLAVE_T_X_OD);
+
+		// Return the value of the bit.
+		return bit_is_set(PINB, COMM_SDA);
+	}
+#endif
+
 	// Wait for the bus to go idle if it is already low.
 	if(bit_is_clear(PINB, COMM_SDA))
 		loop_until_bit_is_set(PINB, COMM_SDA);
@@ -642,6 +2210,24 @@ comm_read_bit() {
 static void
 comm_write_bit(uint8_t v) {
 #if COMM_PHY_PROTO == COMM_PHY_1WIRE
+#if SUPPORT_OVERDRIVE
+	if(comm_overdrive) {
+		cli();
+		comm_wait_idle_od();
+
+		// Wait for the slot to open.
+		loop_until_bit_is_clear(PINB, COMM_SDA);
+
+		if(v == 0) {
+			// Assert our zero bit until the master has sampled it.
+			sbi(DDRB, COMM_SDA);
+			_delay_us(OWSLAVE_T_X_OD);
+			cbi(DDRB, COMM_SDA);
+		}
+		return;
+	}
+#endif
+
 	// Wait for the bus to go idle.
 	if(bit_is_clear(PINB, COMM_SDA))
 		loop_until_bit_is_set(PINB, COMM_SDA);
@@ -699,84 +2285,758 @@ comm_write_bit(uint8_t v) {
 		// Return the bus back to idle.
 		cbi(DDRB, COMM_SDA);
 
-		// Turn interrupts back on.
-		sei();
-	} else {
-		loop_until_bit_is_clear(PINB, COMM_SDA);
-		loop_until_bit_is_set(PINB, COMM_SDA);
+		// Turn interrupts back on.
+		sei();
+	} else {
+		loop_until_bit_is_clear(PINB, COMM_SDA);
+		loop_until_bit_is_set(PINB, COMM_SDA);
+	}
+#else
+#error COMM_PHY_PROTO not set properly!
+#endif
+}
+
+static inline void
+comm_send_presence() {
+#if COMM_PHY_PROTO == COMM_PHY_1WIRE
+#if SUPPORT_OVERDRIVE
+	// The overdrive presence pulse has already been
+	// sent by whoever noticed the reset pulse.
+	if(comm_overdrive)
+		return;
+#endif
+
+	// Wait for reset pulse to end.
+	while(bit_is_clear(PINB, COMM_SDA)) sleep_cpu();
+
+	// Let the bus idle for 20µSec after the end of the reset pulse.
+	_delay_us(20);
+
+	// Send the 80µSec presence pulse.
+	sbi(DDRB, COMM_SDA);
+	_delay_us(80);
+	cbi(DDRB, COMM_SDA);
+#elif COMM_PHY_PROTO == COMM_PHY_FxB
+	// Wait for reset pulse to end.
+	while(bit_is_clear(PINB, COMM_SDA)) sleep_cpu();
+
+	// Send a '0' bit for our presence.
+	comm_write_bit(0);
+#else
+#error COMM_PHY_PROTO not set properly!
+#endif
+}
+
+static uint8_t
+comm_read_byte() {
+	// We really DON'T need to initialize this. Honest.
+	uint8_t ret;
+
+	for(uint8_t i = 0; i != 8; i++) {
+		ret >>= 1;
+		if(comm_read_bit())
+			sbi(ret, 7);
+	}
+	return ret;
+}
+
+static void
+comm_write_byte(uint8_t byte) {
+	for(uint8_t i = 0; i != 8; i++) {
+		comm_write_bit(byte & 1);
+		byte >>= 1;
+	}
+}
+
+static inline uint16_t
+comm_read_word() {
+	return comm_read_byte() + (comm_read_byte() << 8);
+}
+
+static inline void
+comm_write_word(uint16_t x) {
+	comm_write_byte(x);
+	comm_write_byte(x >> 8);
+}
+
+#endif // !COMM_IS_INTERRUPT_DRIVEN
+
+// ----------------------------------------------------------------------------
+#pragma mark -
+#pragma mark Interrupt-Driven Bus Slave
+
+#if COMM_IS_INTERRUPT_DRIVEN
+volatile uint8_t comm_isr_pending;	//!< Command for the main context to run.
+#if SUPPORT_CONVERT_SELECT
+volatile uint8_t comm_isr_channels;	//!< Input select mask of the last CONVERT
+#endif
+#endif
+
+#if USE_ISR_SLAVE
+// Every slot is handled from interrupts: PCINT0_vect sees the slot
+// open and starts the timer, and the bit is decided by whichever
+// comes first of the end of the slot (PCINT0_vect again) or
+// TIM0_COMPA_vect at OWSLAVE_T_X, which is also when we let go of
+// the bus if we were sending a zero. Bits are shifted through
+// comm_isr_byte, and comm_isr_next() is called with every completed
+// byte to decide what to do next. Commands which take a while are
+// handed over to the main context, see comm_isr_service().
+
+//!	Bus Slave States
+enum {
+	COMM_ST_IDLE,			//!< Ignoring the bus until the next reset.
+	COMM_ST_RESET,			//!< Waiting for a reset pulse to end.
+	COMM_ST_BUSY,			//!< Main context is running a command.
+	COMM_ST_ROM_CMD,
+	COMM_ST_ROM_READ,
+	COMM_ST_ROM_MATCH,
+	COMM_ST_SEARCH_BIT,
+	COMM_ST_SEARCH_CMP,
+	COMM_ST_SEARCH_DIR,
+	COMM_ST_FUNC_CMD,
+	COMM_ST_MEM_ADDR,
+	COMM_ST_MEM_DATA,
+	COMM_ST_MEM_CRC,
+	COMM_ST_CONVERT_ARGS,
+#if EMULATE_DS18B20
+	COMM_ST_RD_SCRATCH,
+#endif
+#if SUPPORT_RD_VALUES
+	COMM_ST_RD_VALUES,
+#endif
+#if SUPPORT_HISTORY
+	COMM_ST_RD_HISTORY,
+#endif
+};
+
+volatile uint8_t comm_isr_state;
+
+bool comm_isr_tx;					//!< Set if we are sending comm_isr_byte.
+bool comm_isr_slot_open;
+uint8_t comm_isr_byte;				//!< Byte being sent or received.
+uint8_t comm_isr_count;				//!< Slots left in comm_isr_byte.
+uint8_t comm_isr_cmd;
+uint8_t comm_isr_index;
+uint8_t comm_isr_addr;
+uint16_t comm_isr_crc;
+#if SUPPORT_CHANGE_ALARM
+bool comm_isr_ack;					//!< Set if the read started with the value page.
+#endif
+
+static void
+comm_isr_rx(uint8_t state) {
+	comm_isr_state = state;
+	comm_isr_tx = false;
+	comm_isr_count = 8;
+}
+
+static void
+comm_isr_send(uint8_t state, uint8_t byte) {
+	comm_isr_state = state;
+	comm_isr_tx = true;
+	comm_isr_byte = byte;
+	comm_isr_count = 8;
+}
+
+static uint8_t
+comm_rom_bit() {
+	return (comm_rom.d[comm_isr_index >> 3] >> (comm_isr_index & 7)) & 1;
+}
+
+static void
+comm_isr_mem_next() {
+	if(comm_isr_addr >= 23) {
+		comm_isr_rx(COMM_ST_IDLE);
+	} else if(comm_isr_cmd == COMM_FUNCCMD_RD_MEM) {
+		const uint8_t byte = ((uint8_t*)&value)[comm_isr_addr];
+
+		comm_isr_crc = _crc16_update(comm_isr_crc, byte);
+		comm_isr_send(COMM_ST_MEM_DATA, byte);
+	} else {
+		comm_isr_rx(COMM_ST_MEM_DATA);
+	}
+}
+
+#if EMULATE_DS18B20
+static void
+comm_isr_scratch_next() {
+	uint8_t byte = 0;
+
+	if(comm_isr_index > 8) {
+		comm_isr_rx(COMM_ST_IDLE);
+		return;
+	}
+
+	if(comm_isr_index < 2)
+		byte = ((uint8_t*)&value.temp)[comm_isr_index];
+	else if(comm_isr_index == 8)
+		byte = comm_isr_crc;
+
+	comm_isr_crc = _crc_ibutton_update(comm_isr_crc, byte);
+	comm_isr_index++;
+	comm_isr_send(COMM_ST_RD_SCRATCH, byte);
+}
+#endif
+
+#if SUPPORT_RD_VALUES
+static void
+comm_isr_values_next() {
+	uint8_t byte;
+
+	if(comm_isr_index < RD_VALUES_LEN) {
+		byte = rd_values_byte(comm_isr_index);
+		comm_isr_crc = _crc16_update(comm_isr_crc, byte);
+	} else if(comm_isr_index == RD_VALUES_LEN) {
+		byte = comm_isr_crc;
+	} else if(comm_isr_index == RD_VALUES_LEN + 1) {
+		byte = comm_isr_crc >> 8;
+	} else {
+#if SUPPORT_CHANGE_ALARM
+		ack_values();
+#endif
+		comm_isr_rx(COMM_ST_IDLE);
+		return;
+	}
+
+	comm_isr_index++;
+	comm_isr_send(COMM_ST_RD_VALUES, byte);
+}
+#endif
+
+#if SUPPORT_HISTORY
+//!	Sends the RD_HISTORY frame, with comm_isr_addr as
+//!	the record and comm_isr_index as the byte within it.
+static void
+comm_isr_history_next() {
+	uint8_t byte;
+
+	if(comm_isr_addr <= history_total()) {
+		byte = history_byte(comm_isr_addr, comm_isr_index);
+		comm_isr_crc = _crc16_update(comm_isr_crc, byte);
+		if(++comm_isr_index == HISTORY_RECORD_LEN) {
+			comm_isr_index = 0;
+			comm_isr_addr++;
+		}
+	} else if(comm_isr_index == 0) {
+		byte = comm_isr_crc;
+		comm_isr_index++;
+	} else if(comm_isr_index == 1) {
+		byte = comm_isr_crc >> 8;
+		comm_isr_index++;
+	} else {
+		comm_isr_rx(COMM_ST_IDLE);
+		return;
+	}
+
+	comm_isr_send(COMM_ST_RD_HISTORY, byte);
+}
+#endif
+
+//!	Hands `cmd` over to the main context.
+static void
+comm_isr_run(uint8_t cmd) {
+	comm_isr_pending = cmd;
+
+	// Read slots return zeros until the command is done.
+	comm_isr_send(COMM_ST_BUSY, 0);
+}
+
+//!	Called with every completed byte.
+static void
+comm_isr_next(uint8_t byte) {
+	switch(comm_isr_state) {
+	case COMM_ST_ROM_CMD:
+		comm_isr_index = 0;
+		if(byte == COMM_ROMCMD_READ) {
+			comm_isr_send(COMM_ST_ROM_READ, comm_rom.d[0]);
+		} else if(byte == COMM_ROMCMD_MATCH) {
+			comm_isr_rx(COMM_ST_ROM_MATCH);
+		} else if((byte == COMM_ROMCMD_SEARCH)
+		    || ((byte == COMM_ROMCMD_ALARM_SEARCH)
+		        && get_alarm_condition()
+		    )
+		) {
+			goto search_bit;
+		} else if(byte == COMM_ROMCMD_SKIP) {
+			comm_isr_rx(COMM_ST_FUNC_CMD);
+		} else {
+			comm_isr_rx(COMM_ST_IDLE);
+		}
+		break;
+
+	case COMM_ST_ROM_READ:
+		if(++comm_isr_index == 8)
+			comm_isr_rx(COMM_ST_FUNC_CMD);
+		else
+			comm_isr_send(COMM_ST_ROM_READ, comm_rom.d[comm_isr_index]);
+		break;
+
+	case COMM_ST_ROM_MATCH:
+		if(byte != comm_rom.d[comm_isr_index])
+			comm_isr_rx(COMM_ST_IDLE);
+		else if(++comm_isr_index == 8)
+			comm_isr_rx(COMM_ST_FUNC_CMD);
+		else
+			comm_isr_rx(COMM_ST_ROM_MATCH);
+		break;
+
+	// Search is done one slot at a time: our bit, its
+	// complement, and then the direction the master picked.
+	case COMM_ST_SEARCH_BIT:
+		comm_isr_send(COMM_ST_SEARCH_CMP, ~comm_rom_bit());
+		comm_isr_count = 1;
+		break;
+
+	case COMM_ST_SEARCH_CMP:
+		comm_isr_rx(COMM_ST_SEARCH_DIR);
+		comm_isr_count = 1;
+		break;
+
+	case COMM_ST_SEARCH_DIR:
+		if((byte >> 7) != comm_rom_bit()) {
+			comm_isr_rx(COMM_ST_IDLE);
+			break;
+		}
+		if(++comm_isr_index == 64) {
+			comm_isr_rx(COMM_ST_FUNC_CMD);
+			break;
+		}
+search_bit:
+		comm_isr_send(COMM_ST_SEARCH_BIT, comm_rom_bit());
+		comm_isr_count = 1;
+		break;
+
+	case COMM_ST_FUNC_CMD:
+		comm_isr_cmd = byte;
+		comm_isr_index = 0;
+		if((byte == COMM_FUNCCMD_RD_MEM)
+		    || (byte == COMM_FUNCCMD_WR_MEM)
+		) {
+			// Initialize the CRC by shifting in the command.
+			comm_isr_crc = _crc16_update(0, byte);
+			comm_isr_rx(COMM_ST_MEM_ADDR);
+		} else if(byte == COMM_FUNCCMD_CONVERT) {
+			comm_isr_rx(COMM_ST_CONVERT_ARGS);
+		} else if((byte == COMM_FUNCCMD_COMMIT_MEM)
+		    || (byte == COMM_FUNCCMD_RECALL_MEM)
+		    || (byte == COMM_FUNCCMD_CONVERT_T)
+		) {
+			comm_isr_run(byte);
+#if EMULATE_DS18B20
+		} else if(byte == COMM_FUNCCMD_RD_SCRATCH) {
+			comm_isr_crc = 0;
+			comm_isr_scratch_next();
+#endif
+#if SUPPORT_RD_VALUES
+		} else if(byte == COMM_FUNCCMD_RD_VALUES) {
+			comm_isr_crc = _crc16_update(0, byte);
+			comm_isr_values_next();
+#endif
+#if SUPPORT_HISTORY
+		} else if(byte == COMM_FUNCCMD_RD_HISTORY) {
+			comm_isr_crc = _crc16_update(0, byte);
+			comm_isr_addr = 0;
+			comm_isr_history_next();
+#endif
+		} else {
+			comm_isr_rx(COMM_ST_IDLE);
+		}
+		break;
+
+	case COMM_ST_MEM_ADDR:
+		// Only the low byte of the address matters, but
+		// the CRC is calculated as if the high byte was zero.
+		if(comm_isr_index++ == 0) {
+			comm_isr_addr = byte;
+			comm_isr_crc = _crc16_update(comm_isr_crc, byte);
+			comm_isr_rx(COMM_ST_MEM_ADDR);
+		} else {
+			comm_isr_crc = _crc16_update(comm_isr_crc, 0);
+#if SUPPORT_CHANGE_ALARM
+			comm_isr_ack = (comm_isr_addr == 0);
+#endif
+			comm_isr_mem_next();
+		}
+		break;
+
+	case COMM_ST_MEM_DATA:
+		if(comm_isr_cmd == COMM_FUNCCMD_WR_MEM) {
+			((uint8_t*)&value)[comm_isr_addr] = byte;
+			comm_isr_crc = _crc16_update(comm_isr_crc, byte);
+#if SUPPORT_CFG_JOURNAL
+			if(comm_isr_addr >= sizeof(value))
+				cfg_commit_restart();
+#endif
+		}
+
+		// Write out the CRC at every 8-byte page boundry.
+		if((++comm_isr_addr & 7) == 0) {
+			comm_isr_index = 0;
+			comm_isr_send(COMM_ST_MEM_CRC, comm_isr_crc);
+		} else {
+			comm_isr_mem_next();
+		}
+		break;
+
+	case COMM_ST_MEM_CRC:
+		if(comm_isr_index++ == 0) {
+			comm_isr_send(COMM_ST_MEM_CRC, comm_isr_crc >> 8);
+		} else {
+#if SUPPORT_CHANGE_ALARM
+			if(comm_isr_ack && (comm_isr_addr == 8) && (comm_isr_cmd == COMM_FUNCCMD_RD_MEM))
+				ack_values();
+#endif
+			comm_isr_crc = 0;
+			comm_isr_mem_next();
+		}
+		break;
+
+	case COMM_ST_CONVERT_ARGS:
+		// The read-out control is ignored.
+		if(comm_isr_index++ == 0) {
+#if SUPPORT_CONVERT_SELECT
+			comm_isr_channels = byte;
+#endif
+			comm_isr_rx(COMM_ST_CONVERT_ARGS);
+		} else {
+			comm_isr_run(COMM_FUNCCMD_CONVERT);
+		}
+		break;
+
+#if EMULATE_DS18B20
+	case COMM_ST_RD_SCRATCH:
+		comm_isr_scratch_next();
+		break;
+#endif
+
+#if SUPPORT_RD_VALUES
+	case COMM_ST_RD_VALUES:
+		comm_isr_values_next();
+		break;
+#endif
+
+#if SUPPORT_HISTORY
+	case COMM_ST_RD_HISTORY:
+		comm_isr_history_next();
+		break;
+#endif
+
+	default:
+		// Keep doing whatever we were doing.
+		comm_isr_count = 8;
+		break;
+	}
+}
+
+//!	Called at the end of every slot with the level of the bus.
+static void
+comm_isr_slot(uint8_t bit) {
+	comm_isr_slot_open = false;
+
+	comm_isr_byte >>= 1;
+	if(bit)
+		sbi(comm_isr_byte, 7);
+
+	if(!--comm_isr_count)
+		comm_isr_next(comm_isr_byte);
+}
+
+#endif // USE_ISR_SLAVE
+
+#if COMM_PHY_PROTO == COMM_PHY_2WIRE
+// The USI does all of the shifting, and holds SCK low until we have
+// set it up for whatever comes next, so there is no bit timing to get
+// right here. The memory pages, ROM ID and function commands are
+// mapped onto registers, see COMM_REG_MEM and friends.
+
+//!	2-Wire Slave States
+enum {
+	COMM_USI_ADDRESS,		//!< Check the address byte
+	COMM_USI_SEND,			//!< Send the next register
+	COMM_USI_SEND_ACK_REQ,	//!< Byte sent, read the master's ACK
+	COMM_USI_SEND_ACK,		//!< Check the master's ACK
+	COMM_USI_RECV,			//!< Receive the next byte
+	COMM_USI_RECV_ACK,		//!< Byte received, ACK it
+};
+
+#define COMM_USI_FLAGS		(_BV(USIOIF) | _BV(USIPF) | _BV(USIDC))
+
+uint8_t comm_usi_state;
+uint8_t comm_usi_reg;			//!< Register pointer.
+bool comm_usi_got_reg;			//!< Set once the register pointer was written.
+
+static void
+comm_usi_wait_start() {
+	// Hold SCK low after a start condition, but not on overflow.
+	USICR = _BV(USISIE) | _BV(USIWM1) | _BV(USICS1);
+	USISR = _BV(USISIF) | COMM_USI_FLAGS;
+}
+
+//!	Sets up the USI to shift `bits` bits, driving SDA if `drive` is set.
+static void
+comm_usi_shift(bool drive, uint8_t bits) {
+	if(drive)
+		sbi(DDRB, COMM_SDA);
+	else
+		cbi(DDRB, COMM_SDA);
+
+	// The counter is clocked by both edges of SCK.
+	USISR = COMM_USI_FLAGS | (uint8_t)(16 - bits * 2);
+}
+
+static uint8_t
+comm_usi_reg_read(uint8_t reg) {
+	if(reg < COMM_REG_ROM)
+		return ((uint8_t*)&value)[reg];
+	if(reg < COMM_REG_CMD)
+		return comm_rom.d[reg - COMM_REG_ROM];
+	if(reg == COMM_REG_CMD)
+		return comm_isr_pending;
+#if SUPPORT_CONVERT_SELECT
+	if(reg == COMM_REG_CONVERT)
+		return comm_isr_channels;
+#endif
+	return 0xFF;
+}
+
+static void
+comm_usi_reg_write(uint8_t reg, uint8_t byte) {
+	// Same range as WRITEMEM.
+	if(reg < 23) {
+		((uint8_t*)&value)[reg] = byte;
+#if SUPPORT_CFG_JOURNAL
+		if(reg >= sizeof(value))
+			cfg_commit_restart();
+#endif
+	} else if((reg == COMM_REG_CMD)
+	    && ((byte == COMM_FUNCCMD_CONVERT)
+	        || (byte == COMM_FUNCCMD_CONVERT_T)
+	        || (byte == COMM_FUNCCMD_COMMIT_MEM)
+	        || (byte == COMM_FUNCCMD_RECALL_MEM)
+	    )
+	) {
+		comm_isr_pending = byte;
+	}
+#if SUPPORT_CONVERT_SELECT
+	else if(reg == COMM_REG_CONVERT)
+		comm_isr_channels = byte;
+#endif
+}
+#endif // COMM_PHY_PROTO == COMM_PHY_2WIRE
+
+#if COMM_IS_INTERRUPT_DRIVEN
+//!	Runs whatever command the bus slave has handed over to us.
+static void
+comm_isr_service() {
+	const uint8_t cmd = comm_isr_pending;
+
+	if(!cmd)
+		return;
+
+#if SUPPORT_CONVERT_SELECT
+	if(cmd == COMM_FUNCCMD_CONVERT)
+		do_convert(comm_isr_channels);
+	else if(cmd == COMM_FUNCCMD_CONVERT_T)
+		do_convert(CONVERT_ALL);
+#else
+	if((cmd == COMM_FUNCCMD_CONVERT) || (cmd == COMM_FUNCCMD_CONVERT_T))
+		do_convert(CONVERT_ALL);
+#endif
+	else if(cmd == COMM_FUNCCMD_COMMIT_MEM)
+		do_commit();
+	else if(cmd == COMM_FUNCCMD_RECALL_MEM)
+		do_recall();
+
+	// If another command came in while we were
+	// busy, it will be picked up the next time around.
+	cli();
+	if(comm_isr_pending == cmd) {
+		comm_isr_pending = 0;
+#if USE_ISR_SLAVE
+		if(comm_isr_state == COMM_ST_BUSY)
+			comm_isr_rx(COMM_ST_IDLE);
+#endif
+	}
+	sei();
+}
+#endif
+
+#if SUPPORT_HISTORY
+//!	Adds the values from the last conversion to the history. When
+//!	the SRAM history is full, its oldest record is moved out to the
+//!	EEPROM history, or dropped if there isn't one.
+//!	Returns false if the history is being read out from interrupts,
+//!	in which case we try again after the next background conversion.
+static bool
+history_record() {
+	uint8_t record[HISTORY_RECORD_LEN];
+
+	record[0] = value.moisture;
+	record[1] = value.moisture >> 8;
+#if SUPPORT_TEMP_READING
+	record[2] = (value.temp + 8) >> 4;
+#else
+	record[2] = 0x80;
+#endif
+
+#if HISTORY_EEPROM_LEN
+	if(history_count == HISTORY_LEN) {
+		// Drop the record we are about to overwrite first,
+		// so a reset pulse can't leave a half-written one behind.
+		if(history_eeprom_count == HISTORY_EEPROM_LEN)
+			history_eeprom_count--;
+		eeprom_update_block(
+			history[history_head],
+			history_eeprom[history_eeprom_head],
+			HISTORY_RECORD_LEN
+		);
 	}
-#else
-#error COMM_PHY_PROTO not set properly!
 #endif
-}
 
-static inline void
-comm_send_presence() {
-#if COMM_PHY_PROTO == COMM_PHY_1WIRE
-	// Wait for reset pulse to end.
-	while(bit_is_clear(PINB, COMM_SDA)) sleep_cpu();
+	cli();
+#if USE_ISR_SLAVE
+	// The read-out works straight from the history,
+	// so leave it be until the master is done with it.
+	if(comm_isr_state == COMM_ST_RD_HISTORY) {
+		sei();
+		return false;
+	}
+#endif
+	if(history_count == HISTORY_LEN) {
+#if HISTORY_EEPROM_LEN
+		if(++history_eeprom_head == HISTORY_EEPROM_LEN)
+			history_eeprom_head = 0;
+		history_eeprom_count++;
+#endif
+		history_count--;
+	}
+	memcpy(history[history_head], record, HISTORY_RECORD_LEN);
+	if(++history_head == HISTORY_LEN)
+		history_head = 0;
+	history_count++;
+	history_seq++;
+	sei();
 
-	// Let the bus idle for 20µSec after the end of the reset pulse.
-	_delay_us(20);
+	return true;
+}
+#endif
 
-	// Send the 80µSec presence pulse.
-	sbi(DDRB, COMM_SDA);
-	_delay_us(80);
-	cbi(DDRB, COMM_SDA);
-#elif COMM_PHY_PROTO == COMM_PHY_FxB
-	// Wait for reset pulse to end.
-	while(bit_is_clear(PINB, COMM_SDA)) sleep_cpu();
+#if SUPPORT_AUTO_CONVERT
+//!	Runs a background conversion, and adds every
+//!	HISTORY_INTERVAL-th one to the history.
+static void
+do_auto_convert() {
+	auto_convert_ticks = 0;
+#if USE_RESPONSE_CACHE
+	comm_crc_valid = false;
+#endif
+	convert_values(CONVERT_ALL);
+#if USE_RESPONSE_CACHE
+	comm_prepare_crcs();
+#endif
 
-	// Send a '0' bit for our presence.
-	comm_write_bit(0);
-#else
-#error COMM_PHY_PROTO not set properly!
+#if SUPPORT_HISTORY
+	if(history_ticks != 0xFF)
+		history_ticks++;
+	if((history_ticks >= HISTORY_INTERVAL) && history_record())
+		history_ticks = 0;
 #endif
 }
+#endif
 
-static uint8_t
-comm_read_byte() {
-	// We really DON'T need to initialize this. Honest.
-	uint8_t ret;
+#if USE_IDLE_SLEEP
+//!	Sleeps until the next interrupt, unless the main loop already
+//!	has something to do. Power-down is used whenever nothing needs
+//!	the clock to keep running, which leaves the pin change (or USI
+//!	start condition) and the watchdog to wake us up.
+static void
+idle_sleep() {
+	cli();
 
-	for(uint8_t i = 0; i != 8; i++) {
-		ret >>= 1;
-		if(comm_read_bit())
-			sbi(ret, 7);
+#if COMM_IS_INTERRUPT_DRIVEN
+	if(comm_isr_pending
+#if SUPPORT_CFG_JOURNAL
+	    || (cfg_commit_left && eeprom_is_ready())
+#endif
+	) {
+		sei();
+		return;
 	}
-	return ret;
-}
+#endif
 
-static void
-comm_write_byte(uint8_t byte) {
-	for(uint8_t i = 0; i != 8; i++) {
-		comm_write_bit(byte & 1);
-		byte >>= 1;
+#if SUPPORT_AUTO_CONVERT
+	if(auto_convert_is_due()) {
+		sei();
+		return;
 	}
-}
+#endif
 
-static inline uint16_t
-comm_read_word() {
-	return comm_read_byte() + (comm_read_byte() << 8);
-}
+	if(clk_io_is_idle()
+#if SUPPORT_AUTO_CONVERT
+	    // Timer1 stops in power-down.
+	    && !(cfg.flags & CFG_FLAG_AUTO_CONVERT)
+#endif
+#if SUPPORT_CFG_JOURNAL && COMM_IS_INTERRUPT_DRIVEN
+	    // So does the EEPROM ready interrupt.
+	    && !cfg_commit_left
+#endif
+	)
+		set_sleep_mode(SLEEP_MODE_PWR_DOWN);
+	else
+		set_sleep_mode(SLEEP_MODE_IDLE);
+
+#if SUPPORT_CFG_JOURNAL && COMM_IS_INTERRUPT_DRIVEN
+	// Wake up for the next byte of the commit, see EE_RDY_vect.
+	if(cfg_commit_left)
+		sbi(EECR, EERIE);
+#endif
 
-static inline void
-comm_write_word(uint16_t x) {
-	comm_write_byte(x);
-	comm_write_byte(x >> 8);
+#if USE_WATCHDOG
+	// Have the watchdog wake us up so that the main loop can reset
+	// it, instead of resetting us. The hardware clears WDIE when the
+	// interrupt runs, so if we stop coming back here it bites anyway.
+	WDTCR |= _BV(WDIE);
+#endif
+
+#if SUPPORT_VOLT_READING || SUPPORT_TEMP_READING
+	// An enabled ADC keeps drawing current in every sleep mode.
+	cbi(ADCSRA, ADEN);
+#endif
+
+	sleep_enable();
+	sei();
+	sleep_cpu();
+	sleep_disable();
+
+#if SUPPORT_VOLT_READING || SUPPORT_TEMP_READING
+	sbi(ADCSRA, ADEN);
+#endif
 }
+#endif
 
+#if HOST_BUILD
+// The host harness provides the real main(), and
+// calls into the firmware however it sees fit.
+#define main firmware_main
+extern void main(void);
+#else
 // These next three lines help clean out some,
 // but not all, of the C boilerplate cruft. This
 // saves a few dozen bytes without affecting behavior.
 extern void __do_clear_bss(void) __attribute__ ((naked));
 extern void main (void) __attribute__ ((naked)) __attribute__ ((section (".init8")));
 void __do_clear_bss() { }
+#endif
 
 void
 main(void) {
+#if !COMM_IS_INTERRUPT_DRIVEN
 	uint8_t cmd;
 	uint8_t flags;
+#endif
+#if SUPPORT_OVERDRIVE
+	bool was_overdrive;
+#endif
 
 	// Stop the timer, if it happens to be running.
 	TCCR0B = 0;
@@ -786,11 +3046,13 @@ main(void) {
 
 	// All pins other than COMM_SDA, MOIST_COLLECTOR_PIN,
 	// and MOIST_DRIVE_PIN are set to HIGH, which turns on
-	// the pull-up resistors.
+	// the pull-up resistors. In 2-Wire mode COMM_SDA is set
+	// HIGH as well, since the USI only drives its pins low
+	// when their PORTB bits are set.
 	PORTB = ~(
-		_BV(COMM_SDA) | _BV(MOIST_COLLECTOR_PIN) | _BV(MOIST_DRIVE_PIN)
-#if COMM_PHY_PROTO == COMM_PHY_2WIRE
-		| _BV(COMM_SCK)
+		_BV(MOIST_COLLECTOR_PIN) | _BV(MOIST_DRIVE_PIN)
+#if COMM_PHY_PROTO != COMM_PHY_2WIRE
+		| _BV(COMM_SDA)
 #endif
 	);
 
@@ -798,10 +3060,34 @@ main(void) {
 	// The interrupt handler for the overflow interrupt isn't actually
 	// defined, which means that __bad_interrupt gets called instead.
 	// This causes a soft-reset of the device by jumping to address 0x0000.
+	// (Unless USE_ISR_SLAVE is set, see TIM0_OVF_vect.)
 	TIMSK0 = _BV(TOIE0);
 
+#if COMM_IS_INTERRUPT_DRIVEN
+	comm_isr_pending = 0;
+#if SUPPORT_CONVERT_SELECT
+	comm_isr_channels = 0;
+#endif
+#endif
+
+#if USE_ISR_SLAVE
+	// The compare interrupt marks the sample point of every slot.
+	sbi(TIMSK0, OCIE0A);
+
+	comm_isr_rx(COMM_ST_IDLE);
+	comm_isr_slot_open = false;
+#endif
+
+#if SUPPORT_AUTO_CONVERT
+	// Timer1 paces background conversions, see TIM1_OVF_vect.
+	TCCR1 = _BV(CS13) | _BV(CS12) | _BV(CS11) | _BV(CS10);
+	sbi(TIMSK, TOIE1);
+#endif
+
 #if SUPPORT_CONVERT_INDICATOR && (COMM_PHY_PROTO==COMM_PHY_1WIRE)
 	OCR0A = (uint8_t)((uint32_t)OWSLAVE_T_X * F_CPU / (8l * 1000000l) );
+#elif SUPPORT_CONVERT_INDICATOR && (COMM_PHY_PROTO==COMM_PHY_FxB)
+	OCR0A = (uint8_t)((uint32_t)COMM_FxB_T_BUSY * F_CPU / (8l * 1000000l) );
 #endif
 
 #if SUPPORT_VOLT_READING || SUPPORT_TEMP_READING
@@ -809,11 +3095,10 @@ main(void) {
 #endif
 
 #if COMM_PHY_PROTO == COMM_PHY_2WIRE
-	USICR =
-		_BV(USIWM1) | _BV(USIWM0)	// 2-Wire Mode.
-		| _BV(USISIE)				// Start-Condition Interrupt Enable.
-		| _BV(USICS0) | _BV(USICS1) // External clock, negative edge.
-	;
+	// SCK has to be an output for the USI to be able to hold it low.
+	sbi(DDRB, COMM_SCK);
+
+	comm_usi_wait_start();
 #else
 	// Allow the bus pin to generate interrupts.
 	sbi(PCMSK, COMM_SDA);
@@ -840,21 +3125,71 @@ main(void) {
 		// Reset the MCU status register.
 		MCUSR = 0;
 
+#if SUPPORT_OVERDRIVE
+		comm_overdrive = false;
+#endif
+
 #if !USE_WATCHDOG
 		// We should always attempt to disable the watchdog if we
 		// are not configured to use one. (Advice from the datasheet)
 		wdt_disable();
 #endif
 
+#if SUPPORT_CFG_JOURNAL
+		// Whatever was being committed is lost.
+		cfg_commit_left = 0;
+#endif
+
 		// Load our initial settings from EEPROM.
 		do_recall();
 
+#if SUPPORT_CHANGE_ALARM
+		// Nothing has been read out yet, so the
+		// first conversion always counts as a change.
+		ack_moisture = 0;
+#if SUPPORT_TEMP_READING
+		ack_temp = 0;
+#endif
+#endif
+
+#if SUPPORT_FILTER_EWMA
+		// Start the moving average over from the next reading.
+		filter_ewma_exponent = 0;
+#endif
+
+#if SUPPORT_AUTO_CONVERT
+		auto_convert_ticks = 0;
+#if !COMM_IS_INTERRUPT_DRIVEN
+		auto_convert_quiet = 0;
+#endif
+#endif
+
+#if SUPPORT_HISTORY
+		history_head = 0;
+		history_count = 0;
+#if HISTORY_EEPROM_LEN
+		history_eeprom_head = 0;
+		history_eeprom_count = 0;
+#endif
+		history_seq = 0;
+		history_ticks = 0;
+#endif
+
 		goto wait_for_reset;
 	}
 
 	// Reset the MCU status register.
 	MCUSR = 0;
 
+#if !COMM_IS_INTERRUPT_DRIVEN
+#if SUPPORT_OVERDRIVE
+	// Overdrive resets restart us once the bus has been released,
+	// whereas a standard-speed reset pulse is still going. The
+	// latter always drops us back to standard speed.
+	if(bit_is_clear(PINB, COMM_SDA))
+		comm_overdrive = false;
+#endif
+
 	comm_send_presence();
 
 #if USE_WATCHDOG
@@ -865,6 +3200,23 @@ main(void) {
 	cmd = comm_read_byte();
 	flags = 0;
 
+#if SUPPORT_OVERDRIVE
+	// Everything after an overdrive ROM command, including the
+	// ROM ID for OD_MATCH, is sent at overdrive speed.
+	was_overdrive = comm_overdrive;
+	if((cmd == COMM_ROMCMD_OD_SKIP) || (cmd == COMM_ROMCMD_OD_MATCH)) {
+		// Both end in a '0', which the master is still sending long
+		// after we sampled it. comm_wait_idle_od() would take the
+		// rest of it for an overdrive reset pulse.
+		loop_until_bit_is_set(PINB, COMM_SDA);
+		comm_overdrive = true;
+	}
+	if(cmd == COMM_ROMCMD_OD_SKIP)
+		cmd = COMM_ROMCMD_SKIP;
+	else if(cmd == COMM_ROMCMD_OD_MATCH)
+		cmd = COMM_ROMCMD_MATCH;
+#endif
+
 	// Interpret what the ROM command means.
 	if(cmd == COMM_ROMCMD_MATCH)
 		flags = _BV(2);
@@ -890,8 +3242,13 @@ main(void) {
 				if(flags & _BV(1))
 					comm_write_bit((~byte) & 1);
 				if(flags & _BV(2))
-					if((byte & 1) ^ comm_read_bit())
+					if((byte & 1) ^ comm_read_bit()) {
+#if SUPPORT_OVERDRIVE
+						// Only a successful OD_MATCH leaves us in overdrive.
+						comm_overdrive = was_overdrive;
+#endif
 						goto wait_for_reset;
+					}
 				byte >>= 1;
 			} while(--j);
 		}
@@ -907,7 +3264,7 @@ main(void) {
 #if SUPPORT_DEVICE_NAMING
 	if(cmd == COMM_FUNCCMD_RD_NAME) {
 		for(uint8_t i = 0; i != (uint8_t)sizeof(device_name); i++) {
-			comm_write_byte(eeprom_read_byte(&device_name[i]));
+			comm_write_byte(eeprom_read_byte((const uint8_t*)&device_name[i]));
 		}
 		comm_write_byte(0x00);
 	} else
@@ -924,6 +3281,21 @@ main(void) {
 		comm_read_byte();
 		crc = _crc16_update(crc, 0);
 
+#if SUPPORT_CHANGE_ALARM
+		const bool whole_value_page = (i == 0);
+#endif
+
+#if USE_RESPONSE_CACHE
+		// Reading from the start of page 0 or 1, the CRCs are ready.
+		const uint8_t start = i;
+		bool cached = false;
+
+		if(cmd == COMM_FUNCCMD_RD_MEM)
+			cached = comm_crc_valid && ((i == 0) || (i == 8));
+		else
+			comm_crc_valid = false;
+#endif
+
 		while(i < 23) {
 			uint8_t byte;
 
@@ -938,18 +3310,34 @@ main(void) {
 			}
 
 			// Update the CRC.
-			crc = _crc16_update(crc, byte);
+#if USE_RESPONSE_CACHE
+			if(!cached)
+#endif
+				crc = _crc16_update(crc, byte);
 
 			// Write out the CRC at every 8-byte page boundry.
 			if((i & 7) == 0) {
+#if USE_RESPONSE_CACHE
+				if(cached)
+					crc = comm_crc.rd_mem[(i == 8) ? 0 : (start == 8) ? 1 : 2];
+#endif
 				comm_write_word(crc);
 				crc = 0;
+
+#if SUPPORT_CHANGE_ALARM
+				if(whole_value_page && (i == 8) && (cmd == COMM_FUNCCMD_RD_MEM))
+					ack_values();
+#endif
+#if USE_RESPONSE_CACHE
+				// ack_values() leaves the rest to be worked out here.
+				cached = cached && comm_crc_valid && (i == 8);
+#endif
 			}
 		}
 	} else if(cmd == COMM_FUNCCMD_CONVERT) {
-		comm_read_byte();    // Ignore input select mask
+		const uint8_t channels = comm_read_byte();    // Input select mask
 		comm_read_byte();    // Ignore read-out control
-		do_convert();
+		do_convert(channels);
 	} else if(cmd == COMM_FUNCCMD_COMMIT_MEM) {
 		comm_begin_busy();
 		do_commit();
@@ -959,37 +3347,124 @@ main(void) {
 		do_recall();
 		comm_end_busy();
 	} else if(cmd == COMM_FUNCCMD_CONVERT_T) {
-		do_convert();
+		do_convert(CONVERT_ALL);
 	}
 #if EMULATE_DS18B20
 	else if(cmd == COMM_FUNCCMD_RD_SCRATCH) {
-		uint8_t crc = 0;
-		crc = _crc_ibutton_update(crc, ((uint8_t*)&value.temp)[0]);
-		comm_write_byte(((uint8_t*)&value.temp)[0]);
-		crc = _crc_ibutton_update(crc, ((uint8_t*)&value.temp)[1]);
-		comm_write_byte(((uint8_t*)&value.temp)[1]);
-		for(uint8_t i = 0; i < 6; i++) {
-			crc = _crc_ibutton_update(crc, 0);
-			comm_write_byte(0);
+#if USE_RESPONSE_CACHE
+		if(comm_crc_valid) {
+			comm_write_byte(((uint8_t*)&value.temp)[0]);
+			comm_write_byte(((uint8_t*)&value.temp)[1]);
+			for(uint8_t i = 0; i < 6; i++)
+				comm_write_byte(0);
+			comm_write_byte(comm_crc.rd_scratch);
+		} else
+#endif
+		{
+			uint8_t crc = 0;
+			crc = _crc_ibutton_update(crc, ((uint8_t*)&value.temp)[0]);
+			comm_write_byte(((uint8_t*)&value.temp)[0]);
+			crc = _crc_ibutton_update(crc, ((uint8_t*)&value.temp)[1]);
+			comm_write_byte(((uint8_t*)&value.temp)[1]);
+			for(uint8_t i = 0; i < 6; i++) {
+				crc = _crc_ibutton_update(crc, 0);
+				comm_write_byte(0);
+			}
+			comm_write_byte(crc);
+		}
+	}
+#endif
+#if SUPPORT_RD_VALUES
+	else if(cmd == COMM_FUNCCMD_RD_VALUES) {
+#if USE_RESPONSE_CACHE
+		const bool cached = comm_crc_valid;
+#endif
+		uint16_t crc = _crc16_update(0, cmd);
+
+		for(uint8_t i = 0; i != RD_VALUES_LEN; i++) {
+			const uint8_t byte = rd_values_byte(i);
+
+			comm_write_byte(byte);
+#if USE_RESPONSE_CACHE
+			if(!cached)
+#endif
+				crc = _crc16_update(crc, byte);
+		}
+
+#if USE_RESPONSE_CACHE
+		if(cached)
+			crc = comm_crc.rd_values;
+#endif
+		comm_write_word(crc);
+
+#if SUPPORT_CHANGE_ALARM
+		ack_values();
+#endif
+	}
+#endif
+#if SUPPORT_HISTORY
+	else if(cmd == COMM_FUNCCMD_RD_HISTORY) {
+		const uint8_t count = history_total();
+		uint16_t crc = _crc16_update(0, cmd);
+
+		for(uint8_t n = 0; n <= count; n++) {
+			for(uint8_t i = 0; i != HISTORY_RECORD_LEN; i++) {
+				const uint8_t byte = history_byte(n, i);
+
+				comm_write_byte(byte);
+				crc = _crc16_update(crc, byte);
+			}
 		}
-		comm_write_byte(crc);
+
+		comm_write_word(crc);
 	}
 #endif
+#endif // !COMM_IS_INTERRUPT_DRIVEN
 
 wait_for_reset:
 	for(;;) {
+#if COMM_PHY_PROTO != COMM_PHY_2WIRE
 		// Allow the bus pin to generate interrupts.
 		sbi(PCMSK, COMM_SDA);
 
 		// Turn on the pin-change interrupt.
 		sbi(GIMSK, PCIE);
+#endif
 
 		// Enable interrupts.
 		sei();
 
+#if COMM_IS_INTERRUPT_DRIVEN
+		comm_isr_service();
+#endif
+
+#if SUPPORT_CFG_JOURNAL && COMM_IS_INTERRUPT_DRIVEN
+		cfg_commit_step();
+#endif
+
+#if USE_RESPONSE_CACHE
+		// Catch up after WR_MEM or a read-out while the bus is idle.
+		// A reset pulse in the middle just leaves it to the next time.
+		if(!comm_crc_valid)
+			comm_prepare_crcs();
+#endif
+
+#if SUPPORT_AUTO_CONVERT
+		// No busy indicator here: the master isn't waiting
+		// on us, and may well be talking to someone else. The
+		// blocking slave only gets here between transactions,
+		// and a reset pulse still abandons the conversion.
+		if(auto_convert_is_due())
+			do_auto_convert();
+#endif
+
 #if USE_WATCHDOG
 		wdt_reset();
 #endif
+
+#if USE_IDLE_SLEEP
+		idle_sleep();
+#endif
 	}
 }
 
@@ -1000,14 +3475,76 @@ ISR(TIM0_COMPA_vect) {
 #if COMM_PHY_PROTO == COMM_PHY_1WIRE
 	cbi(DDRB, COMM_SDA);
 	was_interrupted++;
+#if USE_ISR_SLAVE
+	// Still low at the sample point, so this is a zero.
+	if(comm_isr_slot_open)
+		comm_isr_slot(0);
+#endif
 #elif COMM_PHY_PROTO == COMM_PHY_FxB
-	// TODO: Writeme!
+	// Let go of the busy '0' PCINT0_vect started. The timer is stopped
+	// first, so that the end of our own pulse isn't taken for the end
+	// of another slot-opening pulse.
+	if(bit_is_set(DDRB, COMM_SDA)) {
+		TCCR0B = 0;
+		cbi(DDRB, COMM_SDA);
+	}
+	was_interrupted++;
 #endif
 }
 #endif
 
+#if USE_ISR_SLAVE
+ISR(TIM0_OVF_vect) {
+	// Reset pulse. Whatever the main context is doing carries on.
+	TCCR0B = 0;
+	cbi(DDRB, COMM_SDA);
+	comm_isr_slot_open = false;
+	comm_isr_rx(COMM_ST_RESET);
+}
+
+// Pin change interrupt
+ISR(PCINT0_vect) {
+	const uint8_t timer_was_running = TCCR0B;
+
+	TCCR0B = 0; // Stop the timer.
+
+	was_interrupted++;
+
+	// Is this a high-to-low transition?
+	if(bit_is_clear(PINB, COMM_SDA)) {
+		// Assert our zero bit, TIM0_COMPA_vect lets it go.
+		if(comm_isr_tx && !(comm_isr_byte & 1))
+			sbi(DDRB, COMM_SDA);
+
+		TCNT0 = 0; // Reset counter.
+		TCCR0B = (1 << 1);
+		comm_isr_slot_open = true;
+	} else if(comm_isr_state == COMM_ST_RESET) {
+		// Let the bus idle for 20µSec after the end of the reset pulse.
+		_delay_us(20);
+
+		// Send the 80µSec presence pulse.
+		sbi(DDRB, COMM_SDA);
+		_delay_us(80);
+		cbi(DDRB, COMM_SDA);
+
+		// Forget the edges of our own presence pulse.
+		sbi(GIFR, PCIF);
+
+		comm_isr_rx(COMM_ST_ROM_CMD);
+	} else if(comm_isr_slot_open || !timer_was_running) {
+		// Released before the sample point, or so quickly
+		// that we missed the slot opening: either way a one.
+		comm_isr_slot(1);
+	}
+}
+#else
 // Pin change interrupt
 ISR(PCINT0_vect) {
+#if SUPPORT_CONVERT_INDICATOR && (COMM_PHY_PROTO == COMM_PHY_FxB)
+	const uint8_t timer_was_running = TCCR0B;
+#endif
+
 	TCCR0B = 0; // Stop the timer.
 
 #if SUPPORT_CONVERT_INDICATOR
@@ -1016,13 +3553,9 @@ ISR(PCINT0_vect) {
 
 	// Is this a high-to-low transition?
 	if(bit_is_clear(PINB, COMM_SDA)) {
-#if SUPPORT_CONVERT_INDICATOR
-#if COMM_PHY_PROTO == COMM_PHY_1WIRE
+#if SUPPORT_CONVERT_INDICATOR && (COMM_PHY_PROTO == COMM_PHY_1WIRE)
 		if(bit_is_set(TIMSK0, OCIE0A))
 			sbi(DDRB, COMM_SDA);
-#elif COMM_PHY_PROTO == COMM_PHY_FxB
-	// TODO: Writeme!
-#endif
 #endif
 
 		TCNT0 = 0; // Reset counter.
@@ -1032,7 +3565,152 @@ ISR(PCINT0_vect) {
 		// @8.0MHz: ~1µSecond per tick, 256µSecond reset pulse
 		TCCR0B = (1 << 1);
 	}
+#if SUPPORT_CONVERT_INDICATOR && (COMM_PHY_PROTO == COMM_PHY_FxB)
+	else if(timer_was_running && bit_is_set(TIMSK0, OCIE0A)) {
+		// A Fox-Bus™ slot sees the device's '0' after the pulse
+		// opening it, so this is where we start our busy '0'. Our
+		// own falling edge then restarts the timer like any other,
+		// and TIM0_COMPA_vect lets go.
+		sbi(DDRB, COMM_SDA);
+	}
+#endif
+#if SUPPORT_OVERDRIVE
+	else {
+		// Overdrive reset pulses are too short to overflow the timer,
+		// so we have to catch them when they end.
+		if(comm_overdrive
+		    && (TCNT0 >= (uint8_t)((uint32_t)OWSLAVE_T_RSTL_OD * F_CPU / (8l * 1000000l)))
+		) {
+			comm_send_presence_od();
+			comm_reset();
+		} else {
+			TCNT0 = 0;
+		}
+	}
+#endif
+
+#if SUPPORT_AUTO_CONVERT
+	auto_convert_quiet = 0;
+#endif
+}
+#endif // USE_ISR_SLAVE
+
+#endif
+
+#if USE_IDLE_SLEEP && USE_WATCHDOG
+// Only here to wake up idle_sleep(), see there.
+EMPTY_INTERRUPT(WDT_vect);
+#endif
+
+#if USE_IDLE_SLEEP && SUPPORT_CFG_JOURNAL && COMM_IS_INTERRUPT_DRIVEN
+// Also only here to wake up idle_sleep(). This one keeps
+// coming for as long as the EEPROM is ready, so it turns
+// itself off.
+ISR(EE_RDY_vect) {
+	cbi(EECR, EERIE);
+}
+#endif
+
+#if USE_ADC_ISR
+// Bus interrupts may cut in, so this doesn't add to their response time.
+ISR(ADC_vect, ISR_NOBLOCK) {
+	adc_step();
+}
+#endif
+
+#if SUPPORT_AUTO_CONVERT
+ISR(TIM1_OVF_vect) {
+#if SUPPORT_CONVERT_INDICATOR
+	was_interrupted++;
+#endif
+
+	if(auto_convert_ticks != 0xFF)
+		auto_convert_ticks++;
+
+#if !COMM_IS_INTERRUPT_DRIVEN
+	// Counts whole ticks without a bus edge, see auto_convert_is_due().
+	if(auto_convert_quiet != 0xFF)
+		auto_convert_quiet++;
+#endif
+
+	// Waking up idle_sleep() is enough, the main loop does the rest.
+}
+#endif
+
+#if COMM_PHY_PROTO == COMM_PHY_2WIRE
+ISR(USI_START_vect) {
+#if SUPPORT_CONVERT_INDICATOR
+	was_interrupted++;
+#endif
+
+	comm_usi_state = COMM_USI_ADDRESS;
+	cbi(DDRB, COMM_SDA);
+
+	// Wait for the start condition to finish (SCK low),
+	// or to turn out to be a stop condition (SDA high).
+	while(bit_is_set(PINB, COMM_SCK) && bit_is_clear(PINB, COMM_SDA)) { }
+
+	if(bit_is_clear(PINB, COMM_SDA)) {
+		// Receive the address, holding SCK low on overflow.
+		USICR = _BV(USISIE) | _BV(USIOIE)
+			| _BV(USIWM1) | _BV(USIWM0) | _BV(USICS1);
+	} else {
+		USICR = _BV(USISIE) | _BV(USIWM1) | _BV(USICS1);
+	}
+	USISR = _BV(USISIF) | COMM_USI_FLAGS;
 }
 
+ISR(USI_OVF_vect) {
+#if SUPPORT_CONVERT_INDICATOR
+	was_interrupted++;
 #endif
 
+	switch(comm_usi_state) {
+	case COMM_USI_ADDRESS:
+		if((USIDR >> 1) != COMM_2WIRE_ADDR) {
+			comm_usi_wait_start();
+			break;
+		}
+		comm_usi_got_reg = false;
+		comm_usi_state = (USIDR & 1) ? COMM_USI_SEND : COMM_USI_RECV;
+		goto send_ack;
+
+	case COMM_USI_SEND_ACK:
+		// A NACK means the master has read all it wants.
+		if(USIDR) {
+			comm_usi_wait_start();
+			break;
+		}
+		// Fall through.
+	case COMM_USI_SEND:
+		USIDR = comm_usi_reg_read(comm_usi_reg++);
+		comm_usi_state = COMM_USI_SEND_ACK_REQ;
+		comm_usi_shift(true, 8);
+		break;
+
+	case COMM_USI_SEND_ACK_REQ:
+		comm_usi_state = COMM_USI_SEND_ACK;
+		USIDR = 0;
+		comm_usi_shift(false, 1);
+		break;
+
+	case COMM_USI_RECV:
+		comm_usi_state = COMM_USI_RECV_ACK;
+		comm_usi_shift(false, 8);
+		break;
+
+	case COMM_USI_RECV_ACK:
+		// The first byte of a write sets the register pointer.
+		if(comm_usi_got_reg)
+			comm_usi_reg_write(comm_usi_reg++, USIDR);
+		else
+			comm_usi_reg = USIDR;
+		comm_usi_got_reg = true;
+		comm_usi_state = COMM_USI_RECV;
+send_ack:
+		USIDR = 0;
+		comm_usi_shift(true, 1);
+		break;
+	}
+}
+#endif